@@ -301,6 +301,32 @@ pcapng_line_input_byte(unsigned char c)
   return 1;
 }
 
+/*---------------------------------------------------------------------------*/
+int
+pcapng_line_input_room(void)
+{
+  return ringbuf_size(&rxbuf) - 1 - ringbuf_elements(&rxbuf);
+}
+
+/*---------------------------------------------------------------------------*/
+int
+pcapng_line_input(const uint8_t *data, int len)
+{
+  int i;
+
+  for(i = 0; i < len; i++) {
+    if(!ringbuf_put(&rxbuf, data[i])) {
+      break;
+    }
+  }
+
+  /* Wake up consumer process once for the whole block */
+  if(i > 0) {
+    process_poll(&pcapng_line_process);
+  }
+  return i;
+}
+
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(pcapng_line_process, ev, data)
 {
@@ -60,6 +60,24 @@ void pcapng_line_read_epb(uint8_t * ptr, pcapng_enhanced_packet_block_s * packet
  */
 int pcapng_line_input_byte(unsigned char c);
 
+/**
+ * Get the number of bytes that pcapng_line_input() can take right
+ * now. A driver that reads from a file descriptor reads at most this
+ * much, and leaves the rest for later instead of dropping it.
+ */
+int pcapng_line_input_room(void);
+
+/**
+ * Give a block of received serial data to the pcapng line driver.
+ * Bytes that do not fit in the input buffer are dropped.
+ *
+ * \param data The data that is received.
+ * \param len The number of bytes.
+ *
+ * \return The number of bytes that were buffered.
+ */
+int pcapng_line_input(const uint8_t *data, int len);
+
 void pcapng_line_init(void);
 
 PROCESS_NAME(pcapng_line_process);
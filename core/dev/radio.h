@@ -177,6 +177,15 @@ enum {
    */
   RADIO_PARAM_64BIT_ADDR,
 
+  /*
+   * The SFD time of the last frame read with radio.read(), as an
+   * rtimer_clock_t.
+   *
+   * Because this parameter value may be larger than what fits in
+   * radio_value_t, it needs to be used with radio.get_object().
+   */
+  RADIO_PARAM_LAST_PACKET_TIMESTAMP,
+
   /* Constants (read only) */
 
   /* The lowest radio channel. */
@@ -202,6 +211,10 @@ enum {
  * are supported by the radio). A single parameter is used to allow
  * setting these features simultaneously as an atomic operation.
  *
+ * In poll mode, the radio does not pass received frames to the RDC
+ * layer. The RDC layer fetches them itself with radio.pending_packet()
+ * and radio.read(), typically from an rtimer task.
+ *
  * To enable both address filter and transmissions of automatic
  * acknowledgments:
  *
@@ -210,6 +223,7 @@ enum {
  */
 #define RADIO_RX_MODE_ADDRESS_FILTER   (1 << 0)
 #define RADIO_RX_MODE_AUTOACK          (1 << 1)
+#define RADIO_RX_MODE_POLL_MODE        (1 << 2)
 
 /**
  * The radio transmission mode controls whether transmissions should
@@ -79,4 +79,10 @@ void aes_128_set_padded_key(uint8_t *key, uint8_t key_len);
 
 extern const struct aes_128_driver AES_128;
 
+/**
+ * \brief T-table driver, with a run-time selected AES-NI path on x86.
+ *        Select it with \c AES_128_CONF.
+ */
+extern const struct aes_128_driver aes_128_ttable_driver;
+
 #endif /* AES_H_ */
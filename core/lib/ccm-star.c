@@ -81,17 +81,17 @@ ctr_step(const uint8_t *nonce,
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Computes B_0 and absorbs the additional authenticated data into x */
 static void
-mic(const uint8_t *m,  uint8_t m_len,
+mic_start(uint8_t *x,
     const uint8_t *nonce,
-    const uint8_t *a,  uint8_t a_len,
-    uint8_t *result,
+    uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
     uint8_t mic_len)
 {
-  uint8_t x[AES_128_BLOCK_SIZE];
   uint8_t pos;
   uint8_t i;
-  
+
   set_nonce(x, CCM_STAR_AUTH_FLAGS(a_len, mic_len), nonce, m_len);
   AES_128.encrypt(x);
   
@@ -112,6 +112,20 @@ mic(const uint8_t *m,  uint8_t m_len,
       AES_128.encrypt(x);
     }
   }
+}
+/*---------------------------------------------------------------------------*/
+static void
+mic(const uint8_t *m,  uint8_t m_len,
+    const uint8_t *nonce,
+    const uint8_t *a,  uint8_t a_len,
+    uint8_t *result,
+    uint8_t mic_len)
+{
+  uint8_t x[AES_128_BLOCK_SIZE];
+  uint8_t pos;
+  uint8_t i;
+  
+  mic_start(x, nonce, m_len, a, a_len, mic_len);
   
   if(m_len > 0) {
     m = a + a_len;
@@ -144,6 +158,48 @@ ctr(uint8_t *m, uint8_t m_len, const uint8_t* nonce)
   }
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Interleaves CBC-MAC and CTR block by block, so that each block of m is
+ * touched once and the MIC never needs a second walk over the frame.
+ */
+static void
+aead(const uint8_t *nonce,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result, uint8_t mic_len,
+    int forward)
+{
+  uint8_t x[AES_128_BLOCK_SIZE];
+  uint8_t s[AES_128_BLOCK_SIZE];
+  uint8_t pos;
+  uint8_t counter;
+  uint8_t i;
+
+  mic_start(x, nonce, m_len, a, a_len, mic_len);
+
+  pos = 0;
+  counter = 1;
+  while(pos < m_len) {
+    set_nonce(s, CCM_STAR_ENCRYPTION_FLAGS, nonce, counter++);
+    AES_128.encrypt(s);
+    for(i = 0; (pos + i < m_len) && (i < AES_128_BLOCK_SIZE); i++) {
+      if(forward) {
+        x[i] ^= m[pos + i];
+        m[pos + i] ^= s[i];
+      } else {
+        m[pos + i] ^= s[i];
+        x[i] ^= m[pos + i];
+      }
+    }
+    AES_128.encrypt(x);
+    pos += AES_128_BLOCK_SIZE;
+  }
+
+  ctr_step(nonce, 0, x, AES_128_BLOCK_SIZE, 0);
+
+  memcpy(result, x, mic_len);
+}
+/*---------------------------------------------------------------------------*/
 static void set_key(const uint8_t *key) {
     AES_128.set_key((uint8_t*)key);
 }
@@ -151,6 +207,7 @@ static void set_key(const uint8_t *key) {
 const struct ccm_star_driver ccm_star_driver = {
   mic,
   ctr,
-  set_key
+  set_key,
+  aead
 };
 /*---------------------------------------------------------------------------*/
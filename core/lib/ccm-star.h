@@ -83,8 +83,37 @@ struct ccm_star_driver {
    * \param key The key to use.
    */
   void (* set_key)(const uint8_t* key);
+
+  /**
+   * \brief Authenticates and en- or decrypts in a single pass (optional).
+   * \param nonce       The nonce to use. CCM_STAR_NONCE_LENGTH bytes long.
+   * \param m           The data buffer to en- or decrypt in place.
+   * \param m_len       The data buffer length.
+   * \param a           The additional authenticated data.
+   * \param a_len       The additional authenticated data length.
+   * \param result      The generated MIC will be put here.
+   * \param mic_len     The size of the MIC to be generated. <= 16.
+   * \param forward     Nonzero to encrypt, zero to decrypt.
+   *
+   *        The MIC is always computed over the plaintext. When
+   *        decrypting, the received MIC must directly follow m, so
+   *        that hardware engines can verify it as they go; callers
+   *        still compare it against \p result. May be NULL, in which
+   *        case callers fall back to mic() and ctr().
+   */
+  void (* aead)(const uint8_t* nonce,
+      uint8_t* m, uint8_t m_len,
+      const uint8_t* a, uint8_t a_len,
+      uint8_t *result, uint8_t mic_len,
+      int forward);
 };
 
 extern const struct ccm_star_driver CCM_STAR;
 
+/**
+ * \brief The generic AES_128-based driver, which hardware drivers may
+ *        fall back to.
+ */
+extern const struct ccm_star_driver ccm_star_driver;
+
 #endif /* CCM_STAR_H_ */
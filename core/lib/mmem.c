@@ -57,7 +57,13 @@
 
 LIST(mmemlist);
 unsigned int avail_memory;
-static char memory[MMEM_SIZE];
+/* The union aligns the start of the arena for any type. Blocks keep
+   that alignment if their sizes are multiples of it. */
+static union {
+  char bytes[MMEM_SIZE];
+  long align_long;
+  void *align_ptr;
+} memory;
 
 /*---------------------------------------------------------------------------*/
 /**
@@ -93,7 +99,7 @@ mmem_alloc(struct mmem *m, unsigned int size)
 
   /* Set up the pointer so that it points to the first available byte
      in the memory block. */
-  m->ptr = &memory[MMEM_SIZE - avail_memory];
+  m->ptr = &memory.bytes[MMEM_SIZE - avail_memory];
 
   /* Remember the size of this memory block. */
   m->size = size;
@@ -124,7 +130,7 @@ mmem_free(struct mmem *m)
     /* Compact the memory after the allocation that is to be removed
        by moving it downwards. */
     memmove(m->ptr, m->next->ptr,
-	    &memory[MMEM_SIZE - avail_memory] - (char *)m->next->ptr);
+	    &memory.bytes[MMEM_SIZE - avail_memory] - (char *)m->next->ptr);
     
     /* Update all the memory pointers that points to memory that is
        after the allocation that is to be removed. */
@@ -139,6 +145,47 @@ mmem_free(struct mmem *m)
   list_remove(mmemlist, m);
 }
 /*---------------------------------------------------------------------------*/
+/**
+ * \brief      Change the size of a managed memory block
+ * \param m    A pointer to the managed memory block
+ * \param size The new size of the memory block
+ * \return     Non-zero if the block could be resized, zero if there
+ *             was not enough memory left
+ *
+ *             This function resizes a managed memory block in place,
+ *             moving the blocks allocated after it. The contents of
+ *             the block are kept up to the smaller of the old and new
+ *             sizes. If the block cannot grow, it is left unchanged.
+ *
+ */
+int
+mmem_realloc(struct mmem *m, unsigned int size)
+{
+  struct mmem *n;
+  int diff = (int)size - (int)m->size;
+
+  /* Check if we have enough memory left for the new size. */
+  if(diff > 0 && avail_memory < (unsigned int)diff) {
+    return 0;
+  }
+
+  if(m->next != NULL) {
+    /* Move the memory after the block to its new position. */
+    memmove((char *)m->next->ptr + diff, m->next->ptr,
+            &memory.bytes[MMEM_SIZE - avail_memory] - (char *)m->next->ptr);
+
+    /* Update all the memory pointers that points to memory that is
+       after the block. */
+    for(n = m->next; n != NULL; n = n->next) {
+      n->ptr = (void *)((char *)n->ptr + diff);
+    }
+  }
+
+  m->size = size;
+  avail_memory -= diff;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
 /**
  * \brief      Initialize the managed memory module
  * \author     Adam Dunkels
@@ -34,6 +34,7 @@
 
 #include <ctype.h>
 #include <stdio.h>
+#include <string.h>
 
 #define MAX_PATHLEN 80
 #define MAX_HOSTLEN 40
@@ -41,6 +42,57 @@ PROCESS(http_socket_process, "HTTP socket process");
 LIST(socketlist);
 
 static void removesocket(struct http_socket *s);
+static void request_finished(struct http_socket *s, http_socket_event_t ev);
+
+/* States of the chunked transfer-coding decoder */
+enum {
+  CHUNK_SIZE,
+  CHUNK_EXT,
+  CHUNK_DATA,
+  CHUNK_DATA_END,
+  CHUNK_TRAILER,
+};
+
+static char reqbuf[HTTP_SOCKET_OUTPUTBUFSIZE];
+
+#if HTTP_SOCKET_POOL_SIZE
+enum {
+  CONN_FREE,
+  CONN_CONNECTING,
+  CONN_OPEN,
+  CONN_CLOSING,   /* Closed by us, tcp-socket has not let go yet */
+  CONN_CLOSED,    /* Closed by the peer or the network */
+};
+
+/* Request flags */
+#define REQ_WAITING     0x01    /* Waiting for a pooled connection */
+#define REQ_HEADER_SENT 0x02
+#define REQ_SENT        0x04    /* Header and body are queued */
+#define REQ_RESPONDING  0x08    /* The response has started to arrive */
+#define REQ_RETRIED     0x10
+
+/* What happens to the requests of a connection that goes away */
+#define RELEASE_REQUEUE 0       /* Unanswered requests are sent again */
+#define RELEASE_RETRY   1       /* ... unless they already were */
+#define RELEASE_FAIL    2       /* All requests fail */
+
+struct http_socket_conn {
+  struct tcp_socket s;
+  uip_ipaddr_t addr;
+  uint16_t port;
+  uint8_t state;
+  uint8_t reusable;
+  uint8_t nrequests;
+  /* Requests in the order they are sent; the head is the one whose
+     response is being received */
+  struct http_socket *head, *tail;
+  struct etimer idle_timer;
+  uint8_t inputbuf[HTTP_SOCKET_INPUTBUFSIZE];
+  uint8_t outputbuf[HTTP_SOCKET_OUTPUTBUFSIZE];
+};
+
+static struct http_socket_conn pool[HTTP_SOCKET_POOL_SIZE];
+#endif /* HTTP_SOCKET_POOL_SIZE */
 /*---------------------------------------------------------------------------*/
 static void
 call_callback(struct http_socket *s, http_socket_event_t e,
@@ -58,15 +110,32 @@ parse_header_init(struct http_socket *s)
   PT_INIT(&s->headerpt);
 }
 /*---------------------------------------------------------------------------*/
+static void
+reset_response(struct http_socket *s)
+{
+  parse_header_init(s);
+  s->header_received = 0;
+  s->bodylen = 0;
+  s->chunk_state = CHUNK_SIZE;
+  s->chunk_left = 0;
+}
+/*---------------------------------------------------------------------------*/
 static int
 parse_header_byte(struct http_socket *s, char c)
 {
   PT_BEGIN(&s->headerpt);
 
   memset(&s->header, -1, sizeof(s->header));
+  s->conn_close = 0;
+  s->chunked = 0;
 
-  /* Skip the HTTP response */
+  /* Skip the HTTP response. An HTTP/1.0 server closes the connection
+     after the response unless it says otherwise. */
+  s->header_chars = 0;
   while(c != ' ') {
+    if(s->header_chars++ == 7 && c == '0') {
+      s->conn_close = 1;
+    }
     PT_YIELD(&s->headerpt);
   }
 
@@ -79,73 +148,93 @@ parse_header_byte(struct http_socket *s, char c)
     PT_YIELD(&s->headerpt);
   }
 
-  if(s->header.status_code == 0x200 || s->header.status_code == 0x206) {
-    /* Read headers until data */
-
-    while(1) {
-      /* Skip characters until end of line */
-      do {
-        while(c != '\r') {
-          s->header_chars++;
-          PT_YIELD(&s->headerpt);
-        }
+  /* Read headers until data */
+  while(1) {
+    /* Skip characters until end of line */
+    do {
+      while(c != '\r') {
         s->header_chars++;
         PT_YIELD(&s->headerpt);
-      } while(c != '\n');
-      s->header_chars--;
+      }
+      s->header_chars++;
       PT_YIELD(&s->headerpt);
+    } while(c != '\n');
+    s->header_chars--;
 
-      if(s->header_chars == 0) {
-        /* This was an empty line, i.e. the end of headers */
-        break;
-      }
+    if(s->header_chars == 0) {
+      /* This was an empty line, i.e. the end of headers. The final
+         newline is the last byte of the header. */
+      break;
+    }
+    PT_YIELD(&s->headerpt);
 
-      /* Start of line */
-      s->header_chars = 0;
+    /* Start of line */
+    s->header_chars = 0;
 
-      /* Read header field */
-      while(c != ' ' && c != '\t' && c != ':' && c != '\r' &&
-            s->header_chars < sizeof(s->header_field) - 1) {
-        s->header_field[s->header_chars++] = c;
-        PT_YIELD(&s->headerpt);
-      }
-      s->header_field[s->header_chars] = '\0';
+    /* Read header field */
+    while(c != ' ' && c != '\t' && c != ':' && c != '\r' &&
+          s->header_chars < sizeof(s->header_field) - 1) {
+      s->header_field[s->header_chars++] = c;
+      PT_YIELD(&s->headerpt);
+    }
+    s->header_field[s->header_chars] = '\0';
+    /* Skip linear white spaces */
+    while(c == ' ' || c == '\t') {
+      s->header_chars++;
+      PT_YIELD(&s->headerpt);
+    }
+    if(c == ':') {
+      /* Skip the colon */
+      s->header_chars++;
+      PT_YIELD(&s->headerpt);
       /* Skip linear white spaces */
       while(c == ' ' || c == '\t') {
         s->header_chars++;
         PT_YIELD(&s->headerpt);
       }
-      if(c == ':') {
-        /* Skip the colon */
-        s->header_chars++;
-        PT_YIELD(&s->headerpt);
+      if(!strcasecmp(s->header_field, "Content-Length")) {
+        s->header.content_length = 0;
+        while(isdigit((int)c)) {
+          s->header.content_length = s->header.content_length * 10 + c - '0';
+          s->header_chars++;
+          PT_YIELD(&s->headerpt);
+        }
+      } else if(!strcasecmp(s->header_field, "Content-Range")) {
+        /* Skip the bytes-unit token */
+        while(c != ' ' && c != '\t') {
+          s->header_chars++;
+          PT_YIELD(&s->headerpt);
+        }
         /* Skip linear white spaces */
         while(c == ' ' || c == '\t') {
           s->header_chars++;
           PT_YIELD(&s->headerpt);
         }
-        if(!strcmp(s->header_field, "Content-Length")) {
-          s->header.content_length = 0;
-          while(isdigit((int)c)) {
-            s->header.content_length = s->header.content_length * 10 + c - '0';
-            s->header_chars++;
-            PT_YIELD(&s->headerpt);
-          }
-        } else if(!strcmp(s->header_field, "Content-Range")) {
-          /* Skip the bytes-unit token */
-          while(c != ' ' && c != '\t') {
-            s->header_chars++;
-            PT_YIELD(&s->headerpt);
-          }
+        s->header.content_range.first_byte_pos = 0;
+        while(isdigit((int)c)) {
+          s->header.content_range.first_byte_pos =
+            s->header.content_range.first_byte_pos * 10 + c - '0';
+          s->header_chars++;
+          PT_YIELD(&s->headerpt);
+        }
+        /* Skip linear white spaces */
+        while(c == ' ' || c == '\t') {
+          s->header_chars++;
+          PT_YIELD(&s->headerpt);
+        }
+        if(c == '-') {
+          /* Skip the dash */
+          s->header_chars++;
+          PT_YIELD(&s->headerpt);
           /* Skip linear white spaces */
           while(c == ' ' || c == '\t') {
             s->header_chars++;
             PT_YIELD(&s->headerpt);
           }
-          s->header.content_range.first_byte_pos = 0;
+          s->header.content_range.last_byte_pos = 0;
           while(isdigit((int)c)) {
-            s->header.content_range.first_byte_pos =
-              s->header.content_range.first_byte_pos * 10 + c - '0';
+            s->header.content_range.last_byte_pos =
+              s->header.content_range.last_byte_pos * 10 + c - '0';
             s->header_chars++;
             PT_YIELD(&s->headerpt);
           }
@@ -154,8 +243,8 @@ parse_header_byte(struct http_socket *s, char c)
             s->header_chars++;
             PT_YIELD(&s->headerpt);
           }
-          if(c == '-') {
-            /* Skip the dash */
+          if(c == '/') {
+            /* Skip the slash */
             s->header_chars++;
             PT_YIELD(&s->headerpt);
             /* Skip linear white spaces */
@@ -163,108 +252,204 @@ parse_header_byte(struct http_socket *s, char c)
               s->header_chars++;
               PT_YIELD(&s->headerpt);
             }
-            s->header.content_range.last_byte_pos = 0;
-            while(isdigit((int)c)) {
-              s->header.content_range.last_byte_pos =
-                s->header.content_range.last_byte_pos * 10 + c - '0';
-              s->header_chars++;
-              PT_YIELD(&s->headerpt);
-            }
-            /* Skip linear white spaces */
-            while(c == ' ' || c == '\t') {
-              s->header_chars++;
-              PT_YIELD(&s->headerpt);
-            }
-            if(c == '/') {
-              /* Skip the slash */
-              s->header_chars++;
-              PT_YIELD(&s->headerpt);
-              /* Skip linear white spaces */
-              while(c == ' ' || c == '\t') {
+            if(c != '*') {
+              s->header.content_range.instance_length = 0;
+              while(isdigit((int)c)) {
+                s->header.content_range.instance_length =
+                  s->header.content_range.instance_length * 10 + c - '0';
                 s->header_chars++;
                 PT_YIELD(&s->headerpt);
               }
-              if(c != '*') {
-                s->header.content_range.instance_length = 0;
-                while(isdigit((int)c)) {
-                  s->header.content_range.instance_length =
-                    s->header.content_range.instance_length * 10 + c - '0';
-                  s->header_chars++;
-                  PT_YIELD(&s->headerpt);
-                }
-              }
             }
           }
         }
+      } else if(!strcasecmp(s->header_field, "Transfer-Encoding") ||
+                !strcasecmp(s->header_field, "Connection")) {
+        /* Only the first token is looked at */
+        s->header_value_len = 0;
+        while(c != '\r' && c != ' ' && c != '\t' && c != ',' && c != ';') {
+          if(s->header_value_len < sizeof(s->header_value) - 1) {
+            s->header_value[s->header_value_len++] = c;
+          }
+          s->header_chars++;
+          PT_YIELD(&s->headerpt);
+        }
+        s->header_value[s->header_value_len] = '\0';
+        if(!strcasecmp(s->header_value, "chunked")) {
+          s->chunked = 1;
+        } else if(!strcasecmp(s->header_value, "close")) {
+          s->conn_close = 1;
+        } else if(!strcasecmp(s->header_value, "keep-alive")) {
+          s->conn_close = 0;
+        }
       }
     }
+  }
 
-    /* All headers read, now read data */
-    call_callback(s, HTTP_SOCKET_HEADER, (void *)&s->header, sizeof(s->header));
+  PT_END(&s->headerpt);
+}
+/*---------------------------------------------------------------------------*/
+static int
+hexval(char c)
+{
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if(c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Passes response body data on to the callback, without the chunked
+ * transfer-coding if there is one. Calls request_finished() when the
+ * end of the body is seen.
+ *
+ * \return The number of bytes that belonged to this response, or -1
+ *         if the callback closed or reused the socket.
+ */
+static int
+parse_body(struct http_socket *s, const uint8_t *data, int datalen)
+{
+  uint8_t gen = s->gen;
+  int i, n, v;
 
-    /* Should exit the pt here to indicate that all headers have been
-       read */
-    PT_EXIT(&s->headerpt);
-  } else {
-    if(s->header.status_code == 0x404) {
-      printf("File not found\n");
-    } else if(s->header.status_code == 0x301 || s->header.status_code == 0x302) {
-      printf("File moved (not handled)\n");
+  if(!s->chunked) {
+    n = datalen;
+    if(s->header.content_length >= 0 &&
+       s->bodylen + n > s->header.content_length) {
+      n = s->header.content_length - s->bodylen;
     }
-
-    call_callback(s, HTTP_SOCKET_ERR, (void *)&s->header, sizeof(s->header));
-    tcp_socket_close(&s->s);
-    removesocket(s);
-    PT_EXIT(&s->headerpt);
+    if(n > 0) {
+      s->bodylen += n;
+      call_callback(s, HTTP_SOCKET_DATA, data, n);
+      if(s->gen != gen) {
+        return -1;
+      }
+    }
+    if(s->header.content_length >= 0 &&
+       s->bodylen >= s->header.content_length) {
+      request_finished(s, HTTP_SOCKET_CLOSED);
+    }
+    return n;
   }
 
-
-  PT_END(&s->headerpt);
+  i = 0;
+  while(i < datalen) {
+    switch(s->chunk_state) {
+    case CHUNK_SIZE:
+      v = hexval(data[i]);
+      if(v >= 0) {
+        if(s->chunk_left < 0x10000000UL) {
+          s->chunk_left = s->chunk_left * 16 + v;
+        }
+        i++;
+        break;
+      }
+      s->chunk_state = CHUNK_EXT;
+      /* Fall through */
+    case CHUNK_EXT:
+      /* Skip chunk extensions up to the end of the line */
+      if(data[i++] == '\n') {
+        s->chunk_state = s->chunk_left > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+        s->header_chars = 0;
+      }
+      break;
+    case CHUNK_DATA:
+      n = datalen - i;
+      if(n > s->chunk_left) {
+        n = s->chunk_left;
+      }
+      s->chunk_left -= n;
+      s->bodylen += n;
+      if(s->chunk_left == 0) {
+        s->chunk_state = CHUNK_DATA_END;
+      }
+      call_callback(s, HTTP_SOCKET_DATA, &data[i], n);
+      if(s->gen != gen) {
+        return -1;
+      }
+      i += n;
+      break;
+    case CHUNK_DATA_END:
+      if(data[i++] == '\n') {
+        s->chunk_state = CHUNK_SIZE;
+      }
+      break;
+    case CHUNK_TRAILER:
+      /* Skip trailer fields; an empty line ends the body */
+      if(data[i] == '\n') {
+        if(s->header_chars == 0) {
+          request_finished(s, HTTP_SOCKET_CLOSED);
+          return i + 1;
+        }
+        s->header_chars = 0;
+      } else if(data[i] != '\r') {
+        s->header_chars++;
+      }
+      i++;
+      break;
+    }
+  }
+  return i;
 }
 /*---------------------------------------------------------------------------*/
+/**
+ * Feeds response data to the header parser and then to parse_body().
+ *
+ * \return The number of bytes that belonged to this response, or -1
+ *         if the socket went away while the data was processed.
+ */
 static int
-input_pt(struct http_socket *s,
-         const uint8_t *inputptr, int inputdatalen)
+parse_input(struct http_socket *s, const uint8_t *inputptr, int inputdatalen)
 {
-  int i;
-  PT_BEGIN(&s->pt);
+  uint8_t gen = s->gen;
+  int i = 0, len;
 
-  /* Parse the header */
-  s->header_received = 0;
-  do {
+  if(s->header_received == 0) {
     for(i = 0; i < inputdatalen; i++) {
       if(!PT_SCHEDULE(parse_header_byte(s, inputptr[i]))) {
         s->header_received = 1;
+        i++;
         break;
       }
     }
-    inputdatalen -= i;
-    inputptr += i;
-
     if(s->header_received == 0) {
       /* If we have not yet received the full header, we wait for the
          next packet to arrive. */
-      PT_YIELD(&s->pt);
+      return i;
     }
-  } while(s->header_received == 0);
 
-  s->bodylen = 0;
-  do {
-    /* Receive the data */
-    call_callback(s, HTTP_SOCKET_DATA, inputptr, inputdatalen);
-
-    /* Close the connection if the expected content length has been received */
-    if(s->header.content_length >= 0 && s->bodylen < s->header.content_length) {
-      s->bodylen += inputdatalen;
-      if(s->bodylen >= s->header.content_length) {
-        tcp_socket_close(&s->s);
+    if(s->header.status_code != 0x200 && s->header.status_code != 0x206) {
+      if(s->header.status_code == 0x404) {
+        printf("File not found\n");
+      } else if(s->header.status_code == 0x301 ||
+                s->header.status_code == 0x302) {
+        printf("File moved (not handled)\n");
       }
+      request_finished(s, HTTP_SOCKET_ERR);
+      return -1;
     }
 
-    PT_YIELD(&s->pt);
-  } while(inputdatalen > 0);
+#if HTTP_SOCKET_POOL_SIZE
+    if(s->conn_close || (!s->chunked && s->header.content_length < 0)) {
+      /* The end of this response is the end of the connection */
+      s->conn->reusable = 0;
+    }
+#endif /* HTTP_SOCKET_POOL_SIZE */
 
-  PT_END(&s->pt);
+    /* All headers read, now read data */
+    call_callback(s, HTTP_SOCKET_HEADER, (void *)&s->header,
+                  sizeof(s->header));
+    if(s->gen != gen) {
+      return -1;
+    }
+  }
+
+  len = parse_body(s, inputptr + i, inputdatalen - i);
+  return len < 0 ? -1 : i + len;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -277,18 +462,6 @@ start_timeout_timer(struct http_socket *s)
 }
 /*---------------------------------------------------------------------------*/
 static int
-input(struct tcp_socket *tcps, void *ptr,
-      const uint8_t *inputptr, int inputdatalen)
-{
-  struct http_socket *s = ptr;
-
-  input_pt(s, inputptr, inputdatalen);
-  start_timeout_timer(s);
-
-  return 0; /* all data consumed */
-}
-/*---------------------------------------------------------------------------*/
-static int
 parse_url(const char *url, char *host, uint16_t *portptr, char *path)
 {
   const char *urlptr;
@@ -379,12 +552,443 @@ parse_url(const char *url, char *host, uint16_t *portptr, char *path)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+/**
+ * Writes the request line and header fields of a request into \p buf.
+ *
+ * \return The length of the header, or -1 if it does not fit.
+ */
+static int
+format_request(const struct http_socket *s, char *buf, int size)
+{
+  char host[MAX_HOSTLEN];
+  char path[MAX_PATHLEN];
+  int len;
+
+  if(!parse_url(s->url, host, NULL, path)) {
+    return -1;
+  }
+
+  /* If we are configured to route through a proxy, we should provide
+     the full URL as the path. Pooled connections are kept alive, which
+     is the HTTP/1.1 default. */
+  len = snprintf(buf, size, "%s %s HTTP/1.1\r\n%sHost: %s\r\n",
+                 s->postdata != NULL ? "POST" : "GET",
+                 s->proxy_port != 0 ? s->url : path,
+                 HTTP_SOCKET_POOL_SIZE ? "" : "Connection: close\r\n",
+                 host);
+  if(s->postdata != NULL) {
+    if(s->content_type && len < size) {
+      len += snprintf(buf + len, size - len, "Content-Type: %s\r\n",
+                      s->content_type);
+    }
+    if(len < size) {
+      len += snprintf(buf + len, size - len, "Content-Length: %u\r\n",
+                      s->postdatalen);
+    }
+  } else if((s->length || s->pos > 0) && len < size) {
+    if(s->length) {
+      if(s->pos >= 0) {
+        len += snprintf(buf + len, size - len, "Range: bytes=%llu-%llu\r\n",
+                        (unsigned long long)s->pos,
+                        (unsigned long long)(s->pos + s->length - 1));
+      } else {
+        len += snprintf(buf + len, size - len, "Range: bytes=-%llu\r\n",
+                        (unsigned long long)s->length);
+      }
+    } else {
+      len += snprintf(buf + len, size - len, "Range: bytes=%llu-\r\n",
+                      (unsigned long long)s->pos);
+    }
+  }
+  if(len < size) {
+    len += snprintf(buf + len, size - len, "\r\n");
+  }
+  return len < size ? len : -1;
+}
+/*---------------------------------------------------------------------------*/
 static void
 removesocket(struct http_socket *s)
 {
   etimer_stop(&s->timeout_timer);
   s->timeout_timer_started = 0;
   list_remove(socketlist, s);
+#if HTTP_SOCKET_POOL_SIZE
+  s->conn = NULL;
+  s->flags = 0;
+#endif /* HTTP_SOCKET_POOL_SIZE */
+}
+/*---------------------------------------------------------------------------*/
+#if HTTP_SOCKET_POOL_SIZE
+static void
+conn_enqueue(struct http_socket_conn *c, struct http_socket *s)
+{
+  s->pipeline_next = NULL;
+  if(c->tail != NULL) {
+    c->tail->pipeline_next = s;
+  } else {
+    c->head = s;
+  }
+  c->tail = s;
+  c->nrequests++;
+  s->conn = c;
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_dequeue(struct http_socket_conn *c, struct http_socket *s)
+{
+  struct http_socket **sp, *prev;
+
+  prev = NULL;
+  for(sp = &c->head; *sp != NULL; sp = &(*sp)->pipeline_next) {
+    if(*sp == s) {
+      *sp = s->pipeline_next;
+      if(c->tail == s) {
+        c->tail = prev;
+      }
+      c->nrequests--;
+      break;
+    }
+    prev = *sp;
+  }
+  s->conn = NULL;
+  s->pipeline_next = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_idle(struct http_socket_conn *c)
+{
+  if(c->state == CONN_OPEN && c->head == NULL) {
+    PROCESS_CONTEXT_BEGIN(&http_socket_process);
+    etimer_set(&c->idle_timer, HTTP_SOCKET_IDLE_TIMEOUT);
+    PROCESS_CONTEXT_END(&http_socket_process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Queues the header and body of every request that has not been sent
+ * yet, as far as the output buffer allows.
+ */
+static void
+conn_send(struct http_socket_conn *c)
+{
+  struct http_socket *s;
+  int len;
+
+  for(s = c->head; s != NULL; s = s->pipeline_next) {
+    if(s->flags & REQ_SENT) {
+      continue;
+    }
+    if((s->flags & REQ_HEADER_SENT) == 0) {
+      len = format_request(s, reqbuf, sizeof(reqbuf));
+      if(len < 0 || len > tcp_socket_max_sendlen(&c->s)) {
+        break;
+      }
+      tcp_socket_send(&c->s, (uint8_t *)reqbuf, len);
+      s->flags |= REQ_HEADER_SENT;
+      start_timeout_timer(s);
+    }
+    if(s->postdata != NULL && s->postsent < s->postdatalen) {
+      s->postsent += tcp_socket_send(&c->s, s->postdata + s->postsent,
+                                     s->postdatalen - s->postsent);
+      if(s->postsent < s->postdatalen) {
+        break;
+      }
+    }
+    s->flags |= REQ_SENT;
+  }
+
+  if(c->s.c != NULL) {
+    tcpip_poll_tcp(c->s.c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Detaches all requests from a connection that is going away. A request
+ * whose response had started, or that may not be sent again according
+ * to \p mode, is removed and gets \p ev. The others wait for another
+ * connection. POST requests are never sent twice.
+ */
+static void
+conn_release(struct http_socket_conn *c, http_socket_event_t ev, uint8_t mode)
+{
+  struct http_socket *s, *next, *failed, *failed_tail;
+
+  etimer_stop(&c->idle_timer);
+  failed = failed_tail = NULL;
+  for(s = c->head; s != NULL; s = next) {
+    next = s->pipeline_next;
+    s->conn = NULL;
+    s->pipeline_next = NULL;
+    if((s->flags & REQ_RESPONDING) || mode == RELEASE_FAIL ||
+       (mode == RELEASE_RETRY && (s->flags & REQ_RETRIED)) ||
+       (s->postdata != NULL && (s->flags & REQ_HEADER_SENT))) {
+      if(failed_tail != NULL) {
+        failed_tail->pipeline_next = s;
+      } else {
+        failed = s;
+      }
+      failed_tail = s;
+    } else {
+      if(mode == RELEASE_RETRY && (s->flags & REQ_HEADER_SENT)) {
+        s->flags |= REQ_RETRIED;
+      }
+      s->flags = (s->flags & REQ_RETRIED) | REQ_WAITING;
+      s->postsent = 0;
+      reset_response(s);
+    }
+  }
+  c->head = c->tail = NULL;
+  c->nrequests = 0;
+  process_poll(&http_socket_process);
+
+  for(s = failed; s != NULL; s = next) {
+    next = s->pipeline_next;
+    s->pipeline_next = NULL;
+    removesocket(s);
+    call_callback(s, ev, NULL, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_close(struct http_socket_conn *c)
+{
+  if(c->state != CONN_CONNECTING && c->state != CONN_OPEN) {
+    return;
+  }
+  tcp_socket_close(&c->s);
+  if(c->s.c != NULL) {
+    tcpip_poll_tcp(c->s.c);
+  }
+  c->state = CONN_CLOSING;
+  conn_release(c, HTTP_SOCKET_ABORTED, RELEASE_REQUEUE);
+
+  /* Check back for when tcp-socket is done with the connection */
+  PROCESS_CONTEXT_BEGIN(&http_socket_process);
+  etimer_set(&c->idle_timer, CLOCK_SECOND / 8);
+  PROCESS_CONTEXT_END(&http_socket_process);
+}
+/*---------------------------------------------------------------------------*/
+static int
+conn_input(struct tcp_socket *tcps, void *ptr,
+           const uint8_t *inputptr, int inputdatalen)
+{
+  struct http_socket_conn *c = ptr;
+  struct http_socket *s;
+  int len;
+
+  while(inputdatalen > 0 && c->state == CONN_OPEN &&
+        (s = c->head) != NULL && (s->flags & REQ_HEADER_SENT)) {
+    s->flags |= REQ_RESPONDING;
+    start_timeout_timer(s);
+    len = parse_input(s, inputptr, inputdatalen);
+    if(len < 0 || (len == 0 && c->head == s)) {
+      break;
+    }
+    inputptr += len;
+    inputdatalen -= len;
+  }
+
+  return 0; /* all data consumed */
+}
+/*---------------------------------------------------------------------------*/
+static void
+conn_event(struct tcp_socket *tcps, void *ptr,
+           tcp_socket_event_t e)
+{
+  struct http_socket_conn *c = ptr;
+  uint8_t state = c->state;
+
+  if(e == TCP_SOCKET_CONNECTED) {
+    if(state == CONN_CONNECTING) {
+      c->state = CONN_OPEN;
+      conn_send(c);
+      conn_idle(c);
+    }
+  } else if(e == TCP_SOCKET_DATA_SENT) {
+    if(state == CONN_OPEN) {
+      conn_send(c);
+    }
+  } else {
+    c->state = CONN_CLOSED;
+    if(state == CONN_CONNECTING || state == CONN_OPEN) {
+      /* A response without a length ends here. Other requests are
+         tried once more, unless the connection never came up. */
+      conn_release(c,
+                   e == TCP_SOCKET_CLOSED ? HTTP_SOCKET_CLOSED :
+                   e == TCP_SOCKET_TIMEDOUT ? HTTP_SOCKET_TIMEDOUT :
+                   HTTP_SOCKET_ABORTED,
+                   state == CONN_CONNECTING ? RELEASE_FAIL : RELEASE_RETRY);
+    } else {
+      process_poll(&http_socket_process);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+conn_open(struct http_socket_conn *c, const struct http_socket *s)
+{
+  tcp_socket_register(&c->s, c,
+                      c->inputbuf, sizeof(c->inputbuf),
+                      c->outputbuf, sizeof(c->outputbuf),
+                      conn_input, conn_event);
+  if(tcp_socket_connect(&c->s, &s->addr, s->port) < 0) {
+    return 0;
+  }
+  uip_ipaddr_copy(&c->addr, &s->addr);
+  c->port = s->port;
+  c->state = CONN_CONNECTING;
+  c->reusable = 1;
+  c->head = c->tail = NULL;
+  c->nrequests = 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Puts a request on a pooled connection to its host: an idle one if
+ * there is one, otherwise a new one, otherwise the least busy one.
+ *
+ * \return Non-zero if the request got a connection.
+ */
+static int
+conn_attach(struct http_socket *s)
+{
+  struct http_socket_conn *c, *best, *free, *idle;
+
+  best = free = idle = NULL;
+  for(c = pool; c < &pool[HTTP_SOCKET_POOL_SIZE]; c++) {
+    if(c->state == CONN_FREE) {
+      free = c;
+    } else if((c->state == CONN_CONNECTING || c->state == CONN_OPEN) &&
+              c->reusable && c->port == s->port &&
+              uip_ipaddr_cmp(&c->addr, &s->addr)) {
+      if(c->nrequests < HTTP_SOCKET_PIPELINE &&
+         (best == NULL || c->nrequests < best->nrequests)) {
+        best = c;
+      }
+    } else if(c->state == CONN_OPEN && c->nrequests == 0) {
+      idle = c;
+    }
+  }
+
+  if(free != NULL && (best == NULL || best->nrequests > 0) &&
+     conn_open(free, s)) {
+    best = free;
+  }
+
+  if(best == NULL) {
+    if(idle != NULL) {
+      /* Make room by closing an unused connection to another host */
+      conn_close(idle);
+    }
+    return 0;
+  }
+
+  etimer_stop(&best->idle_timer);
+  s->flags &= ~REQ_WAITING;
+  conn_enqueue(best, s);
+  if(best->state == CONN_OPEN) {
+    conn_send(best);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Frees connections that tcp-socket is done with and hands them to
+ * requests waiting for a connection. Runs from the HTTP socket
+ * process, never from within a TCP callback.
+ */
+static void
+dispatch(void)
+{
+  struct http_socket_conn *c;
+  struct http_socket *s;
+
+  for(c = pool; c < &pool[HTTP_SOCKET_POOL_SIZE]; c++) {
+    if(c->state == CONN_CLOSED ||
+       (c->state == CONN_CLOSING && c->s.c == NULL)) {
+      etimer_stop(&c->idle_timer);
+      c->state = CONN_FREE;
+    }
+  }
+
+  for(s = list_head(socketlist);
+      s != NULL;
+      s = list_item_next(s)) {
+    if(s->flags & REQ_WAITING) {
+      conn_attach(s);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+request_finished(struct http_socket *s, http_socket_event_t ev)
+{
+  struct http_socket_conn *c = s->conn;
+
+  conn_dequeue(c, s);
+  removesocket(s);
+  if(ev == HTTP_SOCKET_ERR || !c->reusable) {
+    conn_close(c);
+  } else {
+    conn_idle(c);
+    /* There is room for another request on this connection */
+    process_poll(&http_socket_process);
+  }
+
+  if(ev == HTTP_SOCKET_ERR) {
+    call_callback(s, ev, (void *)&s->header, sizeof(s->header));
+  } else {
+    call_callback(s, ev, NULL, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+request_timedout(struct http_socket *s)
+{
+  struct http_socket_conn *c = s->conn;
+
+  if(c != NULL) {
+    conn_dequeue(c, s);
+    if(s->flags & REQ_HEADER_SENT) {
+      /* The server is stuck; others queued behind this request are
+         better off on a new connection. */
+      conn_close(c);
+    } else {
+      conn_idle(c);
+    }
+  }
+  removesocket(s);
+  call_callback(s, HTTP_SOCKET_TIMEDOUT, NULL, 0);
+}
+/*---------------------------------------------------------------------------*/
+#else /* HTTP_SOCKET_POOL_SIZE */
+static int
+socket_active(struct http_socket *s)
+{
+  struct http_socket *i;
+
+  for(i = list_head(socketlist);
+      i != NULL;
+      i = list_item_next(i)) {
+    if(i == s) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+input(struct tcp_socket *tcps, void *ptr,
+      const uint8_t *inputptr, int inputdatalen)
+{
+  struct http_socket *s = ptr;
+
+  parse_input(s, inputptr, inputdatalen);
+  if(socket_active(s)) {
+    start_timeout_timer(s);
+  }
+
+  return 0; /* all data consumed */
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -392,60 +996,22 @@ event(struct tcp_socket *tcps, void *ptr,
       tcp_socket_event_t e)
 {
   struct http_socket *s = ptr;
-  char host[MAX_HOSTLEN];
-  char path[MAX_PATHLEN];
-  uint16_t port;
-  char str[42];
   int len;
 
   if(e == TCP_SOCKET_CONNECTED) {
     printf("Connected\n");
-    if(parse_url(s->url, host, &port, path)) {
-      tcp_socket_send_str(tcps, s->postdata != NULL ? "POST " : "GET ");
-      if(s->proxy_port != 0) {
-        /* If we are configured to route through a proxy, we should
-           provide the full URL as the path. */
-        tcp_socket_send_str(tcps, s->url);
-      } else {
-        tcp_socket_send_str(tcps, path);
-      }
-      tcp_socket_send_str(tcps, " HTTP/1.1\r\n");
-      tcp_socket_send_str(tcps, "Connection: close\r\n");
-      tcp_socket_send_str(tcps, "Host: ");
-      tcp_socket_send_str(tcps, host);
-      tcp_socket_send_str(tcps, "\r\n");
-      if(s->postdata != NULL) {
-        if(s->content_type) {
-          tcp_socket_send_str(tcps, "Content-Type: ");
-          tcp_socket_send_str(tcps, s->content_type);
-          tcp_socket_send_str(tcps, "\r\n");
-        }
-        tcp_socket_send_str(tcps, "Content-Length: ");
-        sprintf(str, "%u", s->postdatalen);
-        tcp_socket_send_str(tcps, str);
-        tcp_socket_send_str(tcps, "\r\n");
-      } else if(s->length || s->pos > 0) {
-        tcp_socket_send_str(tcps, "Range: bytes=");
-        if(s->length) {
-          if(s->pos >= 0) {
-            sprintf(str, "%llu-%llu", s->pos, s->pos + s->length - 1);
-          } else {
-            sprintf(str, "-%llu", s->length);
-          }
-        } else {
-          sprintf(str, "%llu-", s->pos);
-        }
-        tcp_socket_send_str(tcps, str);
-        tcp_socket_send_str(tcps, "\r\n");
-      }
-      tcp_socket_send_str(tcps, "\r\n");
+    len = format_request(s, reqbuf, sizeof(reqbuf));
+    if(len > 0) {
+      tcp_socket_send(tcps, (uint8_t *)reqbuf, len);
       if(s->postdata != NULL && s->postdatalen) {
         len = tcp_socket_send(tcps, s->postdata, s->postdatalen);
         s->postdata += len;
         s->postdatalen -= len;
       }
     }
-    parse_header_init(s);
+    reset_response(s);
+  } else if(!socket_active(s)) {
+    /* The response was complete before the connection went away */
   } else if(e == TCP_SOCKET_CLOSED) {
     call_callback(s, HTTP_SOCKET_CLOSED, NULL, 0);
     removesocket(s);
@@ -469,6 +1035,44 @@ event(struct tcp_socket *tcps, void *ptr,
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+request_finished(struct http_socket *s, http_socket_event_t ev)
+{
+  if(ev == HTTP_SOCKET_ERR) {
+    call_callback(s, HTTP_SOCKET_ERR, (void *)&s->header, sizeof(s->header));
+    tcp_socket_close(&s->s);
+    removesocket(s);
+  } else {
+    /* The whole response has been received. tcp-socket does not report
+       a close that we initiate, so the request ends here. */
+    tcp_socket_close(&s->s);
+    removesocket(s);
+    call_callback(s, HTTP_SOCKET_CLOSED, NULL, 0);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+request_timedout(struct http_socket *s)
+{
+  tcp_socket_close(&s->s);
+}
+#endif /* HTTP_SOCKET_POOL_SIZE */
+/*---------------------------------------------------------------------------*/
+static void
+connect_request(struct http_socket *s, const uip_ipaddr_t *addr, uint16_t port)
+{
+  s->did_tcp_connect = 1;
+#if HTTP_SOCKET_POOL_SIZE
+  uip_ipaddr_copy(&s->addr, addr);
+  s->port = port;
+  s->flags |= REQ_WAITING;
+  start_timeout_timer(s);
+  conn_attach(s);
+#else /* HTTP_SOCKET_POOL_SIZE */
+  tcp_socket_connect(&s->s, addr, port);
+#endif /* HTTP_SOCKET_POOL_SIZE */
+}
+/*---------------------------------------------------------------------------*/
 static int
 start_request(struct http_socket *s)
 {
@@ -480,7 +1084,8 @@ start_request(struct http_socket *s)
   uint16_t port;
   int ret;
 
-  if(parse_url(s->url, host, &port, path)) {
+  if(parse_url(s->url, host, &port, path) &&
+     format_request(s, reqbuf, sizeof(reqbuf)) > 0) {
 
     printf("url %s host %s port %d path %s\n",
            s->url, host, port, path);
@@ -505,15 +1110,14 @@ start_request(struct http_socket *s)
           return HTTP_SOCKET_OK;
         }
         if(addr != NULL) {
-          s->did_tcp_connect = 1;
-          tcp_socket_connect(&s->s, addr, port);
+          connect_request(s, addr, port);
           return HTTP_SOCKET_OK;
         } else {
           return HTTP_SOCKET_ERR;
         }
       }
     }
-    tcp_socket_connect(&s->s, &ip6addr, port);
+    connect_request(s, &ip6addr, port);
     return HTTP_SOCKET_OK;
   } else {
     return HTTP_SOCKET_ERR;
@@ -556,6 +1160,24 @@ PROCESS_THREAD(http_socket_process, ev, data)
     } else if(ev == PROCESS_EVENT_TIMER) {
       struct http_socket *s;
       struct etimer *timeout_timer = data;
+#if HTTP_SOCKET_POOL_SIZE
+      struct http_socket_conn *c;
+
+      for(c = pool; c < &pool[HTTP_SOCKET_POOL_SIZE]; c++) {
+        if(timeout_timer == &c->idle_timer) {
+          if(c->state == CONN_OPEN && c->head == NULL) {
+            conn_close(c);
+          } else if(c->state == CONN_CLOSING) {
+            if(c->s.c == NULL) {
+              dispatch();
+            } else {
+              etimer_restart(&c->idle_timer);
+            }
+          }
+          break;
+        }
+      }
+#endif /* HTTP_SOCKET_POOL_SIZE */
       /*
        * A socket time-out has occurred. We need to go through the list of HTTP
        * sockets and figure out to which socket this timer event corresponds,
@@ -565,10 +1187,14 @@ PROCESS_THREAD(http_socket_process, ev, data)
           s != NULL;
           s = list_item_next(s)) {
         if(timeout_timer == &s->timeout_timer && s->timeout_timer_started) {
-          tcp_socket_close(&s->s);
+          request_timedout(s);
           break;
         }
       }
+#if HTTP_SOCKET_POOL_SIZE
+    } else if(ev == PROCESS_EVENT_POLL) {
+      dispatch();
+#endif /* HTTP_SOCKET_POOL_SIZE */
     }
   }
 
@@ -592,21 +1218,34 @@ http_socket_init(struct http_socket *s)
   init();
   uip_create_unspecified(&s->proxy_addr);
   s->proxy_port = 0;
+#if HTTP_SOCKET_POOL_SIZE
+  s->conn = NULL;
+  s->flags = 0;
+#endif /* HTTP_SOCKET_POOL_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 static void
 initialize_socket(struct http_socket *s)
 {
+#if HTTP_SOCKET_POOL_SIZE
+  /* Let go of a request still in progress on this socket */
+  http_socket_close(s);
+#endif /* HTTP_SOCKET_POOL_SIZE */
   s->pos = 0;
   s->length = 0;
   s->postdata = NULL;
   s->postdatalen = 0;
   s->timeout_timer_started = 0;
-  PT_INIT(&s->pt);
+  s->gen++;
+  reset_response(s);
+#if HTTP_SOCKET_POOL_SIZE
+  s->postsent = 0;
+#else /* HTTP_SOCKET_POOL_SIZE */
   tcp_socket_register(&s->s, s,
                       s->inputbuf, sizeof(s->inputbuf),
                       s->outputbuf, sizeof(s->outputbuf),
                       input, event);
+#endif /* HTTP_SOCKET_POOL_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -664,7 +1303,21 @@ http_socket_close(struct http_socket *socket)
       s != NULL;
       s = list_item_next(s)) {
     if(s == socket) {
+#if HTTP_SOCKET_POOL_SIZE
+      struct http_socket_conn *c = s->conn;
+
+      if(c != NULL) {
+        conn_dequeue(c, s);
+        if(s->flags & REQ_HEADER_SENT) {
+          /* Its response can no longer be told apart */
+          conn_close(c);
+        } else {
+          conn_idle(c);
+        }
+      }
+#else /* HTTP_SOCKET_POOL_SIZE */
       tcp_socket_close(&s->s);
+#endif /* HTTP_SOCKET_POOL_SIZE */
       removesocket(s);
       return 1;
     }
@@ -71,9 +71,45 @@ typedef void (* http_socket_callback_t)(struct http_socket *s,
 
 #define HTTP_SOCKET_TIMEOUT       ((2 * 60 + 30) * CLOCK_SECOND)
 
+/* With HTTP_SOCKET_CONF_POOL_SIZE set, requests no longer own a TCP
+   connection. They are carried by a pool of that many persistent
+   connections, shared by all requests to the same host and port, and
+   up to HTTP_SOCKET_CONF_PIPELINE requests may be outstanding on each
+   connection. A request completes with HTTP_SOCKET_CLOSED as soon as
+   its response has been received, while the connection stays open. */
+#ifdef HTTP_SOCKET_CONF_POOL_SIZE
+#define HTTP_SOCKET_POOL_SIZE     HTTP_SOCKET_CONF_POOL_SIZE
+#else
+#define HTTP_SOCKET_POOL_SIZE     0
+#endif
+
+#ifdef HTTP_SOCKET_CONF_PIPELINE
+#define HTTP_SOCKET_PIPELINE      HTTP_SOCKET_CONF_PIPELINE
+#else
+#define HTTP_SOCKET_PIPELINE      4
+#endif
+
+/* How long an unused pooled connection is kept open */
+#ifdef HTTP_SOCKET_CONF_IDLE_TIMEOUT
+#define HTTP_SOCKET_IDLE_TIMEOUT  HTTP_SOCKET_CONF_IDLE_TIMEOUT
+#else
+#define HTTP_SOCKET_IDLE_TIMEOUT  (30 * CLOCK_SECOND)
+#endif
+
+struct http_socket_conn;
+
 struct http_socket {
   struct http_socket *next;
+#if HTTP_SOCKET_POOL_SIZE
+  struct http_socket_conn *conn;
+  struct http_socket *pipeline_next;
+  uip_ipaddr_t addr;
+  uint16_t port;
+  uint16_t postsent;
+  uint8_t flags;
+#else /* HTTP_SOCKET_POOL_SIZE */
   struct tcp_socket s;
+#endif /* HTTP_SOCKET_POOL_SIZE */
   uip_ipaddr_t proxy_addr;
   uint16_t proxy_port;
   int64_t pos;
@@ -84,16 +120,25 @@ struct http_socket {
   void *callbackptr;
   int did_tcp_connect;
   char url[HTTP_SOCKET_URLLEN];
+#if !HTTP_SOCKET_POOL_SIZE
   uint8_t inputbuf[HTTP_SOCKET_INPUTBUFSIZE];
   uint8_t outputbuf[HTTP_SOCKET_OUTPUTBUFSIZE];
+#endif /* !HTTP_SOCKET_POOL_SIZE */
 
   struct etimer timeout_timer;
   uint8_t timeout_timer_started;
-  struct pt pt, headerpt;
+  uint8_t gen;
+  struct pt headerpt;
   int header_chars;
-  char header_field[15];
+  char header_field[20];
+  char header_value[12];
+  uint8_t header_value_len;
   struct http_socket_header header;
   uint8_t header_received;
+  uint8_t conn_close;
+  uint8_t chunked;
+  uint8_t chunk_state;
+  uint32_t chunk_left;
   uint64_t bodylen;
   const char *content_type;
 };
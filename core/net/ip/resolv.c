@@ -67,6 +67,8 @@
 #include "net/ip/uip-udp-packet.h"
 #include "net/ip/uip-nameserver.h"
 #include "lib/random.h"
+#include "lib/memb.h"
+#include "lib/list.h"
 
 #ifndef DEBUG
 #define DEBUG CONTIKI_TARGET_COOJA
@@ -162,6 +164,28 @@ strcasecmp(const char *s1, const char *s2)
 #error RESOLV_CONF_SUPPORTS_MDNS cannot be set without RESOLV_CONF_VERIFY_ANSWER_NAMES
 #endif
 
+#if RESOLV_CONF_CACHE_ENTRIES && !RESOLV_SUPPORTS_RECORD_EXPIRATION
+#error RESOLV_CONF_CACHE_ENTRIES cannot be set without RESOLV_CONF_SUPPORTS_RECORD_EXPIRATION
+#endif
+
+/* The number of queries that may be outstanding towards one server
+ * at a time. Only used with RESOLV_CONF_CACHE_ENTRIES; the classic
+ * resolver sends one query at a time. */
+#ifndef RESOLV_CONF_MAX_OUTSTANDING
+#define RESOLV_CONF_MAX_OUTSTANDING 4
+#endif
+
+/* How long, in seconds, a failed lookup is remembered when the server
+ * did not say (RFC 2308). */
+#ifndef RESOLV_CONF_NEGATIVE_TTL
+#define RESOLV_CONF_NEGATIVE_TTL 30
+#endif
+
+/* Upper bound, in seconds, on the TTL of a cached record */
+#ifndef RESOLV_CONF_MAX_TTL
+#define RESOLV_CONF_MAX_TTL 86400UL
+#endif
+
 #if !defined(CONTIKI_TARGET_NAME) && defined(BOARD)
 #define stringy2(x) #x
 #define stringy(x)  stringy2(x)
@@ -178,6 +202,7 @@ strcasecmp(const char *s1, const char *s2)
 
 #define DNS_TYPE_A      1
 #define DNS_TYPE_CNAME  5
+#define DNS_TYPE_SOA    6
 #define DNS_TYPE_PTR   12
 #define DNS_TYPE_MX    15
 #define DNS_TYPE_TXT   16
@@ -274,6 +299,23 @@ struct namemap {
 
 static struct namemap names[RESOLV_ENTRIES];
 
+#if RESOLV_CONF_CACHE_ENTRIES
+/** \internal A completed lookup, kept in most recently used order. */
+struct cache_entry {
+  struct cache_entry *next;
+  unsigned long expiration;
+  uip_ipaddr_t ipaddr;
+  uint16_t hash;
+  uint8_t state;                /* STATE_DONE or STATE_ERROR */
+  char name[RESOLV_CONF_MAX_DOMAIN_NAME_SIZE + 1];
+};
+
+MEMB(cache_memb, struct cache_entry, RESOLV_CONF_CACHE_ENTRIES);
+LIST(cache_list);
+
+static struct resolv_stats stats;
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
+
 static uint8_t seqno;
 
 static struct uip_udp_conn *resolv_conn = NULL;
@@ -628,6 +670,237 @@ mdns_prep_host_announce_packet(void)
 }
 #endif /* RESOLV_CONF_SUPPORTS_MDNS */
 /*---------------------------------------------------------------------------*/
+#if RESOLV_SUPPORTS_RECORD_EXPIRATION
+/** \internal
+ * Returns the TTL of an answer record, in seconds.
+ */
+static uint32_t
+answer_ttl(const struct dns_answer *ans)
+{
+  uint32_t ttl;
+
+  ttl = ((uint32_t)uip_ntohs(ans->ttl[0]) << 16) | uip_ntohs(ans->ttl[1]);
+  return ttl > RESOLV_CONF_MAX_TTL ? RESOLV_CONF_MAX_TTL : ttl;
+}
+#endif /* RESOLV_SUPPORTS_RECORD_EXPIRATION */
+/*---------------------------------------------------------------------------*/
+#if RESOLV_CONF_CACHE_ENTRIES
+static uint16_t
+name_hash(const char *name)
+{
+  uint16_t hash = 5381;
+  char c;
+
+  while((c = *name++) != 0) {
+    if(c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    hash = (hash << 5) + hash + (uint8_t)c;
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static struct cache_entry *
+cache_lookup(const char *name)
+{
+  struct cache_entry *e;
+  uint16_t hash;
+
+  hash = name_hash(name);
+  for(e = list_head(cache_list); e != NULL; e = list_item_next(e)) {
+    if(e->hash == hash && strcasecmp(e->name, name) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Stores the outcome of a lookup as the most recently used cache
+ * entry. A NULL address records a failure.
+ */
+static struct cache_entry *
+cache_store(const char *name, const uip_ipaddr_t *ipaddr, uint32_t ttl)
+{
+  struct cache_entry *e;
+
+  e = cache_lookup(name);
+  if(e == NULL) {
+    e = memb_alloc(&cache_memb);
+    if(e == NULL) {
+      /* Prefer an expired entry over the least recently used one. */
+      for(e = list_head(cache_list); e != NULL; e = list_item_next(e)) {
+        if(clock_seconds() > e->expiration) {
+          break;
+        }
+      }
+      if(e == NULL) {
+        e = list_tail(cache_list);
+        stats.evictions++;
+      }
+    }
+    strncpy(e->name, name, sizeof(e->name) - 1);
+    e->name[sizeof(e->name) - 1] = 0;
+    e->hash = name_hash(e->name);
+  }
+
+  list_remove(cache_list, e);
+  list_push(cache_list, e);
+
+  if(ipaddr != NULL) {
+    e->state = STATE_DONE;
+    uip_ipaddr_copy(&e->ipaddr, ipaddr);
+  } else {
+    e->state = STATE_ERROR;
+  }
+  e->expiration = clock_seconds() + ttl;
+  return e;
+}
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Moves a finished query from its in-flight slot to the cache and
+ * tells the world about it.
+ */
+static void
+query_done(struct namemap *namemapptr, const uip_ipaddr_t *ipaddr,
+           uint32_t ttl)
+{
+  struct cache_entry *e;
+
+  e = cache_store(namemapptr->name, ipaddr, ttl);
+  namemapptr->state = STATE_UNUSED;
+  namemapptr->name[0] = 0;
+  resolv_found(e->name, e->state == STATE_DONE ? &e->ipaddr : NULL);
+}
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Looks a name up among the in-flight queries and in the cache.
+ * Returns \p ret if the name is not known at all.
+ */
+static resolv_status_t
+cache_status(const char *name, uip_ipaddr_t **ipaddr, resolv_status_t ret)
+{
+  struct cache_entry *e;
+  uint8_t i;
+
+  for(i = 0; i < RESOLV_ENTRIES; ++i) {
+    if((names[i].state == STATE_NEW || names[i].state == STATE_ASKING) &&
+       strcasecmp(name, names[i].name) == 0) {
+      return RESOLV_STATUS_RESOLVING;
+    }
+  }
+
+  e = cache_lookup(name);
+  if(e == NULL) {
+    stats.misses++;
+    return ret;
+  }
+
+  if(ipaddr) {
+    *ipaddr = &e->ipaddr;
+  }
+
+  if(clock_seconds() > e->expiration) {
+    stats.misses++;
+    return e->state == STATE_DONE ? RESOLV_STATUS_EXPIRED :
+      RESOLV_STATUS_UNCACHED;
+  }
+
+  list_remove(cache_list, e);
+  list_push(cache_list, e);
+
+  if(e->state == STATE_DONE) {
+    stats.hits++;
+    return RESOLV_STATUS_CACHED;
+  }
+  stats.negative_hits++;
+  return RESOLV_STATUS_NOT_FOUND;
+}
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Returns how long a negative answer may be cached: the smaller of the
+ * TTL and the MINIMUM field of an SOA record in the response (RFC 2308),
+ * or RESOLV_CONF_NEGATIVE_TTL if there is none.
+ */
+static uint32_t
+negative_ttl(unsigned char *queryptr, uint8_t nrecords)
+{
+  const unsigned char *end = (unsigned char *)uip_appdata + uip_datalen();
+  uint32_t ttl, minimum;
+  uint16_t len;
+
+  for(; nrecords > 0; --nrecords) {
+    queryptr = skip_name(queryptr);
+    if(queryptr + 10 > end) {
+      break;
+    }
+    len = ((uint16_t)queryptr[8] << 8) | queryptr[9];
+    if(queryptr + 10 + len > end) {
+      break;
+    }
+    if(queryptr[0] == 0 && queryptr[1] == DNS_TYPE_SOA && len >= 20) {
+      ttl = ((uint32_t)queryptr[4] << 24) | ((uint32_t)queryptr[5] << 16) |
+        ((uint32_t)queryptr[6] << 8) | queryptr[7];
+      queryptr += 10 + len - 4;
+      minimum = ((uint32_t)queryptr[0] << 24) | ((uint32_t)queryptr[1] << 16) |
+        ((uint32_t)queryptr[2] << 8) | queryptr[3];
+      ttl = minimum < ttl ? minimum : ttl;
+      return ttl > RESOLV_CONF_MAX_TTL ? RESOLV_CONF_MAX_TTL : ttl;
+    }
+    queryptr += 10 + len;
+  }
+  return RESOLV_CONF_NEGATIVE_TTL;
+}
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Picks a non-zero transaction ID that no other query is waiting on.
+ */
+static uint16_t
+new_query_id(void)
+{
+  uint16_t id;
+  uint8_t i;
+
+  do {
+    id = random_rand();
+    for(i = 0; i < RESOLV_ENTRIES; ++i) {
+      if(names[i].state == STATE_ASKING && names[i].id == id) {
+        break;
+      }
+    }
+  } while(id == 0 || i < RESOLV_ENTRIES);
+  return id;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+outstanding(uint8_t server)
+{
+  uint8_t i, n;
+
+  for(i = n = 0; i < RESOLV_ENTRIES; ++i) {
+    if(names[i].state == STATE_ASKING && names[i].server == server) {
+      ++n;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/** \internal
+ * Checks that the response in uip_buf came from the server the query
+ * was sent to.
+ */
+static int
+from_server(const struct namemap *namemapptr)
+{
+  const uip_ipaddr_t *server;
+
+  server = uip_nameserver_get(namemapptr->server);
+  return server != NULL &&
+    uip_ipaddr_cmp(server, &UIP_UDP_BUF->srcipaddr) &&
+    UIP_UDP_BUF->srcport == UIP_HTONS(DNS_PORT);
+}
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
+/*---------------------------------------------------------------------------*/
 static char
 try_next_server(struct namemap *namemapptr)
 {
@@ -675,6 +948,9 @@ check_entries(void)
             /* Try the next server (if possible) before failing. Otherwise
                simply mark the entry as failed. */
             if(try_next_server(namemapptr) == 0) {
+#if RESOLV_CONF_CACHE_ENTRIES
+              query_done(namemapptr, NULL, RESOLV_CONF_NEGATIVE_TTL);
+#else /* RESOLV_CONF_CACHE_ENTRIES */
               /* STATE_ERROR basically means "not found". */
               namemapptr->state = STATE_ERROR;
 
@@ -684,6 +960,7 @@ check_entries(void)
 #endif /* RESOLV_SUPPORTS_RECORD_EXPIRATION */
 
               resolv_found(namemapptr->name, NULL);
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
               continue;
             }
           }
@@ -702,13 +979,23 @@ check_entries(void)
           continue;
         }
       } else {
+#if RESOLV_CONF_CACHE_ENTRIES
+        if(outstanding(namemapptr->server) >= RESOLV_CONF_MAX_OUTSTANDING) {
+          continue;
+        }
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
         namemapptr->state = STATE_ASKING;
         namemapptr->tmr = 1;
         namemapptr->retries = 0;
       }
       hdr = (struct dns_hdr *)uip_appdata;
       memset(hdr, 0, sizeof(struct dns_hdr));
+#if RESOLV_CONF_CACHE_ENTRIES
+      hdr->id = new_query_id();
+      stats.queries++;
+#else /* RESOLV_CONF_CACHE_ENTRIES */
       hdr->id = random_rand();
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
       namemapptr->id = hdr->id;
 #if RESOLV_CONF_SUPPORTS_MDNS
       if(!namemapptr->is_mdns || namemapptr->is_probe) {
@@ -772,7 +1059,10 @@ check_entries(void)
       PRINTF("resolver: (i=%d) Sent DNS request for \"%s\".\n", i,
              namemapptr->name);
 #endif /* RESOLV_CONF_SUPPORTS_MDNS */
+#if !RESOLV_CONF_CACHE_ENTRIES
+      /* Queries for other names wait for the next round. */
       break;
+#endif /* !RESOLV_CONF_CACHE_ENTRIES */
     }
   }
 }
@@ -895,10 +1185,18 @@ newdata(void)
 
 /** ANSWER HANDLING SECTION **************************************************/
 
+#if RESOLV_CONF_CACHE_ENTRIES
+  /* A unicast response without answers still completes a query: it is
+   * the negative answer we want to cache. */
+  if(nanswers == 0 && (is_request || hdr->id == 0)) {
+    return;
+  }
+#else /* RESOLV_CONF_CACHE_ENTRIES */
   if(nanswers == 0) {
     /* Skip responses with no answers. */
     return;
   }
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
 
 #if RESOLV_CONF_SUPPORTS_MDNS
   if(UIP_UDP_BUF->srcport == UIP_HTONS(MDNS_PORT) &&
@@ -915,7 +1213,11 @@ newdata(void)
     for(i = 0; i < RESOLV_ENTRIES; ++i) {
       namemapptr = &names[i];
       if(namemapptr->state == STATE_ASKING &&
-         namemapptr->id == hdr->id) {
+         namemapptr->id == hdr->id
+#if RESOLV_CONF_CACHE_ENTRIES
+         && from_server(namemapptr)
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
+        ) {
         break;
       }
     }
@@ -927,6 +1229,14 @@ newdata(void)
 
     PRINTF("resolver: Incoming response for \"%s\".\n", namemapptr->name);
 
+#if RESOLV_CONF_CACHE_ENTRIES
+    if(hdr->flags2 & DNS_FLAG2_ERR_MASK) {
+      query_done(namemapptr, NULL,
+                 negative_ttl(queryptr,
+                              nanswers + (uint8_t)uip_ntohs(hdr->numauthrr)));
+      return;
+    }
+#else /* RESOLV_CONF_CACHE_ENTRIES */
     /* We'll change this to DONE when we find the record. */
     namemapptr->state = STATE_ERROR;
 
@@ -943,6 +1253,7 @@ newdata(void)
       resolv_found(namemapptr->name, NULL);
       return;
     }
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
   }
 
   i = 0;
@@ -984,6 +1295,31 @@ newdata(void)
 #if RESOLV_CONF_SUPPORTS_MDNS
     if(UIP_UDP_BUF->srcport == UIP_HTONS(MDNS_PORT) &&
        hdr->id == 0) {
+#if RESOLV_CONF_CACHE_ENTRIES
+      static char mdns_name[RESOLV_CONF_MAX_DOMAIN_NAME_SIZE + 1];
+      struct cache_entry *e;
+
+      DEBUG_PRINTF("resolver: MDNS query.\n");
+
+      for(i = 0; i < RESOLV_ENTRIES; ++i) {
+        namemapptr = &names[i];
+        if(namemapptr->state == STATE_ASKING && namemapptr->is_mdns &&
+           dns_name_isequal(queryptr, namemapptr->name, uip_appdata)) {
+          break;
+        }
+      }
+      if(i == RESOLV_ENTRIES) {
+        /* Unsolicited answers go straight to the cache. */
+        DEBUG_PRINTF("resolver: Unsolicited MDNS response.\n");
+        if(decode_name(queryptr, mdns_name, uip_appdata)) {
+          e = cache_store(mdns_name, (uip_ipaddr_t *)ans->ipaddr,
+                          answer_ttl(ans));
+          resolv_found(e->name, &e->ipaddr);
+        }
+        namemapptr = NULL;
+        goto skip_to_next_answer;
+      }
+#else /* RESOLV_CONF_CACHE_ENTRIES */
       int8_t available_i = RESOLV_ENTRIES;
 
       DEBUG_PRINTF("resolver: MDNS query.\n");
@@ -1026,6 +1362,7 @@ newdata(void)
         goto skip_to_next_answer;
       }
       namemapptr = &names[i];
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
 
     } else
 #endif /* RESOLV_CONF_SUPPORTS_MDNS */
@@ -1045,15 +1382,18 @@ newdata(void)
 
     DEBUG_PRINTF("resolver: Answer for \"%s\" is usable.\n", namemapptr->name);
 
+#if RESOLV_CONF_CACHE_ENTRIES
+    query_done(namemapptr, (uip_ipaddr_t *) ans->ipaddr, answer_ttl(ans));
+#else /* RESOLV_CONF_CACHE_ENTRIES */
     namemapptr->state = STATE_DONE;
 #if RESOLV_SUPPORTS_RECORD_EXPIRATION
-    namemapptr->expiration = ans->ttl[1] + (ans->ttl[0] << 8);
-    namemapptr->expiration += clock_seconds();
+    namemapptr->expiration = answer_ttl(ans) + clock_seconds();
 #endif /* RESOLV_SUPPORTS_RECORD_EXPIRATION */
 
     uip_ipaddr_copy(&namemapptr->ipaddr, (uip_ipaddr_t *) ans->ipaddr);
 
     resolv_found(namemapptr->name, &namemapptr->ipaddr);
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
     break;
 
   skip_to_next_answer:
@@ -1074,6 +1414,12 @@ newdata(void)
       namemapptr->state = STATE_ASKING;
       process_post(&resolv_process, PROCESS_EVENT_TIMER, NULL);
     }
+#if RESOLV_CONF_CACHE_ENTRIES
+    else {
+      query_done(namemapptr, NULL,
+                 negative_ttl(queryptr, (uint8_t)uip_ntohs(hdr->numauthrr)));
+    }
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
   }
 
 }
@@ -1159,6 +1505,10 @@ PROCESS_THREAD(resolv_process, ev, data)
   PROCESS_BEGIN();
 
   memset(names, 0, sizeof(names));
+#if RESOLV_CONF_CACHE_ENTRIES
+  memb_init(&cache_memb);
+  list_init(cache_list);
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
 
   resolv_event_found = process_alloc_event();
 
@@ -1301,6 +1651,12 @@ resolv_query(const char *name)
     i = lseqi;
     nameptr = &names[i];
   }
+#if RESOLV_CONF_CACHE_ENTRIES
+  else if(nameptr->state == STATE_NEW || nameptr->state == STATE_ASKING) {
+    /* Already on its way; restarting would only discard the answer. */
+    return;
+  }
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
 
   PRINTF("resolver: Starting query for \"%s\".\n", name);
 
@@ -1347,9 +1703,11 @@ resolv_lookup(const char *name, uip_ipaddr_t ** ipaddr)
 {
   resolv_status_t ret = RESOLV_STATUS_UNCACHED;
 
+#if !RESOLV_CONF_CACHE_ENTRIES
   static uint8_t i;
 
   struct namemap *nameptr;
+#endif /* !RESOLV_CONF_CACHE_ENTRIES */
 
   /* Remove trailing dots, if present. */
   name = remove_trailing_dots(name);
@@ -1370,6 +1728,9 @@ resolv_lookup(const char *name, uip_ipaddr_t ** ipaddr)
   }
 #endif /* UIP_CONF_LOOPBACK_INTERFACE */
 
+#if RESOLV_CONF_CACHE_ENTRIES
+  ret = cache_status(name, ipaddr, ret);
+#else /* RESOLV_CONF_CACHE_ENTRIES */
   /* Walk through the list to see if the name is in there. */
   for(i = 0; i < RESOLV_ENTRIES; ++i) {
     nameptr = &names[i];
@@ -1407,6 +1768,7 @@ resolv_lookup(const char *name, uip_ipaddr_t ** ipaddr)
       break;
     }
   }
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
 
 #if VERBOSE_DEBUG
   switch (ret) {
@@ -1435,6 +1797,17 @@ resolv_lookup(const char *name, uip_ipaddr_t ** ipaddr)
   return ret;
 }
 /*---------------------------------------------------------------------------*/
+#if RESOLV_CONF_CACHE_ENTRIES
+/**
+ * \brief      Returns the resolver cache counters.
+ */
+const struct resolv_stats *
+resolv_get_stats(void)
+{
+  return &stats;
+}
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
+/*---------------------------------------------------------------------------*/
 /** \internal
  * Callback function which is called when a hostname is found.
  *
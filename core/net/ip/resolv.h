@@ -52,6 +52,16 @@
 #define RESOLV_CONF_SUPPORTS_MDNS     (1)
 #endif
 
+/** If RESOLV_CONF_CACHE_ENTRIES is non-zero, resolved names (and
+ *  negative answers) are kept in a TTL-honouring LRU cache of that
+ *  many entries. The UIP_CONF_RESOLV_ENTRIES slots then only track
+ *  queries that are in flight, and several of them may be outstanding
+ *  towards the same server at once.
+ */
+#ifndef RESOLV_CONF_CACHE_ENTRIES
+#define RESOLV_CONF_CACHE_ENTRIES     0
+#endif
+
 /**
  * Event that is broadcasted when a DNS name has been resolved.
  */
@@ -95,6 +105,19 @@ CCIF resolv_status_t resolv_lookup(const char *name, uip_ipaddr_t ** ipaddr);
 
 CCIF void resolv_query(const char *name);
 
+#if RESOLV_CONF_CACHE_ENTRIES
+/** Resolver cache counters. */
+struct resolv_stats {
+  uint32_t hits;          /**< Lookups answered by a fresh address. */
+  uint32_t negative_hits; /**< Lookups answered by a cached failure. */
+  uint32_t misses;        /**< Lookups of uncached or expired names. */
+  uint32_t evictions;     /**< Unexpired entries dropped to make room. */
+  uint32_t queries;       /**< Queries sent, retransmissions included. */
+};
+
+CCIF const struct resolv_stats *resolv_get_stats(void);
+#endif /* RESOLV_CONF_CACHE_ENTRIES */
+
 #if RESOLV_CONF_SUPPORTS_MDNS
 CCIF void resolv_set_hostname(const char *hostname);
 
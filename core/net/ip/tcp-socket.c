@@ -40,6 +40,18 @@
 #include <stdio.h>
 #include <string.h>
 
+/* The number of segments a socket keeps in flight. With more than
+   one, the output buffer doubles as the retransmission buffer: the
+   first output_data_send_nxt bytes are sent but unacknowledged. */
+#ifdef TCP_SOCKET_CONF_SEND_WINDOW
+#define TCP_SOCKET_SEND_WINDOW TCP_SOCKET_CONF_SEND_WINDOW
+#else
+#define TCP_SOCKET_SEND_WINDOW UIP_TCP_SEND_WINDOW
+#endif
+
+#if TCP_SOCKET_SEND_WINDOW > UIP_TCP_SEND_WINDOW
+#error "TCP_SOCKET_CONF_SEND_WINDOW exceeds UIP_CONF_TCP_SEND_WINDOW"
+#endif
 
 static void relisten(struct tcp_socket *s);
 
@@ -55,6 +67,59 @@ call_event(struct tcp_socket *s, tcp_socket_event_t event)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if TCP_SOCKET_SEND_WINDOW > 1
+static void
+senddata(struct tcp_socket *s)
+{
+  int len;
+
+  if(uip_rexmit()) {
+    /* uIP has collapsed the window to the oldest segment. Resend it;
+       the rest of the buffer goes out again as new data. */
+    s->output_data_send_nxt = MIN(uip_conn->len, s->output_data_len);
+    if(s->output_data_send_nxt > 0) {
+      uip_send(s->output_data_ptr, s->output_data_send_nxt);
+    }
+    return;
+  }
+
+  len = MIN(s->output_data_len - s->output_data_send_nxt,
+            s->output_data_max_seg);
+  len = MIN(len, uip_send_room());
+  if(len > 0) {
+    uip_send(&s->output_data_ptr[s->output_data_send_nxt], len);
+    s->output_data_send_nxt += len;
+    if(s->output_data_send_nxt < s->output_data_len &&
+       uip_send_room() > len) {
+      /* More data and more window: ask to be polled again so that the
+         next segment goes out without waiting for an ACK. */
+      tcpip_poll_tcp(uip_conn);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+acked(struct tcp_socket *s)
+{
+  uint16_t len = uip_ackedlen();
+
+  /* After a retransmission, the ACK may also cover data that was sent
+     before it and has not been resent since. */
+  if(len > s->output_data_len) {
+    len = s->output_data_len;
+  }
+  if(len > 0) {
+    memmove(&s->output_data_ptr[0], &s->output_data_ptr[len],
+            s->output_data_len - len);
+    s->output_data_len -= len;
+    s->output_data_send_nxt = s->output_data_send_nxt > len ?
+      s->output_data_send_nxt - len : 0;
+    s->output_senddata_len = s->output_data_len;
+
+    call_event(s, TCP_SOCKET_DATA_SENT);
+  }
+}
+#else /* TCP_SOCKET_SEND_WINDOW > 1 */
 static void
 senddata(struct tcp_socket *s)
 {
@@ -96,6 +161,7 @@ acked(struct tcp_socket *s)
     call_event(s, TCP_SOCKET_DATA_SENT);
   }
 }
+#endif /* TCP_SOCKET_SEND_WINDOW > 1 */
 /*---------------------------------------------------------------------------*/
 static void
 newdata(struct tcp_socket *s)
@@ -175,6 +241,9 @@ appcall(void *state)
     if(s == NULL) {
       uip_abort();
     } else {
+#if TCP_SOCKET_SEND_WINDOW > 1
+      uip_send_window(TCP_SOCKET_SEND_WINDOW);
+#endif /* TCP_SOCKET_SEND_WINDOW > 1 */
       if(uip_newdata()) {
         newdata(s);
       }
@@ -184,12 +253,19 @@ appcall(void *state)
   }
 
   if(uip_timedout()) {
+    /* The uip_conn is closed and may be handed out again */
+    if(s != NULL) {
+      s->c = NULL;
+    }
     call_event(s, TCP_SOCKET_TIMEDOUT);
     relisten(s);
   }
 
   if(uip_aborted()) {
     tcp_markconn(uip_conn, NULL);
+    if(s != NULL) {
+      s->c = NULL;
+    }
     call_event(s, TCP_SOCKET_ABORTED);
     relisten(s);
 
@@ -274,10 +350,13 @@ tcp_socket_register(struct tcp_socket *s, void *ptr,
   s->input_data_ptr = input_databuf;
   s->input_data_maxlen = input_databuf_len;
   s->output_data_len = 0;
+  s->output_senddata_len = 0;
+  s->output_data_send_nxt = 0;
   s->output_data_ptr = output_databuf;
   s->output_data_maxlen = output_databuf_len;
   s->input_callback = input_callback;
   s->event_callback = event_callback;
+  s->c = NULL;
   list_add(socketlist, s);
 
   s->listen_port = 0;
@@ -349,7 +428,11 @@ tcp_socket_send(struct tcp_socket *s,
 
   len = MIN(datalen, s->output_data_maxlen - s->output_data_len);
 
-  memcpy(&s->output_data_ptr[s->output_data_len], data, len);
+  /* Data that the caller wrote straight into the output buffer is
+     already in place */
+  if(data != &s->output_data_ptr[s->output_data_len]) {
+    memcpy(&s->output_data_ptr[s->output_data_len], data, len);
+  }
   s->output_data_len += len;
 
   if(s->output_senddata_len == 0) {
@@ -360,6 +443,27 @@ tcp_socket_send(struct tcp_socket *s,
 }
 /*---------------------------------------------------------------------------*/
 int
+tcp_socket_sendv(struct tcp_socket *s,
+                 const struct uip_iovec *iov, int iovcnt)
+{
+  int i, len, n;
+
+  if(s == NULL) {
+    return -1;
+  }
+
+  len = 0;
+  for(i = 0; i < iovcnt; i++) {
+    n = tcp_socket_send(s, iov[i].base, iov[i].len);
+    len += n;
+    if(n < iov[i].len) {
+      break;
+    }
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
 tcp_socket_send_str(struct tcp_socket *s,
              const char *str)
 {
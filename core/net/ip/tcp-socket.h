@@ -229,6 +229,23 @@ int tcp_socket_send(struct tcp_socket *s,
                     const uint8_t *dataptr,
                     int datalen);
 
+/**
+ * \brief      Send data gathered from several buffers on a connected TCP socket
+ * \param s    A pointer to a TCP socket that must have been previously registered with tcp_socket_register()
+ * \param iov  An array of buffers to be sent, in order
+ * \param iovcnt The number of buffers in the array
+ * \retval -1  If an error occurs
+ * \return     The number of bytes that were successfully sent
+ *
+ *             This function works like calling tcp_socket_send() for
+ *             each buffer in turn, and stops at the first buffer
+ *             that does not fit in the output buffer. Use
+ *             tcp_socket_max_sendlen() first to send a message
+ *             either whole or not at all.
+ */
+int tcp_socket_sendv(struct tcp_socket *s,
+                     const struct uip_iovec *iov, int iovcnt);
+
 /**
  * \brief      Send a string on a connected TCP socket
  * \param s    A pointer to a TCP socket that must have been previously registered with tcp_socket_register()
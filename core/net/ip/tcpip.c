@@ -154,6 +154,25 @@ unsigned char tcpip_is_forwarding; /* Forwarding right now? */
 
 PROCESS(tcpip_process, "TCP/IP stack");
 
+#if TCPIP_PACKET_QUEUE
+struct tcpip_packet {
+  struct tcpip_packet *next;
+  uint16_t len;
+  uint8_t ext_len;
+  uint8_t data[UIP_BUFSIZE - UIP_LLH_LEN];
+};
+
+MEMB(packet_memb, struct tcpip_packet, TCPIP_PACKET_QUEUE_BUFFERS);
+LIST(input_queue);
+LIST(output_queue);
+static uint8_t input_queue_len;
+static uint8_t output_queue_len;
+
+struct tcpip_queue_stats tcpip_queue_stats;
+
+static void ipv6_output(void);
+#endif /* TCPIP_PACKET_QUEUE */
+
 /*---------------------------------------------------------------------------*/
 static void
 start_periodic_tcp_timer(void)
@@ -225,6 +244,74 @@ packet_input(void)
 #endif /* UIP_CONF_IP_FORWARD */
 }
 /*---------------------------------------------------------------------------*/
+#if TCPIP_PACKET_QUEUE
+/* Copy the packet in uip_buf to the end of a queue */
+static int
+enqueue(list_t queue, uint8_t *queue_len, uint8_t queue_max)
+{
+  struct tcpip_packet *p;
+
+  if(*queue_len >= queue_max || uip_len > sizeof(p->data)) {
+    return 0;
+  }
+  p = memb_alloc(&packet_memb);
+  if(p == NULL) {
+    return 0;
+  }
+  p->len = uip_len;
+  p->ext_len = uip_ext_len;
+  memcpy(p->data, UIP_IP_BUF, uip_len);
+  list_add(queue, p);
+  (*queue_len)++;
+  process_poll(&tcpip_process);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Move the packet at the head of a queue into uip_buf */
+static int
+dequeue(list_t queue, uint8_t *queue_len)
+{
+  struct tcpip_packet *p;
+
+  p = list_pop(queue);
+  if(p == NULL) {
+    return 0;
+  }
+  (*queue_len)--;
+  uip_len = p->len;
+  uip_ext_len = p->ext_len;
+  memcpy(UIP_IP_BUF, p->data, uip_len);
+  memb_free(&packet_memb, p);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+process_queues(void)
+{
+  uint8_t n;
+
+  /* Input packets that produce output, such as forwarded packets or
+     replies, add them to the output queue. Their own buffers are
+     freed first, so there is always room for that output. */
+  for(n = 0; n < TCPIP_PACKET_QUEUE_INPUT_BATCH; n++) {
+    if(!dequeue(input_queue, &input_queue_len)) {
+      break;
+    }
+    packet_input();
+  }
+
+  while(dequeue(output_queue, &output_queue_len)) {
+    ipv6_output();
+  }
+  uip_len = 0;
+  uip_ext_len = 0;
+
+  if(input_queue_len > 0) {
+    process_poll(&tcpip_process);
+  }
+}
+#endif /* TCPIP_PACKET_QUEUE */
+/*---------------------------------------------------------------------------*/
 #if UIP_TCP
 #if UIP_ACTIVE_OPEN
 struct uip_conn *
@@ -522,13 +609,33 @@ eventhandler(process_event_t ev, process_data_t data)
     case PACKET_INPUT:
       packet_input();
       break;
+
+#if TCPIP_PACKET_QUEUE
+    case PROCESS_EVENT_POLL:
+      process_queues();
+      break;
+#endif /* TCPIP_PACKET_QUEUE */
   };
 }
 /*---------------------------------------------------------------------------*/
 void
 tcpip_input(void)
 {
+#if TCPIP_PACKET_QUEUE
+  if(uip_len > 0) {
+    if(enqueue(input_queue, &input_queue_len, TCPIP_PACKET_QUEUE_INPUT_MAX)) {
+      tcpip_queue_stats.input_queued++;
+      if(input_queue_len > tcpip_queue_stats.input_max) {
+        tcpip_queue_stats.input_max = input_queue_len;
+      }
+    } else {
+      PRINTF("tcpip_input: input queue full, dropping packet\n");
+      tcpip_queue_stats.input_drops++;
+    }
+  }
+#else /* TCPIP_PACKET_QUEUE */
   process_post_synch(&tcpip_process, PACKET_INPUT, NULL);
+#endif /* TCPIP_PACKET_QUEUE */
   uip_len = 0;
 #if NETSTACK_CONF_WITH_IPV6
   uip_ext_len = 0;
@@ -536,16 +643,50 @@ tcpip_input(void)
 }
 /*---------------------------------------------------------------------------*/
 #if NETSTACK_CONF_WITH_IPV6
+#if TCPIP_PACKET_QUEUE
 void
 tcpip_ipv6_output(void)
+{
+  if(uip_len > 0) {
+    if(enqueue(output_queue, &output_queue_len, TCPIP_PACKET_QUEUE_BUFFERS)) {
+      tcpip_queue_stats.output_queued++;
+      if(output_queue_len > tcpip_queue_stats.output_max) {
+        tcpip_queue_stats.output_max = output_queue_len;
+      }
+    } else {
+      PRINTF("tcpip_ipv6_output: output queue full, dropping packet\n");
+      tcpip_queue_stats.output_drops++;
+    }
+  }
+  uip_len = 0;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+ipv6_output(void)
+#else /* TCPIP_PACKET_QUEUE */
+void
+tcpip_ipv6_output(void)
+#endif /* TCPIP_PACKET_QUEUE */
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if UIP_CONF_IPV6_RPL
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL */
 
   if(uip_len == 0) {
     return;
   }
 
+#if UIP_CONF_IPV6_RPL
+  /* A non-storing mode root source routes packets into its DODAG */
+  if(!rpl_insert_srh_header()) {
+    uip_len = 0;
+    return;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
   if(uip_len > UIP_LINK_MTU) {
     UIP_LOG("tcpip_ipv6_output: Packet to big");
     uip_len = 0;
@@ -567,6 +708,11 @@ tcpip_ipv6_output(void)
        nexthop address. */
     if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
       nexthop = &UIP_IP_BUF->destipaddr;
+#if UIP_CONF_IPV6_RPL
+    } else if(rpl_srh_get_next_hop(&srh_nexthop)) {
+      /* The next hop of a source routed packet */
+      nexthop = &srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL */
     } else {
       uip_ds6_route_t *route;
       /* Check if we have a route to the destination address. */
@@ -813,6 +959,12 @@ PROCESS_THREAD(tcpip_process, ev, data)
 #endif /* UIP_CONF_ICMP6 */
   etimer_set(&periodic, CLOCK_SECOND / 2);
 
+#if TCPIP_PACKET_QUEUE
+  memb_init(&packet_memb);
+  list_init(input_queue);
+  list_init(output_queue);
+#endif /* TCPIP_PACKET_QUEUE */
+
   uip_init();
 #ifdef UIP_FALLBACK_INTERFACE
   UIP_FALLBACK_INTERFACE.init();
@@ -350,11 +350,71 @@ void tcpip_set_outputfunc(uint8_t (* f)(void));
 
 /**
  * \brief This function does address resolution and then calls tcpip_output
+ *
+ *        With TCPIP_CONF_PACKET_QUEUE, the packet in uip_buf is
+ *        copied to the output queue and sent later from the
+ *        tcpip_process.
  */
 #if NETSTACK_CONF_WITH_IPV6
 void tcpip_ipv6_output(void);
 #endif
 
+/*
+ * Packet queues. By default, tcpip_input() processes the packet in
+ * uip_buf right away, and tcpip_ipv6_output() hands it to the MAC
+ * layer right away. With TCPIP_CONF_PACKET_QUEUE, both instead copy the
+ * packet to a buffer from a fixed pool and queue it. The tcpip_process
+ * then processes the input queue in batches, and sends the packets in
+ * the output queue, loading each packet into uip_buf in turn. This
+ * lets a forwarding node take in packets while others wait for the
+ * MAC layer, with the pool size as the bound on memory use. IPv6
+ * only.
+ */
+#ifdef TCPIP_CONF_PACKET_QUEUE
+#define TCPIP_PACKET_QUEUE (TCPIP_CONF_PACKET_QUEUE && NETSTACK_CONF_WITH_IPV6)
+#else
+#define TCPIP_PACKET_QUEUE 0
+#endif
+
+/* The number of packet buffers shared by the input and output queues */
+#ifdef TCPIP_CONF_PACKET_QUEUE_BUFFERS
+#define TCPIP_PACKET_QUEUE_BUFFERS TCPIP_CONF_PACKET_QUEUE_BUFFERS
+#else
+#define TCPIP_PACKET_QUEUE_BUFFERS 4
+#endif
+
+/* The maximum length of the input queue. This must be less than the
+   number of buffers, so that there is room to forward packets. */
+#ifdef TCPIP_CONF_PACKET_QUEUE_INPUT_MAX
+#define TCPIP_PACKET_QUEUE_INPUT_MAX TCPIP_CONF_PACKET_QUEUE_INPUT_MAX
+#else
+#define TCPIP_PACKET_QUEUE_INPUT_MAX (TCPIP_PACKET_QUEUE_BUFFERS / 2)
+#endif
+
+/* The number of input packets processed before the output queue is
+   sent */
+#ifdef TCPIP_CONF_PACKET_QUEUE_INPUT_BATCH
+#define TCPIP_PACKET_QUEUE_INPUT_BATCH TCPIP_CONF_PACKET_QUEUE_INPUT_BATCH
+#else
+#define TCPIP_PACKET_QUEUE_INPUT_BATCH TCPIP_PACKET_QUEUE_INPUT_MAX
+#endif
+
+#if TCPIP_PACKET_QUEUE
+/**
+ * \brief Packet queue counters
+ */
+struct tcpip_queue_stats {
+  uint16_t input_queued;   /**< Packets put in the input queue */
+  uint16_t input_drops;    /**< Input packets dropped, queue full */
+  uint16_t output_queued;  /**< Packets put in the output queue */
+  uint16_t output_drops;   /**< Output packets dropped, queue full */
+  uint8_t input_max;       /**< Longest input queue seen */
+  uint8_t output_max;      /**< Longest output queue seen */
+};
+
+extern struct tcpip_queue_stats tcpip_queue_stats;
+#endif /* TCPIP_PACKET_QUEUE */
+
 /**
  * \brief Is forwarding generally enabled?
  */
@@ -147,6 +147,42 @@ udp_socket_sendto(struct udp_socket *c,
   return -1;
 }
 /*---------------------------------------------------------------------------*/
+static int
+iovlen(const struct uip_iovec *iov, int iovcnt)
+{
+  int len;
+
+  for(len = 0; iovcnt > 0; iovcnt--, iov++) {
+    len += iov->len;
+  }
+  return MIN(len, UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN);
+}
+/*---------------------------------------------------------------------------*/
+int
+udp_socket_sendv(struct udp_socket *c,
+                 const struct uip_iovec *iov, int iovcnt)
+{
+  if(c == NULL || c->udp_conn == NULL) {
+    return -1;
+  }
+
+  uip_udp_packet_sendv(c->udp_conn, iov, iovcnt);
+  return iovlen(iov, iovcnt);
+}
+/*---------------------------------------------------------------------------*/
+int
+udp_socket_sendtov(struct udp_socket *c,
+                   const struct uip_iovec *iov, int iovcnt,
+                   const uip_ipaddr_t *to, uint16_t port)
+{
+  if(c == NULL || c->udp_conn == NULL) {
+    return -1;
+  }
+
+  uip_udp_packet_sendtov(c->udp_conn, iov, iovcnt, to, UIP_HTONS(port));
+  return iovlen(iov, iovcnt);
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(udp_socket_process, ev, data)
 {
   struct udp_socket *c;
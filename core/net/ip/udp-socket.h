@@ -175,6 +175,38 @@ int udp_socket_sendto(struct udp_socket *c,
                       const void *data, uint16_t datalen,
                       const uip_ipaddr_t *addr, uint16_t port);
 
+/**
+ * \brief      Send a datagram gathered from several buffers on a UDP socket
+ * \param c    A pointer to the struct udp_socket on which the data should be sent
+ * \param iov  An array of buffers that make up the datagram, in order
+ * \param iovcnt The number of buffers in the array
+ * \return     The number of bytes sent, or -1 if an error occurred
+ *
+ *             This function works like udp_socket_send(), but copies
+ *             the buffers straight into the outgoing packet. A
+ *             protocol header and a payload can thereby be sent
+ *             without first being assembled in a temporary buffer.
+ *
+ */
+int udp_socket_sendv(struct udp_socket *c,
+                     const struct uip_iovec *iov, int iovcnt);
+
+/**
+ * \brief      Send a datagram gathered from several buffers to a specific address and port
+ * \param c    A pointer to the struct udp_socket on which the data should be sent
+ * \param iov  An array of buffers that make up the datagram, in order
+ * \param iovcnt The number of buffers in the array
+ * \param addr The IP address to which the data should be sent
+ * \param port The UDP port number, in host byte order, to which the data should be sent
+ * \return     The number of bytes sent, or -1 if an error occurred
+ *
+ *             This is the vectored version of udp_socket_sendto().
+ *
+ */
+int udp_socket_sendtov(struct udp_socket *c,
+                       const struct uip_iovec *iov, int iovcnt,
+                       const uip_ipaddr_t *addr, uint16_t port);
+
 /**
  * \brief      Close a UDP socket
  * \param c    A pointer to the struct udp_socket to be closed
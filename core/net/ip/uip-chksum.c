@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *         Internet checksum computation and RFC 1624 incremental
+ *         checksum updates.
+ */
+
+#include "net/ip/uip.h"
+#include "net/ip/uip-chksum.h"
+
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+#if !UIP_ARCH_CHKSUM_SUM
+#if UIP_CHKSUM_WIDE
+uint16_t
+uip_chksum_sum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint64_t acc;
+  uint32_t w[4];
+  uint16_t h;
+  uint16_t t;
+
+  /* Sum the data as it is laid out in memory. The ones' complement
+     sum does not depend on byte order, so the result only needs to be
+     converted to host byte order at the end. */
+  acc = 0;
+  while(len >= sizeof(w)) {
+    memcpy(w, data, sizeof(w));
+    acc += (uint64_t)w[0] + w[1] + w[2] + w[3];
+    data += sizeof(w);
+    len -= sizeof(w);
+  }
+  while(len >= sizeof(w[0])) {
+    memcpy(&w[0], data, sizeof(w[0]));
+    acc += w[0];
+    data += sizeof(w[0]);
+    len -= sizeof(w[0]);
+  }
+  if(len >= sizeof(h)) {
+    memcpy(&h, data, sizeof(h));
+    acc += h;
+    data += sizeof(h);
+    len -= sizeof(h);
+  }
+  if(len > 0) {
+    /* The odd last byte is the first byte of a zero-padded word */
+    uint8_t last[2] = { data[0], 0 };
+    memcpy(&h, last, sizeof(h));
+    acc += h;
+  }
+
+  /* Fold the accumulator into 16 bits */
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+
+  t = UIP_HTONS((uint16_t)acc);
+  sum += t;
+  if(sum < t) {
+    sum++;      /* carry */
+  }
+  return sum;
+}
+#else /* UIP_CHKSUM_WIDE */
+uint16_t
+uip_chksum_sum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {   /* At least two more bytes */
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;      /* carry */
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;      /* carry */
+    }
+  }
+
+  /* Return sum in host byte order. */
+  return sum;
+}
+#endif /* UIP_CHKSUM_WIDE */
+#endif /* !UIP_ARCH_CHKSUM_SUM */
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_adjust16(uint16_t chksum, uint16_t old_value, uint16_t new_value)
+{
+  uint32_t sum;
+
+  /* HC' = ~(~HC + ~m + m') */
+  sum = (uint16_t)~chksum;
+  sum += (uint16_t)~old_value;
+  sum += new_value;
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  return ~sum;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_adjust(uint16_t chksum, const void *old_data,
+                  const void *new_data, uint16_t len)
+{
+  const uint8_t *old_bytes = old_data;
+  const uint8_t *new_bytes = new_data;
+  uint16_t old_value;
+  uint16_t new_value;
+  uint32_t sum;
+
+  sum = (uint16_t)~chksum;
+  while(len >= 2) {
+    memcpy(&old_value, old_bytes, 2);
+    memcpy(&new_value, new_bytes, 2);
+    sum += (uint16_t)~old_value;
+    sum += new_value;
+    if(sum > 0xffff) {
+      sum = (sum >> 16) + (sum & 0xffff);
+    }
+    old_bytes += 2;
+    new_bytes += 2;
+    len -= 2;
+  }
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  return ~sum;
+}
+/*---------------------------------------------------------------------------*/
+
+/** @} */
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *         Internet checksum computation, shared by the IPv4, IPv6 and
+ *         ip64 code, and RFC 1624 incremental checksum updates.
+ */
+
+#ifndef UIP_CHKSUM_H_
+#define UIP_CHKSUM_H_
+
+#include "contiki-conf.h"
+#include <stdint.h>
+
+/*
+ * Sum 32-bit words into a 64-bit accumulator, several words per loop
+ * iteration, instead of one 16-bit word at a time. This is faster on
+ * 32- and 64-bit CPUs but not on 8- and 16-bit ones.
+ */
+#ifdef UIP_CONF_CHKSUM_WIDE
+#define UIP_CHKSUM_WIDE UIP_CONF_CHKSUM_WIDE
+#elif defined(__x86_64__) || defined(__i386__) || defined(__arm__) || defined(__aarch64__)
+#define UIP_CHKSUM_WIDE 1
+#else
+#define UIP_CHKSUM_WIDE 0
+#endif
+
+/**
+ * \brief      Add data to a partial Internet checksum
+ * \param sum  The partial checksum so far, in host byte order
+ * \param data The data
+ * \param len  The length of the data, in bytes
+ * \return     The updated partial checksum, in host byte order
+ *
+ *             The data is summed as a sequence of 16-bit words in
+ *             network byte order, with an odd last byte padded with
+ *             zero. Platforms with UIP_ARCH_CHKSUM_SUM set provide
+ *             their own implementation of this function.
+ */
+uint16_t uip_chksum_sum(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/**
+ * \brief      Update a checksum after a change of the covered data
+ * \param chksum The checksum field, as stored in the packet
+ * \param old_data The data before the change
+ * \param new_data The data after the change
+ * \param len  The length of the changed data, in bytes; must be even,
+ *             and the data must start at an even offset from the
+ *             start of the checksummed data
+ * \return     The new checksum field, to be stored in the packet
+ *
+ *             This implements equation 3 of RFC 1624, and saves a full
+ *             checksum computation when forwarding code rewrites a few
+ *             header fields.
+ */
+uint16_t uip_chksum_adjust(uint16_t chksum, const void *old_data,
+                           const void *new_data, uint16_t len);
+
+/**
+ * \brief      Update a checksum after a change of one 16-bit word
+ * \param chksum The checksum field, as stored in the packet
+ * \param old_value The word before the change, as stored in the packet
+ * \param new_value The word after the change, as stored in the packet
+ * \return     The new checksum field, to be stored in the packet
+ */
+uint16_t uip_chksum_adjust16(uint16_t chksum, uint16_t old_value,
+                             uint16_t new_value);
+
+#endif /* UIP_CHKSUM_H_ */
+
+/** @} */
@@ -43,21 +43,20 @@ extern uint16_t uip_slen;
 
 #include "net/ip/uip-udp-packet.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
+#include "sys/cc.h"
 
 #include <string.h>
 
 /*---------------------------------------------------------------------------*/
-void
-uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
-{
+#define UDP_PAYLOAD_MAXLEN (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN)
+/*---------------------------------------------------------------------------*/
 #if UIP_UDP
-  if(data != NULL) {
-    uip_udp_conn = c;
-    uip_slen = len;
-    memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], data,
-           len > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN?
-           UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN: len);
-    uip_process(UIP_UDP_SEND_CONN);
+static void
+output(struct uip_udp_conn *c, int len)
+{
+  uip_udp_conn = c;
+  uip_slen = len;
+  uip_process(UIP_UDP_SEND_CONN);
 
 #if UIP_CONF_IPV6_MULTICAST
   /* Let the multicast engine process the datagram before we send it */
@@ -67,18 +66,57 @@ uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
 #endif /* UIP_IPV6_MULTICAST */
 
 #if NETSTACK_CONF_WITH_IPV6
-    tcpip_ipv6_output();
+  tcpip_ipv6_output();
 #else
-    if(uip_len > 0) {
-      tcpip_output();
-    }
+  if(uip_len > 0) {
+    tcpip_output();
+  }
 #endif
+  uip_slen = 0;
+}
+#endif /* UIP_UDP */
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
+{
+#if UIP_UDP
+  uint8_t *payload = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+
+  if(data != NULL) {
+    if(len > UDP_PAYLOAD_MAXLEN) {
+      len = UDP_PAYLOAD_MAXLEN;
+    }
+    /* Data that was built in place in uip_appdata is not copied */
+    if(data != payload) {
+      memmove(payload, data, len);
+    }
+    output(c, len);
   }
   uip_slen = 0;
 #endif /* UIP_UDP */
 }
 /*---------------------------------------------------------------------------*/
 void
+uip_udp_packet_sendv(struct uip_udp_conn *c,
+                     const struct uip_iovec *iov, int iovcnt)
+{
+#if UIP_UDP
+  uint8_t *payload = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+  int i, len, n;
+
+  len = 0;
+  for(i = 0; i < iovcnt && len < UDP_PAYLOAD_MAXLEN; i++) {
+    n = MIN(iov[i].len, UDP_PAYLOAD_MAXLEN - len);
+    if(iov[i].base != &payload[len]) {
+      memmove(&payload[len], iov[i].base, n);
+    }
+    len += n;
+  }
+  output(c, len);
+#endif /* UIP_UDP */
+}
+/*---------------------------------------------------------------------------*/
+void
 uip_udp_packet_sendto(struct uip_udp_conn *c, const void *data, int len,
 		      const uip_ipaddr_t *toaddr, uint16_t toport)
 {
@@ -102,3 +140,25 @@ uip_udp_packet_sendto(struct uip_udp_conn *c, const void *data, int len,
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_udp_packet_sendtov(struct uip_udp_conn *c,
+                       const struct uip_iovec *iov, int iovcnt,
+                       const uip_ipaddr_t *toaddr, uint16_t toport)
+{
+  uip_ipaddr_t curaddr;
+  uint16_t curport;
+
+  if(toaddr != NULL) {
+    uip_ipaddr_copy(&curaddr, &c->ripaddr);
+    curport = c->rport;
+
+    uip_ipaddr_copy(&c->ripaddr, toaddr);
+    c->rport = toport;
+
+    uip_udp_packet_sendv(c, iov, iovcnt);
+
+    uip_ipaddr_copy(&c->ripaddr, &curaddr);
+    c->rport = curport;
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -46,4 +46,11 @@ void uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len);
 void uip_udp_packet_sendto(struct uip_udp_conn *c, const void *data, int len,
 			   const uip_ipaddr_t *toaddr, uint16_t toport);
 
+/* Vectored variants: the buffers in iov are sent as one datagram */
+void uip_udp_packet_sendv(struct uip_udp_conn *c,
+                          const struct uip_iovec *iov, int iovcnt);
+void uip_udp_packet_sendtov(struct uip_udp_conn *c,
+                            const struct uip_iovec *iov, int iovcnt,
+                            const uip_ipaddr_t *toaddr, uint16_t toport);
+
 #endif /* UIP_UDP_PACKET_H_ */
@@ -615,6 +615,17 @@ struct uip_conn *uip_connect(const uip_ipaddr_t *ripaddr, uint16_t port);
  */
 #define uip_outstanding(conn) ((conn)->len)
 
+/**
+ * One buffer of a scatter/gather list. The vectored send functions
+ * take an array of these and copy the buffers back to back into the
+ * outgoing data, so that a header and a payload that live apart need
+ * not first be assembled in a temporary buffer.
+ */
+struct uip_iovec {
+  const void *base;
+  uint16_t len;
+};
+
 /**
  * Send data on the current connection.
  *
@@ -841,6 +852,50 @@ CCIF void uip_send(const void *data, int len);
  */
 #define uip_mss()             (uip_conn->mss)
 
+#if UIP_TCP_SEND_WINDOW > 1
+/**
+ * Allow the current connection to have several segments in flight.
+ *
+ * Once enabled, the application may send new data with uip_send()
+ * whenever uip_send_room() is non-zero, not only when all previously
+ * sent data has been acknowledged. uip_acked() then signals that
+ * uip_ackedlen() bytes from the start of the unacknowledged data
+ * were acknowledged, and uip_rexmit() asks the application to resend
+ * the first uip_conn->len bytes of the unacknowledged data. Data sent
+ * before a retransmission may still be acknowledged afterwards, so
+ * uip_ackedlen() can be larger than what was sent since then.
+ *
+ * \param segs The maximum number of segments in flight, at most
+ * UIP_TCP_SEND_WINDOW.
+ *
+ * \hideinitializer
+ */
+#define uip_send_window(segs) (uip_conn->snd_segs =                 \
+                               (segs) > UIP_TCP_SEND_WINDOW ?       \
+                               UIP_TCP_SEND_WINDOW : (segs))
+
+/**
+ * The number of bytes that the application may currently send on
+ * the current connection.
+ *
+ * \hideinitializer
+ */
+#define uip_send_room()       uip_tcp_send_room(uip_conn)
+
+/**
+ * The number of bytes acknowledged by the incoming segment.
+ *
+ * Only meaningful when uip_acked() is true on a connection that has
+ * enabled uip_send_window().
+ *
+ * \hideinitializer
+ */
+#define uip_ackedlen()        (uip_ackedlen)
+
+uint16_t uip_tcp_send_room(struct uip_conn *conn);
+extern uint16_t uip_ackedlen;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
+
 /**
  * Set up a new UDP connection.
  *
@@ -889,7 +944,12 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  *
  * \hideinitializer
  */
+#if UIP_CONN_HASH_SIZE
+#define uip_udp_bind(conn, port) uip_udp_rebind(conn, port)
+void uip_udp_rebind(struct uip_udp_conn *conn, uint16_t port);
+#else /* UIP_CONN_HASH_SIZE */
 #define uip_udp_bind(conn, port) (conn)->lport = port
+#endif /* UIP_CONN_HASH_SIZE */
 
 /**
  * Send a UDP datagram of length len on the current connection.
@@ -1362,6 +1422,18 @@ struct uip_conn {
   uint8_t timer;         /**< The retransmission timer. */
   uint8_t nrtx;          /**< The number of retransmissions for the last
 			 segment sent. */
+#if UIP_TCP_SEND_WINDOW > 1
+  uint16_t snd_wnd;      /**< The window advertised by the remote host. */
+  uint16_t rtt_len;      /**< Bytes to be acknowledged before the timed
+                            segment is, or zero if none is timed. */
+  uint16_t snd_max_len;  /**< Bytes sent beyond snd_nxt, including those
+                            dropped from len by a retransmission. */
+  uint8_t rtt_ticks;     /**< Timer ticks since the timed segment was
+                            sent. */
+  uint8_t snd_segs;      /**< The maximum number of segments in flight,
+                            zero or one for stop-and-wait. */
+  uint8_t dupacks;       /**< The number of duplicate ACKs received. */
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 
   /** The application state. */
   uip_tcp_appstate_t appstate;
@@ -421,6 +421,27 @@ void uip_log(char *msg);
 #define UIP_CONNS (UIP_CONF_MAX_CONNECTIONS)
 #endif /* UIP_CONF_MAX_CONNECTIONS */
 
+/**
+ * The number of hash buckets used to demultiplex incoming TCP
+ * segments and UDP datagrams to connections.
+ *
+ * With the default of 0, the connection tables are scanned linearly
+ * for every packet. Larger tables should set this to a power of two,
+ * roughly the number of connections, so that demultiplexing takes
+ * constant time. Only the IPv6 stack supports this.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_CONN_HASH_SIZE
+#define UIP_CONN_HASH_SIZE (UIP_CONF_CONN_HASH_SIZE)
+#else /* UIP_CONF_CONN_HASH_SIZE */
+#define UIP_CONN_HASH_SIZE 0
+#endif /* UIP_CONF_CONN_HASH_SIZE */
+
+#if UIP_CONN_HASH_SIZE & (UIP_CONN_HASH_SIZE - 1)
+#error "UIP_CONF_CONN_HASH_SIZE must be a power of two"
+#endif
+
 
 /**
  * The maximum number of simultaneously listening TCP ports.
@@ -500,6 +521,26 @@ void uip_log(char *msg);
 #define UIP_RECEIVE_WINDOW (UIP_CONF_RECEIVE_WINDOW)
 #endif
 
+/**
+ * The maximum number of unacknowledged TCP segments a connection may
+ * have in flight.
+ *
+ * With the default of 1, uIP keeps its classic stop-and-wait
+ * behaviour. Larger values compile in a sliding send window with
+ * cumulative ACK processing, fast retransmit on three duplicate ACKs
+ * and go-back-N retransmission. Connections only use the window once
+ * the application has enabled it with uip_send_window(), since the
+ * application must be able to regenerate any unacknowledged byte on
+ * a retransmit. Only the IPv6 stack supports this.
+ *
+ * \hideinitializer
+ */
+#ifdef UIP_CONF_TCP_SEND_WINDOW
+#define UIP_TCP_SEND_WINDOW (UIP_CONF_TCP_SEND_WINDOW)
+#else
+#define UIP_TCP_SEND_WINDOW 1
+#endif
+
 /**
  * How long a connection should stay in the TIME_WAIT state.
  *
@@ -38,6 +38,7 @@
 
 #include "lib/random.h"
 
+#include <stddef.h>
 #include <string.h>
 
 #ifdef IP64_ADDRMAP_CONF_ENTRIES
@@ -46,15 +47,144 @@
 #define NUM_ENTRIES 32
 #endif /* IP64_ADDRMAP_CONF_ENTRIES */
 
+/* Number of buckets in each of the two hash indexes, a power of two. */
+#ifdef IP64_ADDRMAP_CONF_HASH_SIZE
+#define HASH_SIZE IP64_ADDRMAP_CONF_HASH_SIZE
+#else /* IP64_ADDRMAP_CONF_HASH_SIZE */
+#define HASH_SIZE 16
+#endif /* IP64_ADDRMAP_CONF_HASH_SIZE */
+
+/* Number of slots in the expiry timing wheel, a power of two, and the
+   time covered by each slot. */
+#ifdef IP64_ADDRMAP_CONF_WHEEL_SLOTS
+#define WHEEL_SLOTS IP64_ADDRMAP_CONF_WHEEL_SLOTS
+#else /* IP64_ADDRMAP_CONF_WHEEL_SLOTS */
+#define WHEEL_SLOTS 32
+#endif /* IP64_ADDRMAP_CONF_WHEEL_SLOTS */
+
+#ifdef IP64_ADDRMAP_CONF_WHEEL_TICK
+#define WHEEL_TICK IP64_ADDRMAP_CONF_WHEEL_TICK
+#else /* IP64_ADDRMAP_CONF_WHEEL_TICK */
+#define WHEEL_TICK (CLOCK_SECOND * 4)
+#endif /* IP64_ADDRMAP_CONF_WHEEL_TICK */
+
+#if (HASH_SIZE & (HASH_SIZE - 1)) || (WHEEL_SLOTS & (WHEEL_SLOTS - 1))
+#error "IP64_ADDRMAP_CONF_HASH_SIZE and _WHEEL_SLOTS must be powers of two"
+#endif
+
 MEMB(entrymemb, struct ip64_addrmap_entry, NUM_ENTRIES);
 LIST(entrylist);
 
+/* Entries are indexed by their flow (the 5-tuple seen from the IPv6
+   side) and by their mapped port. */
+static struct ip64_addrmap_entry *flow_hash[HASH_SIZE];
+static struct ip64_addrmap_entry *port_hash[HASH_SIZE];
+
+/* The timing wheel holds each entry in the slot of the tick at which
+   it is expected to expire. Extending the lifetime of an entry does
+   not move it: when its slot comes up, entries that have not expired
+   yet are simply put in the slot of their new expiry tick. */
+static struct ip64_addrmap_entry *wheel[WHEEL_SLOTS];
+/* The next tick to process, and the clock time at which it starts.
+   The wheel is advanced by the time elapsed since then, which stays
+   correct when clock_time() wraps. */
+static clock_time_t wheel_tick;
+static clock_time_t wheel_clock;
+
+static uint16_t recyclable;
+
+#define TICK_BEFORE(a, b) ((clock_time_t)((a) - (b)) > \
+                           ((clock_time_t)~0) / 2)
+
 #define FIRST_MAPPED_PORT 10000
 #define LAST_MAPPED_PORT  20000
 static uint16_t mapped_port = FIRST_MAPPED_PORT;
 
 #define printf(...)
 
+/*---------------------------------------------------------------------------*/
+static unsigned
+flow_bucket(const uip_ip6addr_t *ip6addr, uint16_t ip6port,
+            const uip_ip4addr_t *ip4addr, uint16_t ip4port,
+            uint8_t protocol)
+{
+  uint16_t h;
+
+  h = ip6addr->u16[6] ^ ip6addr->u16[7] ^ ip4addr->u16[0] ^ ip4addr->u16[1];
+  h ^= ip6port ^ (uint16_t)((ip4port << 7) | (ip4port >> 9)) ^ protocol;
+  h ^= h >> 8;
+  return h & (HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+port_bucket(uint16_t port)
+{
+  return (port ^ (port >> 8)) & (HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+chain_remove(struct ip64_addrmap_entry **head, struct ip64_addrmap_entry *m,
+             size_t link)
+{
+  struct ip64_addrmap_entry **p;
+
+  /* link is the offset of the chain pointer within the entry. */
+  for(p = head; *p != NULL;
+      p = (struct ip64_addrmap_entry **)((char *)*p + link)) {
+    if(*p == m) {
+      *p = *(struct ip64_addrmap_entry **)((char *)m + link);
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+expiry_tick(struct ip64_addrmap_entry *m)
+{
+  clock_time_t expiry;
+
+  /* The first tick that starts after the entry has expired. */
+  expiry = m->timer.start + m->timer.interval;
+  if(TICK_BEFORE(expiry, wheel_clock)) {
+    return wheel_tick;
+  }
+  return wheel_tick + (clock_time_t)(expiry - wheel_clock) / WHEEL_TICK + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_add(struct ip64_addrmap_entry *m)
+{
+  struct ip64_addrmap_entry **slot;
+
+  m->wheel_tick = expiry_tick(m);
+  slot = &wheel[m->wheel_tick & (WHEEL_SLOTS - 1)];
+  m->wheel_next = *slot;
+  *slot = m;
+}
+/*---------------------------------------------------------------------------*/
+static void
+wheel_remove(struct ip64_addrmap_entry *m)
+{
+  chain_remove(&wheel[m->wheel_tick & (WHEEL_SLOTS - 1)], m,
+               offsetof(struct ip64_addrmap_entry, wheel_next));
+}
+/*---------------------------------------------------------------------------*/
+/* Drop an entry that has already been taken off the timing wheel. */
+static void
+entry_free(struct ip64_addrmap_entry *m)
+{
+  chain_remove(&flow_hash[flow_bucket(&m->ip6addr, m->ip6port,
+                                      &m->ip4addr, m->ip4port,
+                                      m->protocol)], m,
+               offsetof(struct ip64_addrmap_entry, flow_next));
+  chain_remove(&port_hash[port_bucket(m->mapped_port)], m,
+               offsetof(struct ip64_addrmap_entry, port_next));
+  if(m->flags & FLAGS_RECYCLABLE) {
+    recyclable--;
+  }
+  list_remove(entrylist, m);
+  memb_free(&entrymemb, m);
+}
 /*---------------------------------------------------------------------------*/
 struct ip64_addrmap_entry *
 ip64_addrmap_list(void)
@@ -67,26 +197,47 @@ ip64_addrmap_init(void)
 {
   memb_init(&entrymemb);
   list_init(entrylist);
+  memset(flow_hash, 0, sizeof(flow_hash));
+  memset(port_hash, 0, sizeof(port_hash));
+  memset(wheel, 0, sizeof(wheel));
+  wheel_tick = 0;
+  wheel_clock = clock_time();
+  recyclable = 0;
   mapped_port = FIRST_MAPPED_PORT;
 }
 /*---------------------------------------------------------------------------*/
 static void
 check_age(void)
 {
-  struct ip64_addrmap_entry *m;
+  struct ip64_addrmap_entry *m, *next;
+  clock_time_t now;
+  unsigned n;
 
-  /* Walk through the list of address mappings, throw away the ones
-     that are too old. */
-  m = list_head(entrylist);
-  while(m != NULL) {
-    if(timer_expired(&m->timer)) {
-      list_remove(entrylist, m);
-      memb_free(&entrymemb, m);
-      m = list_head(entrylist);
-    } else {
-      m = list_item_next(m);
+  /* Advance the timing wheel up to the current tick, throwing away
+     the mappings that are too old. Only the slots that have come up
+     since the last call are visited. */
+  now = clock_time();
+  for(n = 0; !TICK_BEFORE(now, wheel_clock) && n < WHEEL_SLOTS; n++) {
+    m = wheel[wheel_tick & (WHEEL_SLOTS - 1)];
+    wheel[wheel_tick & (WHEEL_SLOTS - 1)] = NULL;
+    wheel_tick++;
+    wheel_clock += WHEEL_TICK;
+    for(; m != NULL; m = next) {
+      next = m->wheel_next;
+      if(timer_expired(&m->timer)) {
+        entry_free(m);
+      } else {
+        wheel_add(m);
+      }
     }
   }
+  if(!TICK_BEFORE(now, wheel_clock)) {
+    /* A full revolution was processed, skip the remaining ticks but
+       keep the time into the current one. */
+    clock_time_t skip = (clock_time_t)(now - wheel_clock) / WHEEL_TICK + 1;
+    wheel_tick += skip;
+    wheel_clock += skip * WHEEL_TICK;
+  }
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -94,20 +245,22 @@ recycle(void)
 {
   /* Find the oldest recyclable mapping and remove it. */
   struct ip64_addrmap_entry *m, *oldest;
+  unsigned n;
 
-  /* Walk through the list of address mappings, throw away the ones
-     that are too old. */
+  if(recyclable == 0) {
+    return 0;
+  }
 
+  /* Walk the timing wheel from the current tick: the first slot with
+     a recyclable mapping holds the ones closest to expiry. */
   oldest = NULL;
-  for(m = list_head(entrylist);
-      m != NULL;
-      m = list_item_next(m)) {
-    if(m->flags & FLAGS_RECYCLABLE) {
-      if(oldest == NULL) {
-        oldest = m;
-      } else {
-        if(timer_remaining(&m->timer) <
-           timer_remaining(&oldest->timer)) {
+  for(n = 0; n < WHEEL_SLOTS && oldest == NULL; n++) {
+    for(m = wheel[(wheel_tick + n) & (WHEEL_SLOTS - 1)];
+        m != NULL;
+        m = m->wheel_next) {
+      if(m->flags & FLAGS_RECYCLABLE) {
+        if(oldest == NULL ||
+           timer_remaining(&m->timer) < timer_remaining(&oldest->timer)) {
           oldest = m;
         }
       }
@@ -117,8 +270,8 @@ recycle(void)
   /* If we found an oldest recyclable entry, remove it and return
      non-zero. */
   if(oldest != NULL) {
-    list_remove(entrylist, oldest);
-    memb_free(&entrymemb, oldest);
+    wheel_remove(oldest);
+    entry_free(oldest);
     return 1;
   }
 
@@ -137,7 +290,9 @@ ip64_addrmap_lookup(const uip_ip6addr_t *ip6addr,
   printf("lookup ip4port %d ip6port %d\n", uip_htons(ip4port),
 	 uip_htons(ip6port));
   check_age();
-  for(m = list_head(entrylist); m != NULL; m = list_item_next(m)) {
+  for(m = flow_hash[flow_bucket(ip6addr, ip6port, ip4addr, ip4port,
+                                protocol)];
+      m != NULL; m = m->flow_next) {
     printf("protocol %d %d, ip4port %d %d, ip6port %d %d, ip4 %d ip6 %d\n",
 	   m->protocol, protocol,
 	   m->ip4port, ip4port,
@@ -156,18 +311,31 @@ ip64_addrmap_lookup(const uip_ip6addr_t *ip6addr,
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+static struct ip64_addrmap_entry *
+lookup_mapped_port(uint16_t port)
+{
+  struct ip64_addrmap_entry *m;
+
+  for(m = port_hash[port_bucket(port)]; m != NULL; m = m->port_next) {
+    if(m->mapped_port == port) {
+      return m;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 struct ip64_addrmap_entry *
 ip64_addrmap_lookup_port(uint16_t mapped_port, uint8_t protocol)
 {
   struct ip64_addrmap_entry *m;
 
   check_age();
-  for(m = list_head(entrylist); m != NULL; m = list_item_next(m)) {
+  m = lookup_mapped_port(mapped_port);
+  if(m != NULL) {
     printf("mapped port %d %d, protocol %d %d\n",
 	   m->mapped_port, mapped_port,
 	   m->protocol, protocol);
-    if(m->mapped_port == mapped_port &&
-       m->protocol == protocol) {
+    if(m->protocol == protocol) {
       m->ip4to6++;
       return m;
     }
@@ -190,6 +358,7 @@ ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
 		    uint8_t protocol)
 {
   struct ip64_addrmap_entry *m;
+  unsigned bucket;
 
   check_age();
   m = memb_alloc(&entrymemb);
@@ -214,21 +383,20 @@ ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
     /* Pick a new, unused local port. First make sure that the
        mapped_port number does not belong to any active connection. If
        so, we keep increasing the mapped_port until we're free. */
-    {
-      struct ip64_addrmap_entry *n;
-      n = list_head(entrylist);
-      while(n != NULL) {
-	if(n->mapped_port == mapped_port) {
-	  increase_mapped_port();
-	  n = list_head(entrylist);
-	} else {
-	  n = list_item_next(m);
-	}
-      }
+    while(lookup_mapped_port(mapped_port) != NULL) {
+      increase_mapped_port();
     }
     m->mapped_port = mapped_port;
     increase_mapped_port();
 
+    bucket = flow_bucket(ip6addr, ip6port, ip4addr, ip4port, protocol);
+    m->flow_next = flow_hash[bucket];
+    flow_hash[bucket] = m;
+    bucket = port_bucket(m->mapped_port);
+    m->port_next = port_hash[bucket];
+    port_hash[bucket] = m;
+    wheel_add(m);
+
     list_add(entrylist, m);
     return m;
   }
@@ -241,14 +409,21 @@ ip64_addrmap_set_lifetime(struct ip64_addrmap_entry *e,
 {
   if(e != NULL) {
     timer_set(&e->timer, time);
+    /* Entries stay in their slot when their lifetime grows, but must
+       move forward in the wheel when it shrinks. */
+    if(TICK_BEFORE(expiry_tick(e), e->wheel_tick)) {
+      wheel_remove(e);
+      wheel_add(e);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
 void
 ip64_addrmap_set_recycleble(struct ip64_addrmap_entry *e)
 {
-  if(e != NULL) {
+  if(e != NULL && !(e->flags & FLAGS_RECYCLABLE)) {
     e->flags |= FLAGS_RECYCLABLE;
+    recyclable++;
   }
 }
 /*---------------------------------------------------------------------------*/
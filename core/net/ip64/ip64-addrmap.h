@@ -38,7 +38,11 @@
 
 struct ip64_addrmap_entry {
   struct ip64_addrmap_entry *next;
+  struct ip64_addrmap_entry *flow_next;
+  struct ip64_addrmap_entry *port_next;
+  struct ip64_addrmap_entry *wheel_next;
   struct timer timer;
+  clock_time_t wheel_tick;
   uip_ip6addr_t ip6addr;
   uip_ip4addr_t ip4addr;
   uint32_t ip6to4, ip4to6;
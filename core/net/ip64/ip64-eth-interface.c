@@ -88,6 +88,7 @@ static void
 output(void)
 {
   int len, ret;
+  uint8_t *ipv4packet, *ethpacket;
 
 
   printf("ip64-interface: output source ");
@@ -97,23 +98,25 @@ output(void)
   PRINTF("\n");
 
   printf("<--------------\n");
-  len = ip64_6to4(&uip_buf[UIP_LLH_LEN], uip_len,
-		  &ip64_packet_buffer[sizeof(struct ip64_eth_hdr)]);
+  /* Translate in place. The IPv4 header is shorter than the IPv6
+     header, so the Ethernet header fits in the space left in front of
+     it and the payload never moves. */
+  ipv4packet = &uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF];
+  ethpacket = ipv4packet - sizeof(struct ip64_eth_hdr);
+  len = ip64_6to4(&uip_buf[UIP_LLH_LEN], uip_len, ipv4packet);
 
   printf("ip64-interface: output len %d\n", len);
   if(len > 0) {
-    if(ip64_arp_check_cache(&ip64_packet_buffer[sizeof(struct ip64_eth_hdr)])) {
+    if(ip64_arp_check_cache(ipv4packet)) {
       printf("Create header\n");
-      ret = ip64_arp_create_ethhdr(ip64_packet_buffer,
-				   &ip64_packet_buffer[sizeof(struct ip64_eth_hdr)]);
+      ret = ip64_arp_create_ethhdr(ethpacket, ipv4packet);
       if(ret > 0) {
 	len += ret;
-	IP64_ETH_DRIVER.output(ip64_packet_buffer, len);
+	IP64_ETH_DRIVER.output(ethpacket, len);
       }
     } else {
       printf("Create request\n");
-      len = ip64_arp_create_arp_request(ip64_packet_buffer,
-					&ip64_packet_buffer[sizeof(struct ip64_eth_hdr)]);
+      len = ip64_arp_create_arp_request(ip64_packet_buffer, ipv4packet);
       IP64_ETH_DRIVER.output(ip64_packet_buffer, len);
     }
   }
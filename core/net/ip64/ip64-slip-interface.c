@@ -94,10 +94,11 @@ input_callback(void)
        packet back if no route is found */
     uip_ipaddr_copy(&last_sender, &UIP_IP_BUF->srcipaddr);
     
-    uint16_t len = ip64_4to6(&uip_buf[UIP_LLH_LEN], uip_len, 
-			     ip64_packet_buffer);
+    /* Translate in place: only the payload is moved to make room for
+       the larger IPv6 header. */
+    uint16_t len = ip64_4to6(&uip_buf[UIP_LLH_LEN], uip_len,
+			     &uip_buf[UIP_LLH_LEN]);
     if(len > 0) {
-      memcpy(&uip_buf[UIP_LLH_LEN], ip64_packet_buffer, len);
       uip_len = len;
       /*      PRINTF("send len %d\n", len); */
     } else {
@@ -131,13 +132,12 @@ output(void)
   if(uip_ipaddr_cmp(&last_sender, &UIP_IP_BUF->srcipaddr)) {
     PRINTF("ip64-interface: output, not sending bounced message\n");
   } else {
+    /* Translate in place, leaving the payload where it is. */
     len = ip64_6to4(&uip_buf[UIP_LLH_LEN], uip_len,
-		    ip64_packet_buffer);
+		    &uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF]);
     PRINTF("ip64-interface: output len %d\n", len);
     if(len > 0) {
-      memcpy(&uip_buf[UIP_LLH_LEN], ip64_packet_buffer, len);
-      uip_len = len;
-      slip_send();
+      slip_write(&uip_buf[UIP_LLH_LEN + IP64_HDRLEN_DIFF], len);
     }
   }
 }
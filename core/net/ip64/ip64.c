@@ -63,6 +63,7 @@
 #include "net/ipv6/uip-ds6.h"
 #include "ip64-ipv4-dhcp.h"
 #include "contiki-net.h"
+#include "net/ip/uip-chksum.h"
 
 #include "net/ip/uip-debug.h"
 
@@ -358,6 +359,27 @@ ipv6_transport_checksum(const uint8_t *packet, uint16_t len, uint8_t proto)
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
 /*---------------------------------------------------------------------------*/
+/* The one's complement sum of a pseudo-header, in network byte order,
+   given its source and destination addresses (stored back to back). */
+static uint16_t
+pseudo_sum(const void *addrs, uint16_t addrlen, uint16_t len, uint8_t proto)
+{
+  uint8_t tail[4];
+
+  tail[0] = len >> 8;
+  tail[1] = len & 0xff;
+  tail[2] = 0;
+  tail[3] = proto;
+  return uip_htons(uip_chksum_sum(uip_chksum_sum(0, addrs, addrlen), tail, 4));
+}
+/*---------------------------------------------------------------------------*/
+/* The first 16-bit word of an ICMP header, as stored in the packet. */
+static uint16_t
+icmp_type_word(uint8_t type, uint8_t icode)
+{
+  return uip_htons((type << 8) | icode);
+}
+/*---------------------------------------------------------------------------*/
 int
 ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
 	  uint8_t *resultpacket)
@@ -368,10 +390,19 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   struct tcp_hdr *tcphdr;
   struct icmpv4_hdr *icmpv4hdr;
   struct icmpv6_hdr *icmpv6hdr;
+  struct ipv6_hdr v6copy;
   uint16_t ipv6len, ipv4len;
+  uint16_t srcport, icmptype;
   struct ip64_addrmap_entry *m;
 
-  v6hdr = (struct ipv6_hdr *)ipv6packet;
+  if(ipv6packet_len < IPV6_HDRLEN) {
+    return 0;
+  }
+
+  /* The result may overlap the original packet, so we work from a
+     copy of the IPv6 header. */
+  memcpy(&v6copy, ipv6packet, IPV6_HDRLEN);
+  v6hdr = &v6copy;
   v4hdr = (struct ipv4_hdr *)resultpacket;
 
   if((v6hdr->len[0] << 8) + v6hdr->len[1] <= ipv6packet_len) {
@@ -381,16 +412,22 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
     return 0;
   }
 
-  /* We copy the data from the IPv6 packet into the IPv4 packet. We do
-     not modify the data in any way. */
-  memcpy(&resultpacket[IPV4_HDRLEN],
-	 &ipv6packet[IPV6_HDRLEN],
-	 ipv6len - IPV6_HDRLEN);
+  /* We move the data from the IPv6 packet into the IPv4 packet. We do
+     not modify the data in any way. If the caller translates in place
+     with IP64_HDRLEN_DIFF bytes of headroom, the data is already where
+     it should be. */
+  if(&resultpacket[IPV4_HDRLEN] != &ipv6packet[IPV6_HDRLEN]) {
+    memmove(&resultpacket[IPV4_HDRLEN],
+            &ipv6packet[IPV6_HDRLEN],
+            ipv6len - IPV6_HDRLEN);
+  }
 
   udphdr = (struct udp_hdr *)&resultpacket[IPV4_HDRLEN];
   tcphdr = (struct tcp_hdr *)&resultpacket[IPV4_HDRLEN];
   icmpv4hdr = (struct icmpv4_hdr *)&resultpacket[IPV4_HDRLEN];
-  icmpv6hdr = (struct icmpv6_hdr *)&ipv6packet[IPV6_HDRLEN];
+  icmpv6hdr = (struct icmpv6_hdr *)&resultpacket[IPV4_HDRLEN];
+  srcport = udphdr->srcport;
+  icmptype = icmp_type_word(icmpv6hdr->type, icmpv6hdr->icode);
 
   /* Translate the IPv6 header into an IPv4 header. */
 
@@ -424,15 +461,6 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   case IP_PROTO_TCP:
     PRINTF("ip64_6to4: TCP header\n");
     v4hdr->proto = IP_PROTO_TCP;
-
-    /* Compute and check the TCP checksum - since we're going to
-       recompute it ourselves, we must ensure that it was correct in
-       the first place. */
-    if(ipv6_transport_checksum(ipv6packet, ipv6len,
-                               IP_PROTO_TCP) != 0xffff) {
-      PRINTF("Bad TCP checksum, dropping packet\n");
-    }
-
     break;
 
   case IP_PROTO_UDP:
@@ -442,17 +470,10 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
     /* Check if this is a DNS request. If so, we should rewrite it
        with the DNS64 module. */
     if(udphdr->destport == UIP_HTONS(DNS_PORT)) {
-      ip64_dns64_6to4((uint8_t *)v6hdr + IPV6_HDRLEN + sizeof(struct udp_hdr),
+      ip64_dns64_6to4((uint8_t *)udphdr + sizeof(struct udp_hdr),
                       ipv6len - IPV6_HDRLEN - sizeof(struct udp_hdr),
                       (uint8_t *)udphdr + sizeof(struct udp_hdr),
-                      BUFSIZE - IPV4_HDRLEN - sizeof(struct udp_hdr));
-    }
-    /* Compute and check the UDP checksum - since we're going to
-       recompute it ourselves, we must ensure that it was correct in
-       the first place. */
-    if(ipv6_transport_checksum(ipv6packet, ipv6len,
-                               IP_PROTO_UDP) != 0xffff) {
-      PRINTF("Bad UDP checksum, dropping packet\n");
+                      ipv6len - IPV6_HDRLEN - sizeof(struct udp_hdr));
     }
     break;
 
@@ -616,25 +637,55 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
 
   /* The checksum is in different places in the different protocol
      headers, so we need to be sure that we update the correct
-     field. */
+     field. Rather than summing the whole packet again, we adjust the
+     checksum for what we changed: the pseudo-header, the source port
+     and the ICMP type. DNS messages are rewritten by the DNS64 module
+     and are summed from scratch. */
   switch(v4hdr->proto) {
   case IP_PROTO_TCP:
-    tcphdr->tcpchksum = 0;
-    tcphdr->tcpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						  IP_PROTO_TCP));
+    tcphdr->tcpchksum =
+      uip_chksum_adjust16(tcphdr->tcpchksum,
+                          pseudo_sum(&v6hdr->srcipaddr,
+                                     2 * sizeof(uip_ip6addr_t),
+                                     ipv4len - IPV4_HDRLEN, IP_PROTO_TCP),
+                          pseudo_sum(&v4hdr->srcipaddr,
+                                     2 * sizeof(uip_ip4addr_t),
+                                     ipv4len - IPV4_HDRLEN, IP_PROTO_TCP));
+    tcphdr->tcpchksum = uip_chksum_adjust16(tcphdr->tcpchksum, srcport,
+                                            tcphdr->srcport);
     break;
   case IP_PROTO_UDP:
-    udphdr->udpchksum = 0;
-    udphdr->udpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						  IP_PROTO_UDP));
+    if(udphdr->destport == UIP_HTONS(DNS_PORT)) {
+      udphdr->udpchksum = 0;
+      udphdr->udpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
+                                                    IP_PROTO_UDP));
+    } else {
+      udphdr->udpchksum =
+        uip_chksum_adjust16(udphdr->udpchksum,
+                            pseudo_sum(&v6hdr->srcipaddr,
+                                       2 * sizeof(uip_ip6addr_t),
+                                       ipv4len - IPV4_HDRLEN, IP_PROTO_UDP),
+                            pseudo_sum(&v4hdr->srcipaddr,
+                                       2 * sizeof(uip_ip4addr_t),
+                                       ipv4len - IPV4_HDRLEN, IP_PROTO_UDP));
+      udphdr->udpchksum = uip_chksum_adjust16(udphdr->udpchksum, srcport,
+                                              udphdr->srcport);
+    }
     if(udphdr->udpchksum == 0) {
       udphdr->udpchksum = 0xffff;
     }
     break;
   case IP_PROTO_ICMPV4:
-    icmpv4hdr->icmpchksum = 0;
-    icmpv4hdr->icmpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						      IP_PROTO_ICMPV4));
+    /* ICMPv4 has no pseudo-header. */
+    icmpv4hdr->icmpchksum =
+      uip_chksum_adjust16(icmpv4hdr->icmpchksum,
+                          pseudo_sum(&v6hdr->srcipaddr,
+                                     2 * sizeof(uip_ip6addr_t),
+                                     ipv4len - IPV4_HDRLEN, IP_PROTO_ICMPV6),
+                          0);
+    icmpv4hdr->icmpchksum =
+      uip_chksum_adjust16(icmpv4hdr->icmpchksum, icmptype,
+                          icmp_type_word(icmpv4hdr->type, icmpv4hdr->icode));
     break;
 
   default:
@@ -657,11 +708,22 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
   struct tcp_hdr *tcphdr;
   struct icmpv4_hdr *icmpv4hdr;
   struct icmpv6_hdr *icmpv6hdr;
+  struct ipv4_hdr v4copy;
   uint16_t ipv4len, ipv6len, ipv6_packet_len;
+  uint16_t destport, icmptype;
+  uint8_t full_chksum;
   struct ip64_addrmap_entry *m;
+  const uint8_t *dnsdata;
 
+  if(ipv4packet_len < IPV4_HDRLEN) {
+    return 0;
+  }
+
+  /* The result may overlap the original packet, so we work from a
+     copy of the IPv4 header. */
+  memcpy(&v4copy, ipv4packet, IPV4_HDRLEN);
   v6hdr = (struct ipv6_hdr *)resultpacket;
-  v4hdr = (struct ipv4_hdr *)ipv4packet;
+  v4hdr = &v4copy;
 
   if((v4hdr->len[0] << 8) + v4hdr->len[1] <= ipv4packet_len) {
     ipv4len = (v4hdr->len[0] << 8) + v4hdr->len[1];
@@ -674,21 +736,52 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
     return 0;
   }
 
-  /* Make sure that the resulting packet fits in the ip64 packet
-     buffer. If not, we drop it. */
-  if(ipv4len - IPV4_HDRLEN + IPV6_HDRLEN > BUFSIZE) {
+  /* Make sure that the resulting packet fits in uip_buf after the
+     link-layer header, where the interfaces put it. If not, we drop
+     it. */
+  if(ipv4len - IPV4_HDRLEN + IPV6_HDRLEN > UIP_BUFSIZE - UIP_LLH_LEN) {
     PRINTF("ip64_4to6: packet too big to fit in buffer, dropping\n");
     return 0;
   }
-  /* We copy the data from the IPv4 packet into the IPv6 packet. */
-  memcpy(&resultpacket[IPV6_HDRLEN],
-	 &ipv4packet[IPV4_HDRLEN],
-	 ipv4len - IPV4_HDRLEN);
-  
+
+  /* A DNS response is rewritten by the DNS64 module, which may grow
+     the message, so it needs the original in a buffer of its own. If
+     the result overlaps the original, the original is saved in
+     ip64_packet_buffer before the payload is moved. */
+  dnsdata = NULL;
+  udphdr = (struct udp_hdr *)&ipv4packet[IPV4_HDRLEN];
+  if(v4hdr->proto == IP_PROTO_UDP &&
+     ipv4len >= IPV4_HDRLEN + sizeof(struct udp_hdr) &&
+     udphdr->srcport == UIP_HTONS(DNS_PORT)) {
+    dnsdata = &ipv4packet[IPV4_HDRLEN];
+    if(dnsdata < resultpacket + ipv4len - IPV4_HDRLEN + IPV6_HDRLEN &&
+       resultpacket < ipv4packet + ipv4len) {
+      if(ipv4packet < ip64_packet_buffer + ip64_packet_buffer_maxlen &&
+         ip64_packet_buffer < ipv4packet + ipv4len) {
+        PRINTF("ip64_4to6: cannot translate DNS in place in ip64_packet_buffer\n");
+        return 0;
+      }
+      memcpy(ip64_packet_buffer, dnsdata, ipv4len - IPV4_HDRLEN);
+      dnsdata = ip64_packet_buffer;
+    }
+  }
+
+  /* We move the data from the IPv4 packet into the IPv6 packet,
+     unless the caller translates in place with IP64_HDRLEN_DIFF bytes
+     of headroom in front of the IPv4 packet. */
+  if(&resultpacket[IPV6_HDRLEN] != &ipv4packet[IPV4_HDRLEN]) {
+    memmove(&resultpacket[IPV6_HDRLEN],
+            &ipv4packet[IPV4_HDRLEN],
+            ipv4len - IPV4_HDRLEN);
+  }
+
   udphdr = (struct udp_hdr *)&resultpacket[IPV6_HDRLEN];
   tcphdr = (struct tcp_hdr *)&resultpacket[IPV6_HDRLEN];
-  icmpv4hdr = (struct icmpv4_hdr *)&ipv4packet[IPV4_HDRLEN];
+  icmpv4hdr = (struct icmpv4_hdr *)&resultpacket[IPV6_HDRLEN];
   icmpv6hdr = (struct icmpv6_hdr *)&resultpacket[IPV6_HDRLEN];
+  destport = udphdr->destport;
+  icmptype = icmp_type_word(icmpv4hdr->type, icmpv4hdr->icode);
+  full_chksum = 0;
 
   ipv6len = ipv4len - IPV4_HDRLEN + IPV6_HDRLEN;
   ipv6_packet_len = ipv6len - IPV6_HDRLEN;
@@ -730,13 +823,14 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
     v6hdr->nxthdr = IP_PROTO_UDP;
     /* Check if this is a DNS request. If so, we should rewrite it
        with the DNS64 module. */
-    if(udphdr->srcport == UIP_HTONS(DNS_PORT)) {
+    if(dnsdata != NULL) {
       int len;
 
-      len = ip64_dns64_4to6((uint8_t *)v4hdr + IPV4_HDRLEN + sizeof(struct udp_hdr),
+      len = ip64_dns64_4to6(dnsdata + sizeof(struct udp_hdr),
                             ipv4len - IPV4_HDRLEN - sizeof(struct udp_hdr),
                             (uint8_t *)v6hdr + IPV6_HDRLEN + sizeof(struct udp_hdr),
                             ipv6_packet_len - sizeof(struct udp_hdr));
+      full_chksum = 1;
       ipv6_packet_len = len + sizeof(struct udp_hdr);
       v6hdr->len[0] = ipv6_packet_len >> 8;
       v6hdr->len[1] = ipv6_packet_len & 0xff;
@@ -854,26 +948,52 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
      field. */
   switch(v6hdr->nxthdr) {
   case IP_PROTO_TCP:
-    tcphdr->tcpchksum = 0;
-    tcphdr->tcpchksum = ~(ipv6_transport_checksum(resultpacket,
-						  ipv6len,
-						  IP_PROTO_TCP));
+    tcphdr->tcpchksum =
+      uip_chksum_adjust16(tcphdr->tcpchksum,
+                          pseudo_sum(&v4hdr->srcipaddr,
+                                     2 * sizeof(uip_ip4addr_t),
+                                     ipv6_packet_len, IP_PROTO_TCP),
+                          pseudo_sum(&v6hdr->srcipaddr,
+                                     2 * sizeof(uip_ip6addr_t),
+                                     ipv6_packet_len, IP_PROTO_TCP));
+    tcphdr->tcpchksum = uip_chksum_adjust16(tcphdr->tcpchksum, destport,
+                                            tcphdr->destport);
     break;
   case IP_PROTO_UDP:
-    udphdr->udpchksum = 0;
-    udphdr->udpchksum = ~(ipv6_transport_checksum(resultpacket,
-						  ipv6len,
-						  IP_PROTO_UDP));
+    /* UDP checksums are optional in IPv4 but not in IPv6, so a
+       datagram without one must be summed from scratch. */
+    if(full_chksum || udphdr->udpchksum == 0) {
+      udphdr->udpchksum = 0;
+      udphdr->udpchksum = ~(ipv6_transport_checksum(resultpacket,
+                                                    ipv6len,
+                                                    IP_PROTO_UDP));
+    } else {
+      udphdr->udpchksum =
+        uip_chksum_adjust16(udphdr->udpchksum,
+                            pseudo_sum(&v4hdr->srcipaddr,
+                                       2 * sizeof(uip_ip4addr_t),
+                                       ipv6_packet_len, IP_PROTO_UDP),
+                            pseudo_sum(&v6hdr->srcipaddr,
+                                       2 * sizeof(uip_ip6addr_t),
+                                       ipv6_packet_len, IP_PROTO_UDP));
+      udphdr->udpchksum = uip_chksum_adjust16(udphdr->udpchksum, destport,
+                                              udphdr->destport);
+    }
     if(udphdr->udpchksum == 0) {
       udphdr->udpchksum = 0xffff;
     }
     break;
 
   case IP_PROTO_ICMPV6:
-    icmpv6hdr->icmpchksum = 0;
-    icmpv6hdr->icmpchksum = ~(ipv6_transport_checksum(resultpacket,
-                                                ipv6len,
-                                                IP_PROTO_ICMPV6));
+    /* ICMPv6, unlike ICMPv4, covers a pseudo-header. */
+    icmpv6hdr->icmpchksum =
+      uip_chksum_adjust16(icmpv6hdr->icmpchksum, 0,
+                          pseudo_sum(&v6hdr->srcipaddr,
+                                     2 * sizeof(uip_ip6addr_t),
+                                     ipv6_packet_len, IP_PROTO_ICMPV6));
+    icmpv6hdr->icmpchksum =
+      uip_chksum_adjust16(icmpv6hdr->icmpchksum, icmptype,
+                          icmp_type_word(icmpv6hdr->type, icmpv6hdr->icode));
     break;
   default:
     PRINTF("ip64_4to6: transport protocol %d not implemented\n", v4hdr->proto);
@@ -34,6 +34,17 @@
 
 #include "net/ip/uip.h"
 
+/**
+ * The difference in length between the IPv6 and IPv4 headers.
+ *
+ * ip64_6to4() and ip64_4to6() accept a result buffer that overlaps
+ * the original packet. A packet translated to resultpacket =
+ * ipv6packet + IP64_HDRLEN_DIFF, or to resultpacket = ipv4packet -
+ * IP64_HDRLEN_DIFF, keeps its payload where it is, so only the
+ * headers are rewritten. Checksums are always updated incrementally.
+ */
+#define IP64_HDRLEN_DIFF 20
+
 void ip64_init(void);
 int ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6len,
 	      uint8_t *resultpacket);
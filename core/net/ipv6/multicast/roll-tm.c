@@ -47,6 +47,8 @@
 #include "net/ipv6/multicast/uip-mcast6.h"
 #include "net/ipv6/multicast/roll-tm.h"
 #include "dev/watchdog.h"
+#include "lib/memb.h"
+#include "lib/list.h"
 #include <string.h>
 
 #define DEBUG DEBUG_NONE
@@ -195,6 +197,7 @@ struct trickle_param {
 /*---------------------------------------------------------------------------*/
 /* Sliding Windows */
 struct sliding_window {
+  struct sliding_window *next;  /* Next window in the same hash bucket */
   seed_id_t seed_id;
   int16_t lower_bound;          /* lolipop */
   int16_t upper_bound;          /* lolipop */
@@ -225,7 +228,6 @@ struct sliding_window {
  * w: pointer to a sliding window
  */
 #define SLIDING_WINDOW_IS_USED_CLR(w) ((w)->flags &= ~SLIDING_WINDOW_U_BIT)
-#define window_free(w) SLIDING_WINDOW_IS_USED_CLR(w)
 
 /**
  * \brief Set 'Is Seen' bit for window w
@@ -266,6 +268,11 @@ struct sliding_window {
 /*---------------------------------------------------------------------------*/
 /* Multicast Packet Buffers */
 struct mcast_packet {
+  struct mcast_packet *next;    /* Cache list, least recently sent first */
+  struct mcast_packet *hash_next; /* Next packet in the same hash bucket */
+#if UIP_MCAST6_STATS
+  clock_time_t received;        /* To sample the forwarding latency */
+#endif
 #if ROLL_TM_SHORT_SEEDS
   /* Short seeds are stored inside the message */
   seed_id_t seed_id;
@@ -275,12 +282,12 @@ struct mcast_packet {
   uint16_t buff_len;
   uint16_t seq_val;             /* host-byte order */
   struct sliding_window *sw;    /* Pointer to the SW this packet belongs to */
-  uint8_t flags;                /* Is-Used, Must Send, Is Listed */
+  uint8_t flags;                /* Forwarded, Must Send, Is Listed */
   uint8_t buff[UIP_BUFSIZE - UIP_LLH_LEN];
 };
 
 /* Flag bits */
-#define MCAST_PACKET_U_BIT       0x80   /* Is Used */
+#define MCAST_PACKET_F_BIT       0x40   /* Forwarded, or originated by us */
 #define MCAST_PACKET_S_BIT       0x20   /* Must Send Next Pass */
 #define MCAST_PACKET_L_BIT       0x10   /* Is listed in ICMP message */
 
@@ -299,23 +306,6 @@ struct mcast_packet {
 #define MCAST_PACKET_TTL(p) \
     (((struct uip_ip_hdr *)(p)->buff)->ttl)
 
-/**
- * \brief Set 'Is Used' bit for packet p
- * p: pointer to a packet buffer
- */
-#define MCAST_PACKET_USED_SET(p) ((p)->flags |= MCAST_PACKET_U_BIT)
-
-/**
- * \brief Clear 'Is Used' bit for packet p
- * p: pointer to a packet buffer
- */
-#define MCAST_PACKET_USED_CLR(p) ((p)->flags &= ~MCAST_PACKET_U_BIT)
-
-/**
- * \brief Is Occupied buffer location p
- */
-#define MCAST_PACKET_IS_USED(p) ((p)->flags & MCAST_PACKET_U_BIT)
-
 /**
  * \brief Must we send this message this pass?
  */
@@ -352,10 +342,16 @@ struct mcast_packet {
 #define MCAST_PACKET_LISTED_CLR(p) ((p)->flags &= ~MCAST_PACKET_L_BIT)
 
 /**
- * \brief Free a multicast packet buffer
+ * \brief Has message p been sent by us at least once?
+ * p: pointer to a struct mcast_packet
+ */
+#define MCAST_PACKET_IS_FORWARDED(p) ((p)->flags & MCAST_PACKET_F_BIT)
+
+/**
+ * \brief Set 'Forwarded' bit for message p
  * p: pointer to a struct mcast_packet
  */
-#define MCAST_PACKET_FREE(p) ((p)->flags = 0)
+#define MCAST_PACKET_FORWARDED_SET(p) ((p)->flags |= MCAST_PACKET_F_BIT)
 /*---------------------------------------------------------------------------*/
 /* Sequence Lists in Multicast Trickle ICMP messages */
 struct sequence_list_header {
@@ -442,7 +438,16 @@ static struct roll_tm_stats stats;
 /*---------------------------------------------------------------------------*/
 static struct trickle_param t[2];
 static struct sliding_window windows[ROLL_TM_WINS];
-static struct mcast_packet buffered_msgs[ROLL_TM_BUFF_NUM];
+MEMB(buffered_msgs_memb, struct mcast_packet, ROLL_TM_BUFF_NUM);
+LIST(buffered_msgs);
+
+/* Hash indexes: windows by Seed ID and M, messages by window and seq. val */
+static struct sliding_window *window_hash[ROLL_TM_HASH_SIZE];
+static struct mcast_packet *msg_hash[ROLL_TM_HASH_SIZE];
+
+#define HASH_MASK (ROLL_TM_HASH_SIZE - 1)
+#define MSG_HASH(w, s) \
+  ((uint8_t)(((w) - windows) * 7 + (s)) & HASH_MASK)
 /*---------------------------------------------------------------------------*/
 /* Temporary Stores */
 /*---------------------------------------------------------------------------*/
@@ -471,6 +476,8 @@ extern uint16_t uip_slen;
 static void icmp_input(void);
 static void icmp_output(void);
 static void window_update_bounds(void);
+static void window_free(struct sliding_window *);
+static void buffer_free(struct mcast_packet *);
 static void reset_trickle_timer(uint8_t);
 static void handle_timer(void *);
 /*---------------------------------------------------------------------------*/
@@ -538,6 +545,9 @@ handle_timer(void *ptr)
   struct trickle_param *param;
   clock_time_t diff_last;       /* Time diff from last pass */
   clock_time_t diff_start;      /* Time diff from interval start */
+  struct mcast_packet *next;
+  uint8_t remaining;
+  uint8_t sent;
   uint8_t m;
 
   param = (struct trickle_param *)ptr;
@@ -572,11 +582,17 @@ handle_timer(void *ptr)
     ("ROLL TM: M=%u Periodic diff from last %lu, from start %lu\n", m,
      (unsigned long)diff_last, (unsigned long)diff_start);
 
-  /* Handle all buffered messages */
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(MCAST_PACKET_IS_USED(locmpptr)
-       && (SLIDING_WINDOW_GET_M(locmpptr->sw) == m)) {
+  /*
+   * Handle all buffered messages, least recently sent first. Messages we
+   * send move to the tail of the list, so we stop after the ones that were
+   * in it when we started
+   */
+  sent = 0;
+  remaining = list_length(buffered_msgs);
+  for(locmpptr = list_head(buffered_msgs); remaining > 0 && locmpptr != NULL;
+      locmpptr = next, remaining--) {
+    next = list_item_next(locmpptr);
+    if(SLIDING_WINDOW_GET_M(locmpptr->sw) == m) {
 
       /*
        * if()
@@ -614,12 +630,19 @@ handle_timer(void *ptr)
           PRINTF("\n");
           window_free(locmpptr->sw);
         }
-        MCAST_PACKET_FREE(locmpptr);
+        buffer_free(locmpptr);
       } else if(MCAST_PACKET_TTL(locmpptr) > 0) {
         /* Handle multicast transmissions */
         if(locmpptr->active < TRICKLE_ACTIVE(param) &&
            ((SUPPRESSION_ENABLED(param) && MCAST_PACKET_MUST_SEND(locmpptr)) ||
            SUPPRESSION_DISABLED(param))) {
+#if ROLL_TM_TX_BATCH
+          if(sent >= ROLL_TM_TX_BATCH) {
+            /* Leave it pending. MUST_SEND is still set if it was */
+            ROLL_TM_STATS_ADD(tx_deferred);
+            continue;
+          }
+#endif
           PRINTF("ROLL TM: M=%u Periodic - Sending packet from Seed ", m);
           PRINT_SEED(&locmpptr->sw->seed_id);
           PRINTF(" seq %u\n", locmpptr->seq_val);
@@ -627,8 +650,17 @@ handle_timer(void *ptr)
           memcpy(UIP_IP_BUF, &locmpptr->buff, uip_len);
 
           UIP_MCAST6_STATS_ADD(mcast_fwd);
+#if UIP_MCAST6_STATS
+          if(!MCAST_PACKET_IS_FORWARDED(locmpptr)) {
+            UIP_MCAST6_STATS_LATENCY(clock_time() - locmpptr->received);
+          }
+#endif
           tcpip_output(NULL);
           MCAST_PACKET_SEND_CLR(locmpptr);
+          MCAST_PACKET_FORWARDED_SET(locmpptr);
+          list_remove(buffered_msgs, locmpptr);
+          list_add(buffered_msgs, locmpptr);
+          sent++;
           watchdog_periodic();
         }
       }
@@ -639,6 +671,8 @@ handle_timer(void *ptr)
   if(SUPPRESSION_ENABLED(param)) {
     if(param->c < param->k) {
       icmp_output();
+    } else {
+      ROLL_TM_STATS_ADD(icmp_suppressed);
     }
   }
 
@@ -682,6 +716,19 @@ reset_trickle_timer(uint8_t index)
   ctimer_set(&t[index].ct, t[index].t_next, handle_timer, (void *)&t[index]);
 }
 /*---------------------------------------------------------------------------*/
+static uint8_t
+window_hash_index(const seed_id_t *s, uint8_t m)
+{
+  const uint8_t *p = (const uint8_t *)s;
+  uint8_t h = m;
+  uint8_t i;
+
+  for(i = 0; i < sizeof(seed_id_t); i++) {
+    h = (h << 1) + (h >> 7) + p[i];
+  }
+  return h & HASH_MASK;
+}
+/*---------------------------------------------------------------------------*/
 static struct sliding_window *
 window_allocate()
 {
@@ -698,11 +745,46 @@ window_allocate()
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+/* Mark window w used for seed s and parametrization m, and index it */
+static void
+window_claim(struct sliding_window *w, seed_id_t *s, uint8_t m)
+{
+  struct sliding_window **bucket;
+
+  SLIDING_WINDOW_M_CLR(w);
+  if(m) {
+    SLIDING_WINDOW_M_SET(w);
+  }
+  SLIDING_WINDOW_IS_USED_SET(w);
+  seed_id_cpy(&w->seed_id, s);
+
+  bucket = &window_hash[window_hash_index(s, m)];
+  w->next = *bucket;
+  *bucket = w;
+}
+/*---------------------------------------------------------------------------*/
+static void
+window_free(struct sliding_window *w)
+{
+  struct sliding_window **pp;
+
+  if(SLIDING_WINDOW_IS_USED(w)) {
+    pp = &window_hash[window_hash_index(&w->seed_id, SLIDING_WINDOW_GET_M(w))];
+    for(; *pp != NULL; pp = &(*pp)->next) {
+      if(*pp == w) {
+        *pp = w->next;
+        break;
+      }
+    }
+  }
+  SLIDING_WINDOW_IS_USED_CLR(w);
+}
+/*---------------------------------------------------------------------------*/
 static struct sliding_window *
 window_lookup(seed_id_t *s, uint8_t m)
 {
-  for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
-      iterswptr--) {
+  for(iterswptr = window_hash[window_hash_index(s, m)]; iterswptr != NULL;
+      iterswptr = iterswptr->next) {
     VERBOSE_PRINTF("ROLL TM: M=%u (%u) ", SLIDING_WINDOW_GET_M(iterswptr), m);
     VERBOSE_PRINT_SEED(&iterswptr->seed_id);
     VERBOSE_PRINTF("\n");
@@ -722,77 +804,93 @@ window_update_bounds()
     iterswptr->lower_bound = -1;
   }
 
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(MCAST_PACKET_IS_USED(locmpptr)) {
-      iterswptr = locmpptr->sw;
-      VERBOSE_PRINTF("ROLL TM: Update Bounds: [%d - %d] vs %u\n",
-                     iterswptr->lower_bound, iterswptr->upper_bound,
-                     locmpptr->seq_val);
-      if(iterswptr->lower_bound < 0
-         || SEQ_VAL_IS_LT(locmpptr->seq_val, iterswptr->lower_bound)) {
-        iterswptr->lower_bound = locmpptr->seq_val;
-      }
-      if(iterswptr->upper_bound < 0 ||
-         SEQ_VAL_IS_GT(locmpptr->seq_val, iterswptr->upper_bound)) {
-        iterswptr->upper_bound = locmpptr->seq_val;
-      }
+  for(locmpptr = list_head(buffered_msgs); locmpptr != NULL;
+      locmpptr = list_item_next(locmpptr)) {
+    iterswptr = locmpptr->sw;
+    VERBOSE_PRINTF("ROLL TM: Update Bounds: [%d - %d] vs %u\n",
+                   iterswptr->lower_bound, iterswptr->upper_bound,
+                   locmpptr->seq_val);
+    if(iterswptr->lower_bound < 0
+       || SEQ_VAL_IS_LT(locmpptr->seq_val, iterswptr->lower_bound)) {
+      iterswptr->lower_bound = locmpptr->seq_val;
+    }
+    if(iterswptr->upper_bound < 0 ||
+       SEQ_VAL_IS_GT(locmpptr->seq_val, iterswptr->upper_bound)) {
+      iterswptr->upper_bound = locmpptr->seq_val;
     }
   }
 }
 /*---------------------------------------------------------------------------*/
 static struct mcast_packet *
-buffer_reclaim()
+buffer_lookup(struct sliding_window *w, uint16_t seq_val)
 {
-  struct sliding_window *largest = windows;
-  struct mcast_packet *rv;
+  struct mcast_packet *p;
 
-  for(iterswptr = &windows[ROLL_TM_WINS - 1]; iterswptr >= windows;
-      iterswptr--) {
-    if(iterswptr->count > largest->count) {
-      largest = iterswptr;
+  for(p = msg_hash[MSG_HASH(w, seq_val)]; p != NULL; p = p->hash_next) {
+    if(p->sw == w && SEQ_VAL_IS_EQ(p->seq_val, seq_val)) {
+      return p;
     }
   }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+buffer_insert(struct mcast_packet *p)
+{
+  struct mcast_packet **bucket;
 
-  if(largest->count == 1) {
-    /* Can't reclaim last entry for a window and this is the largest window */
-    return NULL;
-  }
+  bucket = &msg_hash[MSG_HASH(p->sw, p->seq_val)];
+  p->hash_next = *bucket;
+  *bucket = p;
+  list_add(buffered_msgs, p);
+}
+/*---------------------------------------------------------------------------*/
+static void
+buffer_free(struct mcast_packet *p)
+{
+  struct mcast_packet **pp;
 
-  PRINTF("ROLL TM: Reclaim from Seed ");
-  PRINT_SEED(&largest->seed_id);
-  PRINTF(" M=%u, count was %u\n",
-         SLIDING_WINDOW_GET_M(largest), largest->count);
-  /* Find the packet at the lowest bound for the largest window */
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(MCAST_PACKET_IS_USED(locmpptr) && (locmpptr->sw == largest) &&
-       SEQ_VAL_IS_EQ(locmpptr->seq_val, largest->lower_bound)) {
-      rv = locmpptr;
-      PRINTF("ROLL TM: Reclaim seq. val %u\n", locmpptr->seq_val);
-      MCAST_PACKET_FREE(rv);
-      largest->count--;
+  for(pp = &msg_hash[MSG_HASH(p->sw, p->seq_val)]; *pp != NULL;
+      pp = &(*pp)->hash_next) {
+    if(*pp == p) {
+      *pp = p->hash_next;
+      break;
+    }
+  }
+  list_remove(buffered_msgs, p);
+  memb_free(&buffered_msgs_memb, p);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Evict the least recently sent message whose window keeps at least one
+ * other message. We never reclaim the last entry of a window
+ */
+static struct mcast_packet *
+buffer_reclaim()
+{
+  for(locmpptr = list_head(buffered_msgs); locmpptr != NULL;
+      locmpptr = list_item_next(locmpptr)) {
+    if(locmpptr->sw->count > 1) {
+      PRINTF("ROLL TM: Reclaim from Seed ");
+      PRINT_SEED(&locmpptr->sw->seed_id);
+      PRINTF(" M=%u, seq. val %u, count was %u\n",
+             SLIDING_WINDOW_GET_M(locmpptr->sw), locmpptr->seq_val,
+             locmpptr->sw->count);
+      locmpptr->sw->count--;
+      buffer_free(locmpptr);
       window_update_bounds();
-      VERBOSE_PRINTF("ROLL TM: Reclaim - new bounds [%u , %u]\n",
-                     largest->lower_bound, largest->upper_bound);
-      return rv;
+      ROLL_TM_STATS_ADD(reclaimed);
+      return memb_alloc(&buffered_msgs_memb);
     }
   }
 
-  /* oops */
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
 static struct mcast_packet *
 buffer_allocate()
 {
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(!MCAST_PACKET_IS_USED(locmpptr)) {
-      return locmpptr;
-    }
-  }
-  return NULL;
+  return memb_alloc(&buffered_msgs_memb);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -832,10 +930,9 @@ icmp_output()
 
       buffer = (uint8_t *)sl + sizeof(struct sequence_list_header);
 
-      for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-          locmpptr >= buffered_msgs; locmpptr--) {
-        if(MCAST_PACKET_IS_USED(locmpptr) &&
-           locmpptr->active < TRICKLE_ACTIVE((&t[SLIDING_WINDOW_GET_M(iterswptr)]))) {
+      for(locmpptr = list_head(buffered_msgs); locmpptr != NULL;
+          locmpptr = list_item_next(locmpptr)) {
+        if(locmpptr->active < TRICKLE_ACTIVE((&t[SLIDING_WINDOW_GET_M(iterswptr)]))) {
           if(locmpptr->sw == iterswptr) {
             sl->seq_len++;
             PRINTF(", %u", locmpptr->seq_val);
@@ -895,6 +992,7 @@ accept(uint8_t in)
 {
   seed_id_t *seed_ptr;
   uint8_t m;
+  uint8_t new_window;
   uint16_t seq_val;
 
   PRINTF("ROLL TM: Multicast I/O\n");
@@ -978,17 +1076,12 @@ accept(uint8_t in)
       UIP_MCAST6_STATS_ADD(mcast_dropped);
       return UIP_MCAST6_DROP;
     }
-    for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-        locmpptr >= buffered_msgs; locmpptr--) {
-      if(MCAST_PACKET_IS_USED(locmpptr) &&
-         locmpptr->sw == locswptr &&
-         SLIDING_WINDOW_GET_M(locmpptr->sw) == m &&
-         SEQ_VAL_IS_EQ(seq_val, locmpptr->seq_val)) {
-        /* Seen before , drop */
-        PRINTF("ROLL TM: Seen before\n");
-        UIP_MCAST6_STATS_ADD(mcast_dropped);
-        return UIP_MCAST6_DROP;
-      }
+    if(buffer_lookup(locswptr, seq_val) != NULL) {
+      /* Seen before , drop */
+      PRINTF("ROLL TM: Seen before\n");
+      UIP_MCAST6_STATS_ADD(mcast_dup);
+      UIP_MCAST6_STATS_ADD(mcast_dropped);
+      return UIP_MCAST6_DROP;
     }
   }
 
@@ -996,8 +1089,10 @@ accept(uint8_t in)
 
   /* We have not seen this message before */
   /* Allocate a window if we have to */
+  new_window = 0;
   if(!locswptr) {
     locswptr = window_allocate();
+    new_window = 1;
     PRINTF("ROLL TM: New seed\n");
   }
   if(!locswptr) {
@@ -1018,11 +1113,8 @@ accept(uint8_t in)
     /* Failed to allocate / reclaim a buffer. If the window has only just been
      * allocated, free it before dropping */
     PRINTF("ROLL TM: Buffer reclaim failed\n");
-    if(locswptr->count == 0) {
-      window_free(locswptr);
-      UIP_MCAST6_STATS_ADD(mcast_dropped);
-      return UIP_MCAST6_DROP;
-    }
+    UIP_MCAST6_STATS_ADD(mcast_dropped);
+    return UIP_MCAST6_DROP;
   }
 #if UIP_MCAST6_STATS
   if(in == ROLL_TM_DGRAM_IN) {
@@ -1031,13 +1123,10 @@ accept(uint8_t in)
 #endif
 
   /* We have a window and we have a buffer. Accept this message */
-  /* Set the seed ID and correct M for this window */
-  SLIDING_WINDOW_M_CLR(locswptr);
-  if(m) {
-    SLIDING_WINDOW_M_SET(locswptr);
+  /* Set the seed ID and correct M for a new window */
+  if(new_window) {
+    window_claim(locswptr, seed_ptr, m);
   }
-  SLIDING_WINDOW_IS_USED_SET(locswptr);
-  seed_id_cpy(&locswptr->seed_id, seed_ptr);
   PRINTF("ROLL TM: Window for seed ");
   PRINT_SEED(&locswptr->seed_id);
   PRINTF(" M=%u, count=%u\n",
@@ -1062,7 +1151,10 @@ accept(uint8_t in)
   locmpptr->sw = locswptr;
   locmpptr->buff_len = uip_len;
   locmpptr->seq_val = seq_val;
-  MCAST_PACKET_USED_SET(locmpptr);
+#if UIP_MCAST6_STATS
+  locmpptr->received = clock_time();
+#endif
+  buffer_insert(locmpptr);
 
   PRINTF("ROLL TM: Window for seed ");
   PRINT_SEED(&locswptr->seed_id);
@@ -1084,6 +1176,8 @@ accept(uint8_t in)
 
     PRINTF("ROLL TM: Inconsistency. Reset T%u\n", m);
     reset_trickle_timer(m);
+  } else {
+    MCAST_PACKET_FORWARDED_SET(locmpptr);
   }
 
   /* Deliver if necessary */
@@ -1143,8 +1237,8 @@ icmp_input()
   }
 
   /* Reset Is-Listed bit for all cached packets */
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
+  for(locmpptr = list_head(buffered_msgs); locmpptr != NULL;
+      locmpptr = list_item_next(locmpptr)) {
     MCAST_PACKET_LISTED_CLR(locmpptr);
   }
 
@@ -1222,23 +1316,17 @@ icmp_input()
 
           inconsistency = 1;
           /* Check if the advertised sequence is in our buffer */
-          for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-              locmpptr >= buffered_msgs; locmpptr--) {
-            if(MCAST_PACKET_IS_USED(locmpptr) && locmpptr->sw == locswptr) {
-              if(SEQ_VAL_IS_EQ(locmpptr->seq_val, val)) {
-
-                inconsistency = 0;
-                MCAST_PACKET_LISTED_SET(locmpptr);
-                PRINTF("ROLL TM: ICMPv6 In, %u listed\n", locmpptr->seq_val);
-
-                /* Update lowest seq. num listed for this window
-                 * We need this to check for "we have new" */
-                if(locswptr->min_listed == -1 ||
-                   SEQ_VAL_IS_LT(val, locswptr->min_listed)) {
-                  locswptr->min_listed = val;
-                }
-                break;
-              }
+          locmpptr = buffer_lookup(locswptr, val);
+          if(locmpptr != NULL) {
+            inconsistency = 0;
+            MCAST_PACKET_LISTED_SET(locmpptr);
+            PRINTF("ROLL TM: ICMPv6 In, %u listed\n", locmpptr->seq_val);
+
+            /* Update lowest seq. num listed for this window
+             * We need this to check for "we have new" */
+            if(locswptr->min_listed == -1 ||
+               SEQ_VAL_IS_LT(val, locswptr->min_listed)) {
+              locswptr->min_listed = val;
             }
           }
           if(inconsistency) {
@@ -1265,35 +1353,33 @@ icmp_input()
 
   /* Check for "We have new */
   PRINTF("ROLL TM: ICMPv6 In, Check our buffer\n");
-  for(locmpptr = &buffered_msgs[ROLL_TM_BUFF_NUM - 1];
-      locmpptr >= buffered_msgs; locmpptr--) {
-    if(MCAST_PACKET_IS_USED(locmpptr)) {
-      locswptr = locmpptr->sw;
-      PRINTF("ROLL TM: ICMPv6 In, ");
-      PRINTF("Check %u, Seed L: %u, This L: %u Min L: %d\n",
-             locmpptr->seq_val, SLIDING_WINDOW_IS_LISTED(locswptr),
-             MCAST_PACKET_IS_LISTED(locmpptr), locswptr->min_listed);
-
-      /* Point to the sliding window's trickle param */
-      loctpptr = &t[SLIDING_WINDOW_GET_M(locswptr)];
-      if(!SLIDING_WINDOW_IS_LISTED(locswptr)) {
-        /* If a buffered packet's Seed ID was not listed */
-        PRINTF("ROLL TM: Inconsistency - Seed ID ");
-        PRINT_SEED(&locswptr->seed_id);
-        PRINTF(" was not listed\n");
+  for(locmpptr = list_head(buffered_msgs); locmpptr != NULL;
+      locmpptr = list_item_next(locmpptr)) {
+    locswptr = locmpptr->sw;
+    PRINTF("ROLL TM: ICMPv6 In, ");
+    PRINTF("Check %u, Seed L: %u, This L: %u Min L: %d\n",
+           locmpptr->seq_val, SLIDING_WINDOW_IS_LISTED(locswptr),
+           MCAST_PACKET_IS_LISTED(locmpptr), locswptr->min_listed);
+
+    /* Point to the sliding window's trickle param */
+    loctpptr = &t[SLIDING_WINDOW_GET_M(locswptr)];
+    if(!SLIDING_WINDOW_IS_LISTED(locswptr)) {
+      /* If a buffered packet's Seed ID was not listed */
+      PRINTF("ROLL TM: Inconsistency - Seed ID ");
+      PRINT_SEED(&locswptr->seed_id);
+      PRINTF(" was not listed\n");
+      loctpptr->inconsistency = 1;
+      MCAST_PACKET_SEND_SET(locmpptr);
+    } else {
+      /* This packet was not listed but a prior one was */
+      if(!MCAST_PACKET_IS_LISTED(locmpptr) &&
+         (locswptr->min_listed >= 0) &&
+         SEQ_VAL_IS_GT(locmpptr->seq_val, locswptr->min_listed)) {
+        PRINTF("ROLL TM: Inconsistency - ");
+        PRINTF("Seq. %u was not listed but %u was\n",
+               locmpptr->seq_val, locswptr->min_listed);
         loctpptr->inconsistency = 1;
         MCAST_PACKET_SEND_SET(locmpptr);
-      } else {
-        /* This packet was not listed but a prior one was */
-        if(!MCAST_PACKET_IS_LISTED(locmpptr) &&
-           (locswptr->min_listed >= 0) &&
-           SEQ_VAL_IS_GT(locmpptr->seq_val, locswptr->min_listed)) {
-          PRINTF("ROLL TM: Inconsistency - ");
-          PRINTF("Seq. %u was not listed but %u was\n",
-                 locmpptr->seq_val, locswptr->min_listed);
-          loctpptr->inconsistency = 1;
-          MCAST_PACKET_SEND_SET(locmpptr);
-        }
       }
     }
   }
@@ -1415,7 +1501,10 @@ init()
   PRINTF("ROLL TM: ROLL Multicast - Draft #%u\n", ROLL_TM_VER);
 
   memset(windows, 0, sizeof(windows));
-  memset(buffered_msgs, 0, sizeof(buffered_msgs));
+  memset(window_hash, 0, sizeof(window_hash));
+  memset(msg_hash, 0, sizeof(msg_hash));
+  memb_init(&buffered_msgs_memb);
+  list_init(buffered_msgs);
   memset(t, 0, sizeof(t));
 
   ROLL_TM_STATS_INIT();
@@ -187,6 +187,29 @@
 #define ROLL_TM_BUFF_NUM 6
 #endif
 /*---------------------------------------------------------------------------*/
+/**
+ * Number of hash buckets used to find a sliding window by Seed ID and a
+ * buffered message by sequence value, instead of scanning all of them for
+ * every multicast datagram and every ICMP sequence list entry.
+ * Must be a power of two
+ */
+#ifdef ROLL_TM_CONF_HASH_SIZE
+#define ROLL_TM_HASH_SIZE ROLL_TM_CONF_HASH_SIZE
+#else
+#define ROLL_TM_HASH_SIZE 8
+#endif
+/*---------------------------------------------------------------------------*/
+/**
+ * Maximum number of buffered messages transmitted per trickle timer firing.
+ * Messages that exceed the batch stay pending and go out at the next firing,
+ * least recently sent first. 0 transmits everything pending at once
+ */
+#ifdef ROLL_TM_CONF_TX_BATCH
+#define ROLL_TM_TX_BATCH ROLL_TM_CONF_TX_BATCH
+#else
+#define ROLL_TM_TX_BATCH 0
+#endif
+/*---------------------------------------------------------------------------*/
 /**
  * Use Short Seed IDs [short: 2, long: 16 (default)]
  * It can be argued that we should (and it would be easy to) support both at
@@ -236,6 +259,15 @@ struct roll_tm_stats {
 
   /** Number of malformed ICMP datagrams seen by us */
   UIP_MCAST6_STATS_DATATYPE icmp_bad;
+
+  /** Number of ICMP datagrams suppressed because k consistent ones were heard */
+  UIP_MCAST6_STATS_DATATYPE icmp_suppressed;
+
+  /** Number of buffered messages evicted to make room for new ones */
+  UIP_MCAST6_STATS_DATATYPE reclaimed;
+
+  /** Number of pending transmissions deferred by the batch limit */
+  UIP_MCAST6_STATS_DATATYPE tx_deferred;
 };
 /*---------------------------------------------------------------------------*/
 #endif /* ROLL_TM_H_ */
@@ -51,4 +51,14 @@ uip_mcast6_stats_init(void *stats)
   uip_mcast6_stats.engine_stats = stats;
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_mcast6_stats_latency(clock_time_t latency)
+{
+  uip_mcast6_stats.fwd_latency_samples++;
+  uip_mcast6_stats.fwd_latency_sum += latency;
+  if(latency > uip_mcast6_stats.fwd_latency_max) {
+    uip_mcast6_stats.fwd_latency_max = latency;
+  }
+}
+/*---------------------------------------------------------------------------*/
 /** @} */
@@ -42,6 +42,7 @@
 #define UIP_MCAST6_STATS_H_
 /*---------------------------------------------------------------------------*/
 #include "contiki-conf.h"
+#include "sys/clock.h"
 
 #include <stdint.h>
 /*---------------------------------------------------------------------------*/
@@ -87,6 +88,18 @@ typedef struct uip_mcast6_stats {
   /** Count of multicast datagrams correclty formed but dropped by us */
   UIP_MCAST6_STATS_DATATYPE mcast_dropped;
 
+  /** Count of datagrams dropped because we had already seen them */
+  UIP_MCAST6_STATS_DATATYPE mcast_dup;
+
+  /** Count of forwarded datagrams whose forwarding latency was sampled */
+  UIP_MCAST6_STATS_DATATYPE fwd_latency_samples;
+
+  /** Sum of sampled forwarding latencies, in clock ticks */
+  uint32_t fwd_latency_sum;
+
+  /** Largest sampled forwarding latency, in clock ticks */
+  clock_time_t fwd_latency_max;
+
   /** Opaque pointer to an engine's additional stats */
   void *engine_stats;
 } uip_mcast6_stats_t;
@@ -100,10 +113,12 @@ extern uip_mcast6_stats_t uip_mcast6_stats;
 #define UIP_MCAST6_STATS_ADD(x) uip_mcast6_stats.x++
 #define UIP_MCAST6_STATS_GET(x) uip_mcast6_stats.x
 #define UIP_MCAST6_STATS_INIT(s) uip_mcast6_stats_init(s)
+#define UIP_MCAST6_STATS_LATENCY(l) uip_mcast6_stats_latency(l)
 #else /* UIP_MCAST6_STATS */
 #define UIP_MCAST6_STATS_ADD(x)
 #define UIP_MCAST6_STATS_GET(x) 0
 #define UIP_MCAST6_STATS_INIT(s)
+#define UIP_MCAST6_STATS_LATENCY(l)
 #endif /* UIP_MCAST6_STATS */
 /*---------------------------------------------------------------------------*/
 /**
@@ -111,6 +126,12 @@ extern uip_mcast6_stats_t uip_mcast6_stats;
  * \param stats A pointer to a struct holding an engine's additional statistics
  */
 void uip_mcast6_stats_init(void *stats);
+
+/**
+ * \brief Record how long a datagram was held before we forwarded it
+ * \param latency The time from reception to forwarding, in clock ticks
+ */
+void uip_mcast6_stats_latency(clock_time_t latency);
 /*---------------------------------------------------------------------------*/
 #endif /* UIP_MCAST6_STATS_H_ */
 /*---------------------------------------------------------------------------*/
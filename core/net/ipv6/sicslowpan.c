@@ -65,6 +65,7 @@
 #include "net/ip/tcpip.h"
 #include "net/ip/uip.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
 #include "net/netstack.h"
@@ -229,7 +230,14 @@ static uint16_t sicslowpan_len;
  * It has a fix size as we do not use dynamic memory allocation.
  */
 static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+
+/**
+ * The buffer the current inbound packet is uncompressed into. Packets
+ * that are not fragmented are uncompressed in place into uip_buf, so
+ * they are copied only once from the packetbuf. Only fragments are
+ * staged in the reassembly buffer.
+ */
+static uint8_t *sicslowpan_buf = sicslowpan_aligned_buf.u8;
 
 /** The total length of the IPv6 packet in the sicslowpan_buf. */
 
@@ -251,6 +259,13 @@ linkaddr_t frag_sender;
 /** Reassembly %process %timer. */
 static struct timer reass_timer;
 
+/**
+ * Packet attributes of the fragments being sent. They are restored in
+ * the packetbuf between fragments, so that the fragment payload does
+ * not have to be saved and restored through a queuebuf.
+ */
+static uint16_t frag_attrs[(PACKETBUF_ATTR_PACKED_MAX + 1) / 2];
+
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
 /** The buffer used for the 6lowpan processing is uip_buf.
@@ -307,6 +322,68 @@ set_packet_attrs()
 /*   } */
 
 }
+#if PACKETBUF_WITH_PRIORITY
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the upper-layer header of the packet in uip_buf, past
+ * any hop-by-hop, destination options and routing headers, the way
+ * uip_process() walks them on input.
+ * \param offset Set to the offset of the header from the IPv6 header
+ * \return The upper-layer protocol, or UIP_PROTO_NONE if the header
+ * chain runs past the end of the packet
+ */
+static uint8_t
+upper_layer_proto(uint16_t *offset)
+{
+  struct uip_ext_hdr *ext;
+  uint8_t proto = UIP_IP_BUF->proto;
+  uint16_t off = UIP_IPH_LEN;
+
+  while(proto == UIP_PROTO_HBHO || proto == UIP_PROTO_DESTO ||
+        proto == UIP_PROTO_ROUTING) {
+    if(off + sizeof(struct uip_ext_hdr) > uip_len) {
+      return UIP_PROTO_NONE;
+    }
+    ext = (struct uip_ext_hdr *)&uip_buf[UIP_LLH_LEN + off];
+    proto = ext->next;
+    off += (ext->len << 3) + 8;
+  }
+  *offset = off;
+  return proto;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Let the MAC layer schedule routing and neighbor discovery
+ * traffic, and TCP segments that carry no data, ahead of bulk data
+ */
+static void
+set_packet_priority(void)
+{
+  struct uip_icmp_hdr *icmp;
+  struct uip_tcp_hdr *tcp;
+  uint16_t off;
+
+  switch(upper_layer_proto(&off)) {
+  case UIP_PROTO_ICMP6:
+    icmp = (struct uip_icmp_hdr *)&uip_buf[UIP_LLH_LEN + off];
+    if(off + UIP_ICMPH_LEN <= uip_len &&
+       ((icmp->type >= ICMP6_RS && icmp->type <= ICMP6_REDIRECT) ||
+        icmp->type == ICMP6_RPL)) {
+      packetbuf_set_attr(PACKETBUF_ATTR_PRIORITY,
+                         PACKETBUF_ATTR_PRIORITY_CONTROL);
+    }
+    break;
+  case UIP_PROTO_TCP:
+    tcp = (struct uip_tcp_hdr *)&uip_buf[UIP_LLH_LEN + off];
+    if(off + UIP_TCPH_LEN <= uip_len &&
+       uip_len <= off + ((tcp->tcpoffset >> 4) << 2)) {
+      packetbuf_set_attr(PACKETBUF_ATTR_PRIORITY,
+                         PACKETBUF_ATTR_PRIORITY_ACK);
+    }
+    break;
+  }
+}
+#endif /* PACKETBUF_WITH_PRIORITY */
 
 
 
@@ -1400,6 +1477,10 @@ output(const uip_lladdr_t *localdest)
   }
 #endif
 
+#if PACKETBUF_WITH_PRIORITY
+  set_packet_priority();
+#endif /* PACKETBUF_WITH_PRIORITY */
+
   /*
    * The destination address will be tagged to each outbound
    * packet. If the argument localdest is NULL, we are sending a
@@ -1447,7 +1528,7 @@ output(const uip_lladdr_t *localdest)
 
   if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
-    struct queuebuf *q;
+    uint16_t frag_tag;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
@@ -1456,7 +1537,7 @@ output(const uip_lladdr_t *localdest)
      * The following fragments contain only the fragn dispatch.
      */
     int estimated_fragments = ((int)uip_len) / ((int)MAC_MAX_PAYLOAD - SICSLOWPAN_FRAGN_HDR_LEN) + 1;
-    int freebuf = queuebuf_numfree() - 1;
+    int freebuf = queuebuf_numfree();
     PRINTFO("uip_len: %d, fragments: %d, free bufs: %d\n", uip_len, estimated_fragments, freebuf);
     if(freebuf < estimated_fragments) {
       PRINTFO("Dropping packet, not enough free bufs\n");
@@ -1480,8 +1561,8 @@ output(const uip_lladdr_t *localdest)
     SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
           ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
 /*     PACKETBUF_FRAG_BUF->tag = uip_htons(my_tag); */
-    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, my_tag);
-    my_tag++;
+    frag_tag = my_tag++;
+    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, frag_tag);
 
     /* Copy payload and send */
     packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
@@ -1490,15 +1571,12 @@ output(const uip_lladdr_t *localdest)
     memcpy(packetbuf_ptr + packetbuf_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, packetbuf_payload_len);
     packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
-      PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
+    if(queuebuf_numfree() == 0) {
+      PRINTFO("no queuebuf available for first fragment, dropping packet\n");
       return 0;
     }
+    packetbuf_attr_pack((uint8_t *)frag_attrs);
     send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
 
     /* Check tx result. */
     if((last_tx_status == MAC_TX_COLLISION) ||
@@ -1513,17 +1591,22 @@ output(const uip_lladdr_t *localdest)
     
     /*
      * Create following fragments
-     * Datagram tag is already in the buffer, we need to set the
-     * FRAGN dispatch and for each fragment, the offset
+     * The MAC may have modified the packetbuf, so we start each
+     * fragment from a cleared packetbuf with the saved attributes, and
+     * set the FRAGN dispatch, the datagram tag and the offset
      */
     packetbuf_hdr_len = SICSLOWPAN_FRAGN_HDR_LEN;
-/*     PACKETBUF_FRAG_BUF->dispatch_size = */
-/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
-    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
-          ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
     packetbuf_payload_len = (max_payload - packetbuf_hdr_len) & 0xfffffff8;
     while(processed_ip_out_len < uip_len) {
       PRINTFO("sicslowpan output: fragment ");
+      packetbuf_clear();
+      packetbuf_attr_unpack((uint8_t *)frag_attrs);
+      packetbuf_ptr = packetbuf_dataptr();
+/*       PACKETBUF_FRAG_BUF->dispatch_size = */
+/*         uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+            ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, frag_tag);
       PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] = processed_ip_out_len >> 3;
       
       /* Copy payload and send */
@@ -1536,15 +1619,11 @@ output(const uip_lladdr_t *localdest)
       memcpy(packetbuf_ptr + packetbuf_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, packetbuf_payload_len);
       packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
+      if(queuebuf_numfree() == 0) {
+        PRINTFO("no queuebuf available, dropping fragment\n");
         return 0;
       }
       send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
       processed_ip_out_len += packetbuf_payload_len;
 
       /* Check tx result. */
@@ -1720,6 +1799,10 @@ input(void)
     }
   }
 
+  /* Fragments are reassembled in sicslowpan_aligned_buf, while
+     unfragmented packets go straight to uip_buf. */
+  sicslowpan_buf = is_fragment ? sicslowpan_aligned_buf.u8 : uip_buf;
+
   if(packetbuf_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
     /* this is a FRAGN, skip the header compression dispatch section */
     goto copypayload;
@@ -1779,11 +1862,11 @@ input(void)
   {
     int req_size = UIP_LLH_LEN + uncomp_hdr_len + (uint16_t)(frag_offset << 3)
         + packetbuf_payload_len;
-    if(req_size > sizeof(sicslowpan_buf)) {
+    if(req_size > UIP_BUFSIZE) {
       PRINTF(
           "SICSLOWPAN: packet dropped, minimum required SICSLOWPAN_IP_BUF size: %d+%d+%d+%d=%d (current size: %d)\n",
           UIP_LLH_LEN, uncomp_hdr_len, (uint16_t)(frag_offset << 3),
-          packetbuf_payload_len, req_size, sizeof(sicslowpan_buf));
+          packetbuf_payload_len, req_size, UIP_BUFSIZE);
       return;
     }
   }
@@ -1822,7 +1905,10 @@ input(void)
   if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
     PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
            sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
+    if(is_fragment) {
+      /* Unfragmented packets have already been uncompressed in uip_buf */
+      memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
+    }
     uip_len = sicslowpan_len;
     sicslowpan_len = 0;
     processed_ip_in_len = 0;
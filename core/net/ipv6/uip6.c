@@ -74,6 +74,7 @@
 #include "sys/cc.h"
 #include "net/ip/uip.h"
 #include "net/ip/uipopt.h"
+#include "net/ip/uip-chksum.h"
 #include "net/ipv6/uip-icmp6.h"
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-ds6.h"
@@ -258,6 +259,16 @@ static uint8_t iss[4];
 uint8_t uip_acc32[4];
 static uint8_t opt;
 static uint16_t tmp16;
+
+#if UIP_TCP_SEND_WINDOW > 1
+/* The number of bytes acknowledged by the incoming segment. */
+uint16_t uip_ackedlen;
+/* The offset from snd_nxt of the data segment about to be sent. */
+static uint16_t snd_off;
+/* The number of duplicate ACKs that triggers a fast retransmit. */
+#define TCP_DUPACK_THRESHOLD 3
+#define TCP_WINDOWED(conn) ((conn)->snd_segs > 1)
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 #endif /* UIP_TCP */
 /** @} */
 
@@ -273,6 +284,48 @@ struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
 #endif /* UIP_UDP */
 /** @} */
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \name Connection hash index
+ * @{
+ */
+/*---------------------------------------------------------------------------*/
+#if UIP_CONN_HASH_SIZE && (UIP_TCP || UIP_UDP)
+/*
+ * Chained hash tables over the connection arrays, linked by array
+ * index. TCP connections are hashed on their port pair and remote
+ * address, UDP connections on their local port only, as they may be
+ * bound to any remote endpoint.
+ *
+ * Every active connection is kept in the chain it hashes to. Closing
+ * a connection does not touch the index: lookups verify each entry
+ * and unlink the ones that have gone stale, and a connection is
+ * relinked whenever a slot is reused.
+ */
+#define HASH_NONE 0xffff
+
+struct conn_index {
+  uint16_t head[UIP_CONN_HASH_SIZE];
+  uint16_t *next;
+  uint16_t *bucket;
+  uint16_t len;
+};
+
+#if UIP_TCP
+static uint16_t tcp_index_next[UIP_CONNS];
+static uint16_t tcp_index_bucket[UIP_CONNS];
+static struct conn_index tcp_index =
+  { { 0 }, tcp_index_next, tcp_index_bucket, UIP_CONNS };
+#endif /* UIP_TCP */
+#if UIP_UDP
+static uint16_t udp_index_next[UIP_UDP_CONNS];
+static uint16_t udp_index_bucket[UIP_UDP_CONNS];
+static struct conn_index udp_index =
+  { { 0 }, udp_index_next, udp_index_bucket, UIP_UDP_CONNS };
+#endif /* UIP_UDP */
+#endif /* UIP_CONN_HASH_SIZE && (UIP_TCP || UIP_UDP) */
+/** @} */
+
 /*---------------------------------------------------------------------------*/
 /**
  * \name ICMPv6 variables
@@ -318,43 +371,193 @@ uip_add32(uint8_t *op32, uint16_t op16)
 
 #endif /* UIP_ARCH_ADD32 && UIP_TCP */
 
-#if ! UIP_ARCH_CHKSUM
+#if UIP_CONN_HASH_SIZE && (UIP_TCP || UIP_UDP)
 /*---------------------------------------------------------------------------*/
 static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+conn_hash(uint16_t lport, uint16_t rport, const uip_ipaddr_t *ripaddr)
 {
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
+  uint16_t h;
 
-  dataptr = data;
-  last_byte = data + len - 1;
-  
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
+  h = lport ^ (uint16_t)((rport << 5) | (rport >> 11));
+  if(ripaddr != NULL) {
+    h ^= ripaddr->u16[6] ^ ripaddr->u16[7];
+  }
+  h ^= h >> 8;
+  return h & (UIP_CONN_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_init(struct conn_index *index)
+{
+  uint16_t i;
+
+  for(i = 0; i < UIP_CONN_HASH_SIZE; i++) {
+    index->head[i] = HASH_NONE;
+  }
+  for(i = 0; i < index->len; i++) {
+    index->next[i] = HASH_NONE;
+    index->bucket[i] = HASH_NONE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_unlink(struct conn_index *index, uint16_t i)
+{
+  uint16_t *p;
+
+  if(index->bucket[i] == HASH_NONE) {
+    return;
+  }
+  for(p = &index->head[index->bucket[i]]; *p != HASH_NONE;
+      p = &index->next[*p]) {
+    if(*p == i) {
+      *p = index->next[i];
+      break;
     }
-    dataptr += 2;
   }
-  
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
+  index->next[i] = HASH_NONE;
+  index->bucket[i] = HASH_NONE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_link(struct conn_index *index, uint16_t i, uint16_t bucket)
+{
+  if(index->bucket[i] == bucket) {
+    return;
+  }
+  index_unlink(index, i);
+  index->next[i] = index->head[bucket];
+  index->head[bucket] = i;
+  index->bucket[i] = bucket;
+}
+#if UIP_TCP
+/*---------------------------------------------------------------------------*/
+/* Find the connection that the TCP segment in uip_buf belongs to. */
+static struct uip_conn *
+tcp_index_lookup(void)
+{
+  struct uip_conn *conn, *found;
+  uint16_t i, next;
+
+  found = NULL;
+  for(i = tcp_index.head[conn_hash(UIP_TCP_BUF->destport,
+                                   UIP_TCP_BUF->srcport,
+                                   &UIP_IP_BUF->srcipaddr)];
+      i != HASH_NONE; i = next) {
+    next = tcp_index.next[i];
+    conn = &uip_conns[i];
+    if(conn->tcpstateflags == UIP_CLOSED) {
+      index_unlink(&tcp_index, i);
+    } else if(UIP_TCP_BUF->destport == conn->lport &&
+              UIP_TCP_BUF->srcport == conn->rport &&
+              uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &conn->ripaddr) &&
+              (found == NULL || conn < found)) {
+      /* Prefer the lowest slot, as the linear scan would. */
+      found = conn;
+    }
+  }
+  return found;
+}
+#endif /* UIP_TCP */
+#if UIP_UDP
+/*---------------------------------------------------------------------------*/
+/* Find the connection that the UDP datagram in uip_buf is for. */
+static struct uip_udp_conn *
+udp_index_lookup(void)
+{
+  struct uip_udp_conn *conn, *found;
+  uint16_t i, next, bucket;
+
+  found = NULL;
+  bucket = conn_hash(UIP_UDP_BUF->destport, 0, NULL);
+  for(i = udp_index.head[bucket]; i != HASH_NONE; i = next) {
+    next = udp_index.next[i];
+    conn = &uip_udp_conns[i];
+    if(conn->lport == 0 || conn_hash(conn->lport, 0, NULL) != bucket) {
+      /* Removed or rebound without uip_udp_bind(). */
+      index_unlink(&udp_index, i);
+    } else if(UIP_UDP_BUF->destport == conn->lport &&
+              (conn->rport == 0 ||
+               UIP_UDP_BUF->srcport == conn->rport) &&
+              (uip_is_addr_unspecified(&conn->ripaddr) ||
+               uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &conn->ripaddr)) &&
+              (found == NULL || conn < found)) {
+      found = conn;
     }
   }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static int
+udp_port_used(uint16_t port)
+{
+  uint16_t i;
 
-  /* Return sum in host byte order. */
-  return sum;
+  for(i = udp_index.head[conn_hash(port, 0, NULL)]; i != HASH_NONE;
+      i = udp_index.next[i]) {
+    if(uip_udp_conns[i].lport == port) {
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* UIP_UDP */
+#endif /* UIP_CONN_HASH_SIZE && (UIP_TCP || UIP_UDP) */
+
+#if UIP_TCP && UIP_TCP_SEND_WINDOW > 1
+/*---------------------------------------------------------------------------*/
+/* The distance from sequence number b to sequence number a. */
+static uint32_t
+seq_diff(const uint8_t *a, const uint8_t *b)
+{
+  return (((uint32_t)a[0] << 24) | ((uint32_t)a[1] << 16) |
+          ((uint32_t)a[2] << 8) | a[3]) -
+    (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+     ((uint32_t)b[2] << 8) | b[3]);
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
+uip_tcp_send_room(struct uip_conn *conn)
+{
+  uint32_t limit;
+
+  if(!TCP_WINDOWED(conn)) {
+    return conn->len == 0 ? conn->mss : 0;
+  }
+
+  limit = (uint32_t)conn->mss * conn->snd_segs;
+  if(conn->snd_wnd < limit) {
+    limit = conn->snd_wnd;
+  }
+  if(limit == 0 && conn->len == 0) {
+    /* Zero window: let a single segment through as a window probe. */
+    limit = conn->mss;
+  }
+  if(limit <= conn->len) {
+    return 0;
+  }
+  limit -= conn->len;
+  return limit > conn->mss ? conn->mss : (uint16_t)limit;
+}
+/*---------------------------------------------------------------------------*/
+/* Collapse the window to its first segment before a retransmission. */
+static void
+window_rexmit(struct uip_conn *conn)
+{
+  if(conn->len > conn->mss) {
+    conn->len = conn->mss;
+  }
+  conn->rtt_len = 0;
+  conn->dupacks = 0;
+}
+#endif /* UIP_TCP && UIP_TCP_SEND_WINDOW > 1 */
+
+#if ! UIP_ARCH_CHKSUM
+/*---------------------------------------------------------------------------*/
+uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
 {
-  return uip_htons(chksum(0, (uint8_t *)data, len));
+  return uip_htons(uip_chksum_sum(0, (uint8_t *)data, len));
 }
 /*---------------------------------------------------------------------------*/
 #ifndef UIP_ARCH_IPCHKSUM
@@ -363,7 +566,7 @@ uip_ipchksum(void)
 {
   uint16_t sum;
 
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  sum = uip_chksum_sum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
   PRINTF("uip_ipchksum: sum 0x%04x\n", sum);
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -393,10 +596,10 @@ upper_layer_chksum(uint8_t proto)
   /* IP protocol and length fields. This addition cannot carry. */
   sum = upper_layer_len + proto;
   /* Sum IP source and destination addresses. */
-  sum = chksum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+  sum = uip_chksum_sum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
 
   /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
+  sum = uip_chksum_sum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
                upper_layer_len);
     
   return (sum == 0) ? 0xffff : uip_htons(sum);
@@ -441,6 +644,9 @@ uip_init(void)
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
   }
+#if UIP_CONN_HASH_SIZE
+  index_init(&tcp_index);
+#endif /* UIP_CONN_HASH_SIZE */
 #endif /* UIP_TCP */
 
 #if UIP_ACTIVE_OPEN || UIP_UDP
@@ -451,6 +657,9 @@ uip_init(void)
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
     uip_udp_conns[c].lport = 0;
   }
+#if UIP_CONN_HASH_SIZE
+  index_init(&udp_index);
+#endif /* UIP_CONN_HASH_SIZE */
 #endif /* UIP_UDP */
 
 #if UIP_CONF_IPV6_MULTICAST
@@ -521,9 +730,20 @@ uip_connect(const uip_ipaddr_t *ripaddr, uint16_t rport)
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
+#if UIP_TCP_SEND_WINDOW > 1
+  conn->snd_wnd = 0;
+  conn->rtt_len = 0;
+  conn->snd_max_len = 0;
+  conn->snd_segs = 0;
+  conn->dupacks = 0;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
   conn->lport = uip_htons(lastport);
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
+#if UIP_CONN_HASH_SIZE
+  index_link(&tcp_index, conn - uip_conns,
+             conn_hash(conn->lport, conn->rport, &conn->ripaddr));
+#endif /* UIP_CONN_HASH_SIZE */
   
   return conn;
 }
@@ -568,11 +788,17 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     lastport = 4096;
   }
   
+#if UIP_CONN_HASH_SIZE
+  if(udp_port_used(uip_htons(lastport))) {
+    goto again;
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
     if(uip_udp_conns[c].lport == uip_htons(lastport)) {
       goto again;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
 
   conn = 0;
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
@@ -594,9 +820,26 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     uip_ipaddr_copy(&conn->ripaddr, ripaddr);
   }
   conn->ttl = uip_ds6_if.cur_hop_limit;
+#if UIP_CONN_HASH_SIZE
+  index_link(&udp_index, conn - uip_udp_conns,
+             conn_hash(conn->lport, 0, NULL));
+#endif /* UIP_CONN_HASH_SIZE */
   
   return conn;
 }
+/*---------------------------------------------------------------------------*/
+#if UIP_CONN_HASH_SIZE
+void
+uip_udp_rebind(struct uip_udp_conn *conn, uint16_t port)
+{
+  conn->lport = port;
+  if(port == 0) {
+    index_unlink(&udp_index, conn - uip_udp_conns);
+  } else {
+    index_link(&udp_index, conn - uip_udp_conns, conn_hash(port, 0, NULL));
+  }
+}
+#endif /* UIP_CONN_HASH_SIZE */
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
 #if UIP_TCP
@@ -954,7 +1197,11 @@ uip_process(uint8_t flag)
   if(flag == UIP_POLL_REQUEST) {
 #if UIP_TCP
     if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+#if UIP_TCP_SEND_WINDOW > 1
+       uip_tcp_send_room(uip_connr) > 0) {
+#else /* UIP_TCP_SEND_WINDOW > 1 */
        !uip_outstanding(uip_connr)) {
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
       uip_flags = UIP_POLL;
       UIP_APPCALL();
       goto appsend;
@@ -1001,6 +1248,11 @@ uip_process(uint8_t flag)
        * connection's timer and see if it has reached the RTO value
        * in which case we retransmit.
        */
+#if UIP_TCP_SEND_WINDOW > 1
+      if(uip_connr->rtt_len > 0 && uip_connr->rtt_ticks < 0xff) {
+        ++(uip_connr->rtt_ticks);
+      }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
       if(uip_outstanding(uip_connr)) {
         if(uip_connr->timer-- == 0) {
           if(uip_connr->nrtx == UIP_MAXRTX ||
@@ -1056,6 +1308,11 @@ uip_process(uint8_t flag)
                * the code for sending out the packet (the apprexmit
                * label).
                */
+#if UIP_TCP_SEND_WINDOW > 1
+              if(TCP_WINDOWED(uip_connr)) {
+                window_rexmit(uip_connr);
+              }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
               uip_flags = UIP_REXMIT;
               UIP_APPCALL();
               goto apprexmit;
@@ -1066,6 +1323,15 @@ uip_process(uint8_t flag)
               /* In all these states we should retransmit a FINACK. */
               goto tcp_send_finack;
           }
+#if UIP_TCP_SEND_WINDOW > 1
+        } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED &&
+                  TCP_WINDOWED(uip_connr) &&
+                  uip_tcp_send_room(uip_connr) > 0) {
+          /* Let the application fill the rest of the send window. */
+          uip_flags = UIP_POLL;
+          UIP_APPCALL();
+          goto appsend;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
         }
       } else if((uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
         /*
@@ -1366,6 +1632,12 @@ uip_process(uint8_t flag)
 
         PRINTF("Processing Routing header\n");
         if(UIP_ROUTING_BUF->seg_left > 0) {
+#if UIP_CONF_IPV6_RPL
+          if(rpl_process_srh_header()) {
+            /* Forward to the next address of the source route */
+            goto send;
+          }
+#endif /* UIP_CONF_IPV6_RPL */
           uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
           UIP_STAT(++uip_stat.ip.drop);
           UIP_LOG("ip6: unrecognized routing type");
@@ -1505,6 +1777,12 @@ uip_process(uint8_t flag)
   }
 
   /* Demultiplex this UDP packet between the UDP "connections". */
+#if UIP_CONN_HASH_SIZE
+  uip_udp_conn = udp_index_lookup();
+  if(uip_udp_conn != NULL) {
+    goto udp_found;
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(uip_udp_conn = &uip_udp_conns[0];
       uip_udp_conn < &uip_udp_conns[UIP_UDP_CONNS];
       ++uip_udp_conn) {
@@ -1524,6 +1802,7 @@ uip_process(uint8_t flag)
       goto udp_found;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
   PRINTF("udp: no matching connection found\n");
   UIP_STAT(++uip_stat.udp.drop);
 
@@ -1614,6 +1893,12 @@ uip_process(uint8_t flag)
 
   /* Demultiplex this segment. */
   /* First check any active connections. */
+#if UIP_CONN_HASH_SIZE
+  uip_connr = tcp_index_lookup();
+  if(uip_connr != NULL) {
+    goto found;
+  }
+#else /* UIP_CONN_HASH_SIZE */
   for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
       ++uip_connr) {
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
@@ -1623,6 +1908,7 @@ uip_process(uint8_t flag)
       goto found;
     }
   }
+#endif /* UIP_CONN_HASH_SIZE */
 
   /* If we didn't find and active connection that expected the packet,
      either this packet is an old duplicate, or this is a SYN packet
@@ -1735,10 +2021,22 @@ uip_process(uint8_t flag)
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
+#if UIP_TCP_SEND_WINDOW > 1
+  uip_connr->snd_wnd = 0;
+  uip_connr->rtt_len = 0;
+  uip_connr->snd_max_len = 0;
+  uip_connr->snd_segs = 0;
+  uip_connr->dupacks = 0;
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
   uip_connr->lport = UIP_TCP_BUF->destport;
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
+#if UIP_CONN_HASH_SIZE
+  index_link(&tcp_index, uip_connr - uip_conns,
+             conn_hash(uip_connr->lport, uip_connr->rport,
+                       &uip_connr->ripaddr));
+#endif /* UIP_CONN_HASH_SIZE */
 
   uip_connr->snd_nxt[0] = iss[0];
   uip_connr->snd_nxt[1] = iss[1];
@@ -1862,6 +2160,64 @@ uip_process(uint8_t flag)
      data. If so, we update the sequence number, reset the length of
      the outstanding data, calculate RTT estimations, and reset the
      retransmission timer. */
+#if UIP_TCP_SEND_WINDOW > 1
+  /* With a send window, any ACK that covers a prefix of the data
+     sent is accepted. This includes data beyond the window that a
+     retransmission has collapsed. Duplicate ACKs for the oldest
+     segment trigger a fast retransmit. */
+  if((UIP_TCP_BUF->flags & TCP_ACK) && TCP_WINDOWED(uip_connr)) {
+    uint32_t acked;
+
+    tmp16 = ((uint16_t)UIP_TCP_BUF->wnd[0] << 8) + (uint16_t)UIP_TCP_BUF->wnd[1];
+    acked = seq_diff(UIP_TCP_BUF->ackno, uip_connr->snd_nxt);
+    if(acked > 0 &&
+       (acked <= uip_connr->len || acked <= uip_connr->snd_max_len)) {
+      uip_add32(uip_connr->snd_nxt, (uint16_t)acked);
+      memcpy(uip_connr->snd_nxt, uip_acc32, 4);
+      uip_connr->len = acked < uip_connr->len ?
+        uip_connr->len - (uint16_t)acked : 0;
+      uip_connr->snd_max_len = acked < uip_connr->snd_max_len ?
+        uip_connr->snd_max_len - (uint16_t)acked : 0;
+      uip_ackedlen = (uint16_t)acked;
+
+      /* Do RTT estimation on the timed segment, unless it has been
+         retransmitted. */
+      if(uip_connr->rtt_len > 0) {
+        if(acked >= uip_connr->rtt_len) {
+          int m;
+          m = uip_connr->rtt_ticks;
+          m = m - (uip_connr->sa >> 3);
+          uip_connr->sa += m;
+          if(m < 0) {
+            m = -m;
+          }
+          m = m - (uip_connr->sv >> 2);
+          uip_connr->sv += m;
+          uip_connr->rto = (uip_connr->sa >> 3) + uip_connr->sv;
+          uip_connr->rtt_len = 0;
+        } else {
+          uip_connr->rtt_len -= (uint16_t)acked;
+        }
+      }
+      uip_flags = UIP_ACKDATA;
+      uip_connr->timer = uip_connr->rto;
+      uip_connr->nrtx = 0;
+      uip_connr->dupacks = 0;
+    } else if(acked == 0 && uip_connr->len > 0 && uip_len == 0 &&
+              !(UIP_TCP_BUF->flags & (TCP_SYN | TCP_FIN)) &&
+              tmp16 == uip_connr->snd_wnd &&
+              (uip_connr->tcpstateflags & UIP_TS_MASK) == UIP_ESTABLISHED) {
+      if(++uip_connr->dupacks == TCP_DUPACK_THRESHOLD) {
+        UIP_STAT(++uip_stat.tcp.rexmit);
+        window_rexmit(uip_connr);
+        uip_flags = UIP_REXMIT;
+        uip_slen = 0;
+        UIP_APPCALL();
+        goto apprexmit;
+      }
+    }
+  } else
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
   if((UIP_TCP_BUF->flags & TCP_ACK) && uip_outstanding(uip_connr)) {
     uip_add32(uip_connr->snd_nxt, uip_connr->len);
 
@@ -1900,6 +2256,14 @@ uip_process(uint8_t flag)
     }
     
   }
+#if UIP_TCP_SEND_WINDOW > 1
+  /* Track the peer's window on all connections, so that it is known
+     by the time the application enables the send window. */
+  if(UIP_TCP_BUF->flags & TCP_ACK) {
+    uip_connr->snd_wnd = ((uint16_t)UIP_TCP_BUF->wnd[0] << 8) +
+      (uint16_t)UIP_TCP_BUF->wnd[1];
+  }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
 
   /* Do different things depending on in what state the connection is. */
   switch(uip_connr->tcpstateflags & UIP_TS_MASK) {
@@ -2110,6 +2474,28 @@ uip_process(uint8_t flag)
         }
 
         /* If uip_slen > 0, the application has data to be sent. */
+#if UIP_TCP_SEND_WINDOW > 1
+        if(uip_slen > 0 && TCP_WINDOWED(uip_connr)) {
+          /* New data is appended to the data already in flight, as
+             far as the send window allows. */
+          tmp16 = uip_tcp_send_room(uip_connr);
+          if(uip_slen > tmp16) {
+            uip_slen = tmp16;
+          }
+          if(uip_slen > 0) {
+            snd_off = uip_connr->len;
+            uip_connr->len += uip_slen;
+            if(uip_connr->len > uip_connr->snd_max_len) {
+              uip_connr->snd_max_len = uip_connr->len;
+            }
+            if(uip_connr->rtt_len == 0 && uip_connr->nrtx == 0) {
+              uip_connr->rtt_len = uip_connr->len;
+              uip_connr->rtt_ticks = 0;
+            }
+          }
+          goto apprexmit;
+        }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
         if(uip_slen > 0) {
 
           /* If the connection has acknowledged data, the contents of
@@ -2149,6 +2535,16 @@ uip_process(uint8_t flag)
            packet had new data in it, we must send out a packet. */
         if(uip_slen > 0 && uip_connr->len > 0) {
           /* Add the length of the IP and TCP headers. */
+#if UIP_TCP_SEND_WINDOW > 1
+          if(TCP_WINDOWED(uip_connr)) {
+            /* A retransmission resends the collapsed window, new data
+               is sent at snd_off. */
+            if(uip_flags & UIP_REXMIT) {
+              uip_slen = uip_connr->len;
+            }
+            uip_len = uip_slen + UIP_TCPIP_HLEN;
+          } else
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
           uip_len = uip_connr->len + UIP_TCPIP_HLEN;
           /* We always set the ACK flag in response packets. */
           UIP_TCP_BUF->flags = TCP_ACK | TCP_PSH;
@@ -2259,6 +2655,14 @@ uip_process(uint8_t flag)
   UIP_TCP_BUF->seqno[2] = uip_connr->snd_nxt[2];
   UIP_TCP_BUF->seqno[3] = uip_connr->snd_nxt[3];
 
+#if UIP_TCP_SEND_WINDOW > 1
+  if(snd_off > 0) {
+    uip_add32(UIP_TCP_BUF->seqno, snd_off);
+    memcpy(UIP_TCP_BUF->seqno, uip_acc32, 4);
+    snd_off = 0;
+  }
+#endif /* UIP_TCP_SEND_WINDOW > 1 */
+
   UIP_TCP_BUF->srcport  = uip_connr->lport;
   UIP_TCP_BUF->destport = uip_connr->rport;
 
@@ -33,7 +33,8 @@
 /**
  * \file
  *         Protects against replay attacks by comparing with the last
- *         unicast or broadcast frame counter of the sender.
+ *         unicast or broadcast frame counter of the sender, optionally
+ *         through a sliding window that tolerates reordering.
  * \author
  *         Konrad Krentz <konrad.krentz@gmail.com>
  */
@@ -46,9 +47,148 @@
 #include "net/llsec/anti-replay.h"
 #include "net/packetbuf.h"
 
+#if ANTI_REPLAY_PERSISTENT
+#include "cfs/cfs.h"
+#include "sys/ctimer.h"
+
+#ifdef ANTI_REPLAY_CONF_PERSISTENT_FILENAME
+#define ANTI_REPLAY_PERSISTENT_FILENAME ANTI_REPLAY_CONF_PERSISTENT_FILENAME
+#else
+#define ANTI_REPLAY_PERSISTENT_FILENAME "anti-replay"
+#endif
+
+/* How often the neighbors' frame counters are written out, if changed.
+   Frames received since the last write can be replayed after a reboot. */
+#ifdef ANTI_REPLAY_CONF_PERSISTENT_INTERVAL
+#define ANTI_REPLAY_PERSISTENT_INTERVAL ANTI_REPLAY_CONF_PERSISTENT_INTERVAL
+#else
+#define ANTI_REPLAY_PERSISTENT_INTERVAL (CLOCK_SECOND * 60)
+#endif
+
+/* Our frame counter is written once every this many frames. The file
+   holds the first value not yet handed out, and we resume from there. */
+#ifdef ANTI_REPLAY_CONF_COUNTER_STRIDE
+#define ANTI_REPLAY_COUNTER_STRIDE ANTI_REPLAY_CONF_COUNTER_STRIDE
+#else
+#define ANTI_REPLAY_COUNTER_STRIDE 1024
+#endif
+
+/* The file holds the reserved counter, followed by one record per
+   neighbor */
+struct anti_replay_record {
+  linkaddr_t addr;
+  uint32_t last_broadcast_counter;
+  uint32_t last_unicast_counter;
+};
+
+static nbr_table_t *persist_table;
+static struct ctimer persist_timer;
+static uint32_t reserved_counter;
+static uint8_t dirty;
+#endif /* ANTI_REPLAY_PERSISTENT */
+
+#if ANTI_REPLAY_WINDOW
+#define BROADCAST_WINDOW(info) (&(info)->broadcast_window)
+#define UNICAST_WINDOW(info)   (&(info)->unicast_window)
+#else /* ANTI_REPLAY_WINDOW */
+#define BROADCAST_WINDOW(info) NULL
+#define UNICAST_WINDOW(info)   NULL
+#endif /* ANTI_REPLAY_WINDOW */
+
 /* This node's current frame counter value */
 static uint32_t counter;
 
+struct anti_replay_stats anti_replay_stats;
+
+#if ANTI_REPLAY_PERSISTENT
+/*---------------------------------------------------------------------------*/
+static void
+persist(void)
+{
+  struct anti_replay_record r;
+  struct anti_replay_info *info;
+  int fd;
+
+  cfs_remove(ANTI_REPLAY_PERSISTENT_FILENAME);
+  fd = cfs_open(ANTI_REPLAY_PERSISTENT_FILENAME, CFS_WRITE);
+  if(fd < 0) {
+    return;
+  }
+  if(cfs_write(fd, &reserved_counter, sizeof(reserved_counter))
+     == sizeof(reserved_counter) && persist_table != NULL) {
+    for(info = nbr_table_head(persist_table);
+        info != NULL;
+        info = nbr_table_next(persist_table, info)) {
+      linkaddr_copy(&r.addr, nbr_table_get_lladdr(persist_table, info));
+      r.last_broadcast_counter = info->last_broadcast_counter;
+      r.last_unicast_counter = info->last_unicast_counter;
+      if(cfs_write(fd, &r, sizeof(r)) != sizeof(r)) {
+        break;
+      }
+    }
+  }
+  cfs_close(fd);
+  dirty = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+persist_periodic(void *ptr)
+{
+  if(dirty) {
+    persist();
+  }
+  ctimer_set(&persist_timer, ANTI_REPLAY_PERSISTENT_INTERVAL,
+             persist_periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+restore(void)
+{
+  struct anti_replay_record r;
+  struct anti_replay_info *info;
+  int fd;
+
+  fd = cfs_open(ANTI_REPLAY_PERSISTENT_FILENAME, CFS_READ);
+  if(fd < 0) {
+    return;
+  }
+  if(cfs_read(fd, &reserved_counter, sizeof(reserved_counter))
+     == sizeof(reserved_counter)) {
+    counter = reserved_counter;
+  }
+  /* Restored neighbors are left unlocked, so that those that are not
+     heard from again can make room for new ones. They are locked like
+     any other neighbor once a fresh frame from them is accepted. */
+  while(persist_table != NULL
+        && cfs_read(fd, &r, sizeof(r)) == sizeof(r)) {
+    info = nbr_table_add_lladdr(persist_table, &r.addr);
+    if(info == NULL) {
+      break;
+    }
+    info->last_broadcast_counter = r.last_broadcast_counter;
+    info->last_unicast_counter = r.last_unicast_counter;
+#if ANTI_REPLAY_WINDOW
+    /* What the window held is lost; treat all of it as received */
+    info->broadcast_window = info->unicast_window = 0xffffffff;
+#endif /* ANTI_REPLAY_WINDOW */
+  }
+  cfs_close(fd);
+}
+#endif /* ANTI_REPLAY_PERSISTENT */
+/*---------------------------------------------------------------------------*/
+void
+anti_replay_init(nbr_table_t *table)
+{
+#if ANTI_REPLAY_PERSISTENT
+  persist_table = table;
+  restore();
+  reserved_counter = counter + ANTI_REPLAY_COUNTER_STRIDE;
+  persist();
+  ctimer_set(&persist_timer, ANTI_REPLAY_PERSISTENT_INTERVAL,
+             persist_periodic, NULL);
+#endif /* ANTI_REPLAY_PERSISTENT */
+}
+
 /*---------------------------------------------------------------------------*/
 void
 anti_replay_set_counter(void)
@@ -56,6 +196,12 @@ anti_replay_set_counter(void)
   frame802154_frame_counter_t reordered_counter;
   
   reordered_counter.u32 = LLSEC802154_HTONL(++counter);
+#if ANTI_REPLAY_PERSISTENT
+  if(counter >= reserved_counter) {
+    reserved_counter = counter + ANTI_REPLAY_COUNTER_STRIDE;
+    persist();
+  }
+#endif /* ANTI_REPLAY_PERSISTENT */
   
   packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1, reordered_counter.u16[0]);
   packetbuf_set_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3, reordered_counter.u16[1]);
@@ -78,32 +224,76 @@ anti_replay_init_info(struct anti_replay_info *info)
   info->last_broadcast_counter
       = info->last_unicast_counter
       = anti_replay_get_counter();
+#if ANTI_REPLAY_WINDOW
+  info->broadcast_window = packetbuf_holds_broadcast() ? 1 : 0;
+  info->unicast_window = packetbuf_holds_broadcast() ? 0 : 1;
+#endif /* ANTI_REPLAY_WINDOW */
+#if ANTI_REPLAY_PERSISTENT
+  dirty = 1;
+#endif /* ANTI_REPLAY_PERSISTENT */
+}
+/*---------------------------------------------------------------------------*/
+static int
+was_replayed(uint32_t received_counter, uint32_t *last_counter,
+    uint32_t *window)
+{
+#if ANTI_REPLAY_WINDOW
+  uint32_t diff;
+
+  if(received_counter > *last_counter) {
+    diff = received_counter - *last_counter;
+    *window = diff >= ANTI_REPLAY_WINDOW ? 1 : (*window << diff) | 1;
+    *last_counter = received_counter;
+    return 0;
+  }
+
+  /* An older frame is accepted once if it is still inside the window */
+  diff = *last_counter - received_counter;
+  if(diff >= ANTI_REPLAY_WINDOW || (*window & ((uint32_t)1 << diff))) {
+    return 1;
+  }
+  *window |= (uint32_t)1 << diff;
+  anti_replay_stats.reordered++;
+  return 0;
+#else /* ANTI_REPLAY_WINDOW */
+  if(received_counter <= *last_counter) {
+    return 1;
+  }
+  *last_counter = received_counter;
+  return 0;
+#endif /* ANTI_REPLAY_WINDOW */
 }
 /*---------------------------------------------------------------------------*/
 int
 anti_replay_was_replayed(struct anti_replay_info *info)
 {
   uint32_t received_counter;
+  int replayed;
   
   received_counter = anti_replay_get_counter();
   
   if(packetbuf_holds_broadcast()) {
     /* broadcast */
-    if(received_counter <= info->last_broadcast_counter) {
-      return 1;
-    } else {
-      info->last_broadcast_counter = received_counter;
-      return 0;
-    }
+    replayed = was_replayed(received_counter,
+        &info->last_broadcast_counter, BROADCAST_WINDOW(info));
   } else {
     /* unicast */
-    if(received_counter <= info->last_unicast_counter) {
-      return 1;
-    } else {
-      info->last_unicast_counter = received_counter;
-      return 0;
+    replayed = was_replayed(received_counter,
+        &info->last_unicast_counter, UNICAST_WINDOW(info));
+  }
+  
+  if(replayed) {
+    anti_replay_stats.replayed++;
+  }
+#if ANTI_REPLAY_PERSISTENT
+  else {
+    dirty = 1;
+    if(persist_table != NULL) {
+      nbr_table_lock(persist_table, info);
     }
   }
+#endif /* ANTI_REPLAY_PERSISTENT */
+  return replayed;
 }
 /*---------------------------------------------------------------------------*/
 
@@ -46,12 +46,60 @@
 #define ANTI_REPLAY_H
 
 #include "contiki.h"
+#include "net/nbr-table.h"
+
+/* Width in frames of the sliding replay window kept per sender, at most
+   32. Frames that arrive out of order are accepted once as long as they
+   are less than this many counter values behind the newest frame. With
+   0, only strictly increasing frame counters are accepted. */
+#ifdef ANTI_REPLAY_CONF_WINDOW
+#define ANTI_REPLAY_WINDOW ANTI_REPLAY_CONF_WINDOW
+#else /* ANTI_REPLAY_CONF_WINDOW */
+#define ANTI_REPLAY_WINDOW 0
+#endif /* ANTI_REPLAY_CONF_WINDOW */
+
+#if ANTI_REPLAY_WINDOW > 32
+#error "ANTI_REPLAY_CONF_WINDOW must not exceed 32"
+#endif
+
+/* Keep this node's frame counter and the last frame counters of its
+   neighbors in CFS, so that a reboot neither resets our counter below
+   what neighbors have seen nor forgets what we have seen from them. */
+#ifdef ANTI_REPLAY_CONF_PERSISTENT
+#define ANTI_REPLAY_PERSISTENT ANTI_REPLAY_CONF_PERSISTENT
+#else /* ANTI_REPLAY_CONF_PERSISTENT */
+#define ANTI_REPLAY_PERSISTENT 0
+#endif /* ANTI_REPLAY_CONF_PERSISTENT */
 
 struct anti_replay_info {
   uint32_t last_broadcast_counter;
   uint32_t last_unicast_counter;
+#if ANTI_REPLAY_WINDOW
+  /* Bit n is set when last_*_counter - n has been received */
+  uint32_t broadcast_window;
+  uint32_t unicast_window;
+#endif /* ANTI_REPLAY_WINDOW */
 };
 
+/**
+ * \brief Anti-replay counters
+ */
+struct anti_replay_stats {
+  uint16_t replayed;   /**< Frames rejected as replayed */
+  uint16_t reordered;  /**< Out-of-order frames accepted by the window */
+};
+
+extern struct anti_replay_stats anti_replay_stats;
+
+/**
+ * \brief       Restores the frame counter and, if a table is given, the
+ *              neighbors' anti-replay information from CFS. Restored
+ *              table entries are only locked once a fresh frame from
+ *              the neighbor is accepted. Does nothing unless persistent.
+ * \param table Registered table of struct anti_replay_info, or NULL
+ */
+void anti_replay_init(nbr_table_t *table);
+
 /**
  * \brief Sets the frame counter packetbuf attributes.
  */
@@ -9,6 +9,17 @@
 #include "net/packetbuf.h"
 #include <string.h>
 
+/*---------------------------------------------------------------------------*/
+static void
+set_nonce(uint8_t *nonce, const uint8_t *extended_source_address)
+{
+  memcpy(nonce, extended_source_address, 8);
+  nonce[8] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3) >> 8;
+  nonce[9] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3) & 0xff;
+  nonce[10] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1) >> 8;
+  nonce[11] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1) & 0xff;
+  nonce[12] = packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL);
+}
 /*---------------------------------------------------------------------------*/
 void ccm_star_mic_packetbuf(const uint8_t *extended_source_address,
     uint8_t *result,
@@ -20,12 +31,7 @@ void ccm_star_mic_packetbuf(const uint8_t *extended_source_address,
   uint8_t header_len = packetbuf_hdrlen();
   uint8_t nonce[CCM_STAR_NONCE_LENGTH];
   
-  memcpy(nonce, extended_source_address, 8);
-  nonce[8] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3) >> 8;
-  nonce[9] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3) & 0xff;
-  nonce[10] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1) >> 8;
-  nonce[11] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1) & 0xff;
-  nonce[12] = packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL);
+  set_nonce(nonce, extended_source_address);
 
   if(packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL) & (1 << 2)) {
     CCM_STAR.mic(dataptr, data_len, nonce, headerptr, header_len, result, mic_len);
@@ -40,13 +46,46 @@ void ccm_star_ctr_packetbuf(const uint8_t *extended_source_address)
   uint8_t data_len = packetbuf_datalen();
   uint8_t nonce[CCM_STAR_NONCE_LENGTH];
   
-  memcpy(nonce, extended_source_address, 8);
-  nonce[8] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3) >> 8;
-  nonce[9] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_2_3) & 0xff;
-  nonce[10] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1) >> 8;
-  nonce[11] = packetbuf_attr(PACKETBUF_ATTR_FRAME_COUNTER_BYTES_0_1) & 0xff;
-  nonce[12] = packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL);
+  set_nonce(nonce, extended_source_address);
 
   CCM_STAR.ctr(dataptr, data_len, nonce);
 }
 /*---------------------------------------------------------------------------*/
+void ccm_star_aead_packetbuf(const uint8_t *extended_source_address,
+    uint8_t *result,
+    uint8_t mic_len,
+    int forward)
+{
+  uint8_t *dataptr = packetbuf_dataptr();
+  uint8_t data_len = packetbuf_datalen();
+  uint8_t *headerptr = packetbuf_hdrptr();
+  uint8_t header_len = packetbuf_hdrlen();
+  uint8_t nonce[CCM_STAR_NONCE_LENGTH];
+  int with_encryption;
+
+  with_encryption = packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL) & (1 << 2);
+
+  if(CCM_STAR.aead == NULL) {
+    if(forward) {
+      ccm_star_mic_packetbuf(extended_source_address, result, mic_len);
+    }
+    if(with_encryption) {
+      ccm_star_ctr_packetbuf(extended_source_address);
+    }
+    if(!forward) {
+      ccm_star_mic_packetbuf(extended_source_address, result, mic_len);
+    }
+    return;
+  }
+
+  set_nonce(nonce, extended_source_address);
+
+  if(with_encryption) {
+    CCM_STAR.aead(nonce, dataptr, data_len, headerptr, header_len,
+        result, mic_len, forward);
+  } else {
+    CCM_STAR.aead(nonce, dataptr + data_len, 0, headerptr, packetbuf_totlen(),
+        result, mic_len, forward);
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -20,5 +20,16 @@ void ccm_star_mic_packetbuf(const uint8_t *extended_source_address,
  */
 void ccm_star_ctr_packetbuf(const uint8_t *extended_source_address);
 
+/**
+ * \brief Authenticates and, if the security level demands it, en- or
+ *        decrypts the frame in one pass. Uses CCM_STAR.aead when the
+ *        driver has one and falls back to mic and ctr otherwise.
+ *        When decrypting, the received MIC must follow the payload.
+ */
+void ccm_star_aead_packetbuf(const uint8_t *extended_source_address,
+    uint8_t *result,
+    uint8_t mic_len,
+    int forward);
+
 #endif /* CCM_STAR_PACKETBUF_H_ */
 
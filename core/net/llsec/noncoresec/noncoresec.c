@@ -54,8 +54,6 @@
 #include "lib/ccm-star.h"
 #include <string.h>
 
-#define WITH_ENCRYPTION (LLSEC802154_SECURITY_LEVEL & (1 << 2))
-
 #ifdef NONCORESEC_CONF_KEY
 #define NONCORESEC_KEY NONCORESEC_CONF_KEY
 #else /* NONCORESEC_CONF_KEY */
@@ -113,10 +111,8 @@ on_frame_created(void)
   uint8_t *dataptr = packetbuf_dataptr();
   uint8_t data_len = packetbuf_datalen();
 
-  ccm_star_mic_packetbuf(get_extended_address(&linkaddr_node_addr), dataptr + data_len, LLSEC802154_MIC_LENGTH);
-#if WITH_ENCRYPTION
-  ccm_star_ctr_packetbuf(get_extended_address(&linkaddr_node_addr));
-#endif /* WITH_ENCRYPTION */
+  ccm_star_aead_packetbuf(get_extended_address(&linkaddr_node_addr),
+      dataptr + data_len, LLSEC802154_MIC_LENGTH, 1);
   packetbuf_set_datalen(data_len + LLSEC802154_MIC_LENGTH);
   
   return 1;
@@ -145,10 +141,8 @@ input(void)
   data_len -= LLSEC802154_MIC_LENGTH;
   packetbuf_set_datalen(data_len);
   
-#if WITH_ENCRYPTION
-  ccm_star_ctr_packetbuf(get_extended_address(sender));
-#endif /* WITH_ENCRYPTION */
-  ccm_star_mic_packetbuf(get_extended_address(sender), generated_mic, LLSEC802154_MIC_LENGTH);
+  ccm_star_aead_packetbuf(get_extended_address(sender),
+      generated_mic, LLSEC802154_MIC_LENGTH, 0);
   
   received_mic = dataptr + data_len;
   if(memcmp(generated_mic, received_mic, LLSEC802154_MIC_LENGTH) != 0) {
@@ -205,6 +199,7 @@ bootstrap(llsec_on_bootstrapped_t on_bootstrapped)
 {
   CCM_STAR.set_key(key);
   nbr_table_register(anti_replay_table, NULL);
+  anti_replay_init(anti_replay_table);
   on_bootstrapped();
 }
 /*---------------------------------------------------------------------------*/
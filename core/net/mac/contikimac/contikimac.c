@@ -243,6 +243,10 @@ static struct compower_activity current_packet;
 
 #define DEFAULT_STREAM_TIME (4 * CYCLE_TIME)
 
+#if CONTIKIMAC_WITH_STATS
+struct contikimac_stats contikimac_stats;
+#endif /* CONTIKIMAC_WITH_STATS */
+
 #if CONTIKIMAC_CONF_BROADCAST_RATE_LIMIT
 static struct timer broadcast_rate_timer;
 static int broadcast_rate_counter;
@@ -512,6 +516,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   uint8_t is_known_receiver = 0;
   uint8_t collisions;
   int transmit_len;
+  void *frame;
   int ret;
   uint8_t contikimac_was_on;
   uint8_t seqno;
@@ -521,8 +526,18 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
     PRINTF("contikimac: radio is turned off\n");
     return MAC_TX_ERR_FATAL;
   }
+
+  if(buf_list != NULL && packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED)) {
+    /* The frame was created in advance by qsend_list(), and is sent
+       straight from its queuebuf */
+    frame = queuebuf_dataptr(buf_list->buf);
+    transmit_len = queuebuf_datalen(buf_list->buf);
+  } else {
+    frame = NULL;
+    transmit_len = packetbuf_totlen();
+  }
  
-  if(packetbuf_totlen() == 0) {
+  if(transmit_len == 0) {
     PRINTF("contikimac: send_packet data len 0\n");
     return MAC_TX_ERR_FATAL;
   }
@@ -556,16 +571,18 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
 #endif /* NETSTACK_CONF_WITH_IPV6 */
   }
 
-  if(!packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED)) {
-    packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
-    if(NETSTACK_FRAMER.create_and_secure() < 0) {
-      PRINTF("contikimac: framer failed\n");
-      return MAC_TX_ERR_FATAL;
+  if(frame == NULL) {
+    if(!packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED)) {
+      packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+      if(NETSTACK_FRAMER.create_and_secure() < 0) {
+        PRINTF("contikimac: framer failed\n");
+        return MAC_TX_ERR_FATAL;
+      }
     }
+    frame = packetbuf_hdrptr();
+    transmit_len = packetbuf_totlen();
   }
-  
-  transmit_len = packetbuf_totlen();
-  NETSTACK_RADIO.prepare(packetbuf_hdrptr(), transmit_len);
+  NETSTACK_RADIO.prepare(frame, transmit_len);
   
   if(!is_broadcast && !is_receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
@@ -734,7 +751,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   off();
 
   PRINTF("contikimac: send (strobes=%u, len=%u, %s, %s), done\n", strobes,
-         packetbuf_totlen(),
+         transmit_len,
          got_strobe_ack ? "ack" : "no ack",
          collisions ? "collision" : "no collision");
 
@@ -777,11 +794,23 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   if(!is_broadcast) {
     if(collisions == 0 && is_receiver_awake == 0) {
       phase_update(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-		   encounter_time, ret);
+		   encounter_time, CYCLE_TIME, ret);
     }
   }
 #endif /* WITH_PHASE_OPTIMIZATION */
 
+#if CONTIKIMAC_WITH_STATS
+  if(!is_broadcast && is_receiver_awake == 0 && got_strobe_ack) {
+    if(is_known_receiver) {
+      contikimac_stats.phase_locked_tx++;
+      contikimac_stats.phase_locked_strobes += strobes + 1;
+    } else {
+      contikimac_stats.unlocked_tx++;
+      contikimac_stats.unlocked_strobes += strobes + 1;
+    }
+  }
+#endif /* CONTIKIMAC_WITH_STATS */
+
   return ret;
 }
 /*---------------------------------------------------------------------------*/
@@ -832,7 +861,12 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
       }
       
       packetbuf_set_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED, 1);
-      queuebuf_update_from_packetbuf(curr->buf);
+      if(!queuebuf_update_from_packetbuf(curr->buf)) {
+        /* The queuebuf could not hold the frame; let the MAC drop it */
+        PRINTF("contikimac: could not store frame\n");
+        mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+        return;
+      }
     }
     curr = next;
   } while(next != NULL);
@@ -843,8 +877,9 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
   do { /* A loop sending a burst of packets from buf_list */
     next = list_item_next(curr);
 
-    /* Prepare the packetbuf */
-    queuebuf_to_packetbuf(curr->buf);
+    /* Prepare the packetbuf attributes; the frame itself is sent
+       from the queuebuf */
+    queuebuf_attr_to_packetbuf(curr->buf);
     
     /* Send the current packet */
     ret = send_packet(sent, ptr, curr, is_receiver_awake);
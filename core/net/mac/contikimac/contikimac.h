@@ -46,4 +46,28 @@
 
 extern const struct rdc_driver contikimac_driver;
 
+#ifdef CONTIKIMAC_CONF_WITH_STATS
+#define CONTIKIMAC_WITH_STATS CONTIKIMAC_CONF_WITH_STATS
+#else /* CONTIKIMAC_CONF_WITH_STATS */
+#define CONTIKIMAC_WITH_STATS 0
+#endif /* CONTIKIMAC_CONF_WITH_STATS */
+
+#if CONTIKIMAC_WITH_STATS
+/**
+ * Strobe counts of acknowledged unicast transmissions, split by
+ * whether the phase of the receiver was known. The number of strobes
+ * saved per packet by phase-locking is
+ * unlocked_strobes / unlocked_tx - phase_locked_strobes / phase_locked_tx,
+ * each strobe costing the airtime of one frame.
+ */
+struct contikimac_stats {
+  uint32_t phase_locked_tx;
+  uint32_t phase_locked_strobes;
+  uint32_t unlocked_tx;
+  uint32_t unlocked_strobes;
+};
+
+extern struct contikimac_stats contikimac_stats;
+#endif /* CONTIKIMAC_WITH_STATS */
+
 #endif /* CONTIKIMAC_H */
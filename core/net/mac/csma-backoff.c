@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Backoff policies for the CSMA MAC layer
+ */
+
+#include "net/mac/csma-backoff.h"
+#include "net/mac/mac.h"
+#include "lib/random.h"
+
+/* Fixed-point scale of the adaptive policy's failure ratio */
+#define LOAD_SCALE 256
+
+/* Weight of a new sample in the failure ratio, as a power of two */
+#ifdef CSMA_BACKOFF_CONF_LOAD_ALPHA_SHIFT
+#define LOAD_ALPHA_SHIFT CSMA_BACKOFF_CONF_LOAD_ALPHA_SHIFT
+#else
+#define LOAD_ALPHA_SHIFT 3
+#endif /* CSMA_BACKOFF_CONF_LOAD_ALPHA_SHIFT */
+
+/* Below this failure ratio the channel is considered idle */
+#define LOAD_LOW  (LOAD_SCALE / 8)
+/* Above this failure ratio the channel is considered congested */
+#define LOAD_HIGH (LOAD_SCALE / 2)
+
+static uint16_t load;
+
+/*---------------------------------------------------------------------------*/
+/* Pick a time within the interval [time, time + window * time[ */
+static clock_time_t
+random_backoff(clock_time_t time, int window)
+{
+  return time + (random_rand() % (window * time));
+}
+/*---------------------------------------------------------------------------*/
+static void
+null_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+null_tx_done(int status, int num_transmissions)
+{
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+beb_backoff(clock_time_t timebase, int transmissions)
+{
+  int backoff_exponent;
+
+  /* The retransmission time uses a truncated exponential backoff
+   * so that the interval between the transmissions increase with
+   * each retransmit. */
+  backoff_exponent = transmissions;
+
+  /* Truncate the exponent if needed. */
+  if(backoff_exponent > CSMA_MAX_BACKOFF_EXPONENT) {
+    backoff_exponent = CSMA_MAX_BACKOFF_EXPONENT;
+  }
+
+  return random_backoff(timebase, 1 << backoff_exponent);
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+linear_backoff(clock_time_t timebase, int transmissions)
+{
+  int window;
+
+  window = transmissions + 1;
+  if(window > (1 << CSMA_MAX_BACKOFF_EXPONENT)) {
+    window = 1 << CSMA_MAX_BACKOFF_EXPONENT;
+  }
+
+  return random_backoff(timebase, window);
+}
+/*---------------------------------------------------------------------------*/
+static void
+adaptive_init(void)
+{
+  load = 0;
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+adaptive_backoff(clock_time_t timebase, int transmissions)
+{
+  int backoff_exponent;
+  int max_exponent;
+
+  backoff_exponent = transmissions;
+  max_exponent = CSMA_MAX_BACKOFF_EXPONENT;
+
+  if(load < LOAD_LOW) {
+    /* Failures are rare, retry quickly */
+    max_exponent = 1;
+  } else if(load > LOAD_HIGH) {
+    /* The channel is congested, spread retransmissions further out */
+    backoff_exponent++;
+    max_exponent++;
+  }
+
+  if(backoff_exponent > max_exponent) {
+    backoff_exponent = max_exponent;
+  }
+
+  return random_backoff(timebase, 1 << backoff_exponent);
+}
+/*---------------------------------------------------------------------------*/
+static void
+adaptive_tx_done(int status, int num_transmissions)
+{
+  uint16_t sample;
+
+  switch(status) {
+  case MAC_TX_OK:
+    sample = 0;
+    break;
+  case MAC_TX_COLLISION:
+  case MAC_TX_NOACK:
+    sample = LOAD_SCALE;
+    break;
+  default:
+    return;
+  }
+
+  /* Exponentially weighted moving average of the failure ratio */
+  load = load - (load >> LOAD_ALPHA_SHIFT) + (sample >> LOAD_ALPHA_SHIFT);
+}
+/*---------------------------------------------------------------------------*/
+const struct csma_backoff_policy csma_backoff_beb = {
+  "beb",
+  null_init,
+  beb_backoff,
+  null_tx_done,
+};
+/*---------------------------------------------------------------------------*/
+const struct csma_backoff_policy csma_backoff_linear = {
+  "linear",
+  null_init,
+  linear_backoff,
+  null_tx_done,
+};
+/*---------------------------------------------------------------------------*/
+const struct csma_backoff_policy csma_backoff_adaptive = {
+  "adaptive",
+  adaptive_init,
+  adaptive_backoff,
+  adaptive_tx_done,
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Backoff policies for the CSMA MAC layer
+ */
+
+#ifndef CSMA_BACKOFF_H_
+#define CSMA_BACKOFF_H_
+
+#include "contiki.h"
+
+#ifndef CSMA_MAX_BACKOFF_EXPONENT
+#ifdef CSMA_CONF_MAX_BACKOFF_EXPONENT
+#define CSMA_MAX_BACKOFF_EXPONENT CSMA_CONF_MAX_BACKOFF_EXPONENT
+#else
+#define CSMA_MAX_BACKOFF_EXPONENT 3
+#endif /* CSMA_CONF_MAX_BACKOFF_EXPONENT */
+#endif /* CSMA_MAX_BACKOFF_EXPONENT */
+
+/**
+ * The backoff policy used by CSMA, one of the policies declared
+ * below or an application-provided one.
+ */
+#ifdef CSMA_CONF_BACKOFF_POLICY
+#define CSMA_BACKOFF_POLICY CSMA_CONF_BACKOFF_POLICY
+#else /* CSMA_CONF_BACKOFF_POLICY */
+#define CSMA_BACKOFF_POLICY csma_backoff_beb
+#endif /* CSMA_CONF_BACKOFF_POLICY */
+
+/**
+ * The structure of a CSMA backoff policy.
+ */
+struct csma_backoff_policy {
+  char *name;
+
+  /** Initialize the policy */
+  void (* init)(void);
+
+  /** Returns the time to wait before the next transmission attempt,
+      given the channel check time base and the number of transmissions
+      already made */
+  clock_time_t (* backoff)(clock_time_t timebase, int transmissions);
+
+  /** Informs the policy of the outcome of a transmission attempt */
+  void (* tx_done)(int status, int num_transmissions);
+};
+
+/** Truncated binary exponential backoff, the classic CSMA behavior */
+extern const struct csma_backoff_policy csma_backoff_beb;
+
+/** Backoff window growing by one time base per transmission */
+extern const struct csma_backoff_policy csma_backoff_linear;
+
+/** Exponential backoff whose window follows the recent ratio of
+    collisions and missing acknowledgements */
+extern const struct csma_backoff_policy csma_backoff_adaptive;
+
+#endif /* CSMA_BACKOFF_H_ */
@@ -38,11 +38,13 @@
  */
 
 #include "net/mac/csma.h"
+#include "net/mac/csma-backoff.h"
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 
 #include "sys/ctimer.h"
 #include "sys/clock.h"
+#include "sys/energest.h"
 
 #include "lib/random.h"
 
@@ -63,14 +65,6 @@
 #define PRINTF(...)
 #endif /* DEBUG */
 
-#ifndef CSMA_MAX_BACKOFF_EXPONENT
-#ifdef CSMA_CONF_MAX_BACKOFF_EXPONENT
-#define CSMA_MAX_BACKOFF_EXPONENT CSMA_CONF_MAX_BACKOFF_EXPONENT
-#else
-#define CSMA_MAX_BACKOFF_EXPONENT 3
-#endif /* CSMA_CONF_MAX_BACKOFF_EXPONENT */
-#endif /* CSMA_MAX_BACKOFF_EXPONENT */
-
 #ifndef CSMA_MAX_MAC_TRANSMISSIONS
 #ifdef CSMA_CONF_MAX_MAC_TRANSMISSIONS
 #define CSMA_MAX_MAC_TRANSMISSIONS CSMA_CONF_MAX_MAC_TRANSMISSIONS
@@ -79,6 +73,15 @@
 #endif /* CSMA_CONF_MAX_MAC_TRANSMISSIONS */
 #endif /* CSMA_MAX_MAC_TRANSMISSIONS */
 
+#if CSMA_WITH_PRIORITY
+struct csma_priority_stats csma_priority_stats[PACKETBUF_ATTR_PRIORITY_CLASSES];
+#endif /* CSMA_WITH_PRIORITY */
+
+#if CSMA_WITH_AIRTIME
+struct csma_airtime csma_airtime[CSMA_AIRTIME_CHANNELS];
+static unsigned long last_transmit, last_listen, last_cpu;
+#endif /* CSMA_WITH_AIRTIME */
+
 #if CSMA_MAX_MAC_TRANSMISSIONS < 1
 #error CSMA_CONF_MAX_MAC_TRANSMISSIONS must be at least 1.
 #error Change CSMA_CONF_MAX_MAC_TRANSMISSIONS in contiki-conf.h or in your Makefile.
@@ -89,6 +92,12 @@ struct qbuf_metadata {
   mac_callback_t sent;
   void *cptr;
   uint8_t max_transmissions;
+  /* Handed to the RDC layer, which has not reported on it yet */
+  uint8_t in_flight;
+#if CSMA_WITH_PRIORITY
+  uint8_t priority;
+  clock_time_t enqueued;
+#endif /* CSMA_WITH_PRIORITY */
 };
 
 /* Every neighbor has its own packet queue */
@@ -96,6 +105,10 @@ struct neighbor_queue {
   struct neighbor_queue *next;
   linkaddr_t addr;
   struct ctimer transmit_timer;
+#if CSMA_WITH_PRIORITY
+  /* Expires when the neighbor queue may transmit */
+  struct timer due_timer;
+#endif /* CSMA_WITH_PRIORITY */
   uint8_t transmissions;
   uint8_t collisions, deferrals;
   LIST_STRUCT(queued_packet_list);
@@ -121,6 +134,13 @@ MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
 
+/* The queue being handed to the RDC layer in send_list(), and the
+   packet after the last one the RDC layer reported on from within the
+   call. An asynchronous RDC layer, such as tschrdc, reports later on
+   the packets it has accepted. */
+static struct neighbor_queue *sending_queue;
+static struct rdc_buf_list *after_last_report;
+
 static void packet_sent(void *ptr, int status, int num_transmissions);
 static void transmit_packet_list(void *ptr);
 
@@ -155,17 +175,151 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+#if CSMA_WITH_AIRTIME
+static void
+read_energest(unsigned long *transmit, unsigned long *listen,
+              unsigned long *cpu)
+{
+  energest_flush();
+  *transmit = energest_type_time(ENERGEST_TYPE_TRANSMIT);
+  *listen = energest_type_time(ENERGEST_TYPE_LISTEN);
+  *cpu = energest_type_time(ENERGEST_TYPE_CPU) +
+    energest_type_time(ENERGEST_TYPE_LPM);
+}
+/*---------------------------------------------------------------------------*/
+/* Charge the radio time spent since the last call to the current
+   channel. */
+static void
+update_airtime(void)
+{
+  struct csma_airtime *a;
+  radio_value_t channel;
+  unsigned long transmit, listen, cpu;
+
+  if(NETSTACK_RADIO.get_value(RADIO_PARAM_CHANNEL, &channel) != RADIO_RESULT_OK) {
+    channel = 0;
+  }
+  a = &csma_airtime[channel % CSMA_AIRTIME_CHANNELS];
+
+  read_energest(&transmit, &listen, &cpu);
+
+  a->transmit += transmit - last_transmit;
+  a->listen += listen - last_listen;
+  a->elapsed += cpu - last_cpu;
+
+  last_transmit = transmit;
+  last_listen = listen;
+  last_cpu = cpu;
+}
+#endif /* CSMA_WITH_AIRTIME */
+/*---------------------------------------------------------------------------*/
+/* Tell if some packets of the queue are still with the RDC layer */
+static int
+queue_in_flight(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q;
+
+  for(q = list_head(n->queued_packet_list); q != NULL; q = list_item_next(q)) {
+    if(((struct qbuf_metadata *)q->ptr)->in_flight) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+schedule_transmission(struct neighbor_queue *n, clock_time_t time)
+{
+#if CSMA_WITH_PRIORITY
+  timer_set(&n->due_timer, time);
+#endif /* CSMA_WITH_PRIORITY */
+  ctimer_set(&n->transmit_timer, time, transmit_packet_list, n);
+}
+/*---------------------------------------------------------------------------*/
+#if CSMA_WITH_PRIORITY
+static uint8_t
+head_priority(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q = list_head(n->queued_packet_list);
+  if(q == NULL || q->ptr == NULL) {
+    return PACKETBUF_ATTR_PRIORITY_BULK;
+  }
+  return ((struct qbuf_metadata *)q->ptr)->priority;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the neighbor queue that should transmit now: the one with
+   the most urgent head packet among all queues that are due. Ties are
+   resolved in favor of n, the queue whose timer fired. */
+static struct neighbor_queue *
+select_neighbor_queue(struct neighbor_queue *n)
+{
+  struct neighbor_queue *best = n;
+  struct neighbor_queue *m;
+
+  for(m = list_head(neighbor_list); m != NULL; m = list_item_next(m)) {
+    if(m != best && timer_expired(&m->due_timer) &&
+       list_head(m->queued_packet_list) != NULL && !queue_in_flight(m) &&
+       head_priority(m) > head_priority(best)) {
+      best = m;
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_priority_stats(struct qbuf_metadata *metadata)
+{
+  struct csma_priority_stats *stats = &csma_priority_stats[metadata->priority];
+  clock_time_t delay = clock_time() - metadata->enqueued;
+
+  stats->packets++;
+  stats->delay_sum += delay;
+  if(delay > stats->delay_max) {
+    stats->delay_max = delay;
+  }
+}
+#endif /* CSMA_WITH_PRIORITY */
+/*---------------------------------------------------------------------------*/
 static void
 transmit_packet_list(void *ptr)
 {
   struct neighbor_queue *n = ptr;
+#if CSMA_WITH_PRIORITY
+  if(n) {
+    n = select_neighbor_queue(n);
+    if(n != ptr) {
+      /* Let the more urgent queue go first, and come back right after */
+      PRINTF("csma: priority %d queue preempts %d\n",
+             head_priority(n), head_priority(ptr));
+      ctimer_stop(&n->transmit_timer);
+      schedule_transmission(ptr, 0);
+    }
+  }
+#endif /* CSMA_WITH_PRIORITY */
   if(n) {
     struct rdc_buf_list *q = list_head(n->queued_packet_list);
-    if(q != NULL) {
+    struct rdc_buf_list *p;
+    /* A queue is not sent again until the RDC layer has reported on
+       all the packets it was handed; packet_sent() then reschedules
+       it */
+    if(q != NULL && !queue_in_flight(n)) {
       PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
           list_length(n->queued_packet_list));
+      for(p = q; p != NULL; p = list_item_next(p)) {
+        ((struct qbuf_metadata *)p->ptr)->in_flight = 1;
+      }
+      sending_queue = n;
+      after_last_report = NULL;
       /* Send packets in the neighbor's list */
       NETSTACK_RDC.send_list(packet_sent, n, q);
+      if(sending_queue != NULL) {
+        /* The RDC layer stops at the first packet it reports a failure
+           for, and the packets after it were not handed over */
+        for(p = after_last_report; p != NULL; p = list_item_next(p)) {
+          ((struct qbuf_metadata *)p->ptr)->in_flight = 0;
+        }
+      }
+      sending_queue = NULL;
     }
   }
 }
@@ -178,6 +332,9 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
     list_remove(n->queued_packet_list, p);
 
     queuebuf_free(p->buf);
+#if CSMA_WITH_PRIORITY
+    update_priority_stats(p->ptr);
+#endif /* CSMA_WITH_PRIORITY */
     memb_free(&metadata_memb, p->ptr);
     memb_free(&packet_memb, p);
     PRINTF("csma: free_queued_packet, queue length %d, free packets %d\n",
@@ -188,10 +345,12 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
       n->collisions = 0;
       n->deferrals = 0;
       /* Set a timer for next transmissions */
-      ctimer_set(&n->transmit_timer, default_timebase(),
-                 transmit_packet_list, n);
+      schedule_transmission(n, default_timebase());
     } else {
       /* This was the last packet in the queue, we free the neighbor */
+      if(n == sending_queue) {
+        sending_queue = NULL;
+      }
       ctimer_stop(&n->transmit_timer);
       list_remove(neighbor_list, n);
       memb_free(&neighbor_memb, n);
@@ -209,13 +368,17 @@ packet_sent(void *ptr, int status, int num_transmissions)
   mac_callback_t sent;
   void *cptr;
   int num_tx;
-  int backoff_exponent;
-  int backoff_transmissions;
 
   n = ptr;
   if(n == NULL) {
     return;
   }
+
+  CSMA_BACKOFF_POLICY.tx_done(status, num_transmissions);
+#if CSMA_WITH_AIRTIME
+  update_airtime();
+#endif /* CSMA_WITH_AIRTIME */
+
   switch(status) {
   case MAC_TX_OK:
   case MAC_TX_NOACK:
@@ -240,8 +403,12 @@ packet_sent(void *ptr, int status, int num_transmissions)
 
   if(q != NULL) {
     metadata = (struct qbuf_metadata *)q->ptr;
+    if(n == sending_queue) {
+      after_last_report = list_item_next(q);
+    }
 
     if(metadata != NULL) {
+      metadata->in_flight = 0;
       sent = metadata->sent;
       cptr = metadata->cptr;
       num_tx = n->transmissions;
@@ -263,30 +430,14 @@ packet_sent(void *ptr, int status, int num_transmissions)
         }
 
         /* The retransmission time must be proportional to the channel
-           check interval of the underlying radio duty cycling layer. */
-        time = default_timebase();
-
-        /* The retransmission time uses a truncated exponential backoff
-         * so that the interval between the transmissions increase with
-         * each retransmit. */
-        backoff_exponent = num_tx;
-
-        /* Truncate the exponent if needed. */
-        if(backoff_exponent > CSMA_MAX_BACKOFF_EXPONENT) {
-          backoff_exponent = CSMA_MAX_BACKOFF_EXPONENT;
-        }
-
-        /* Proceed to exponentiation. */
-        backoff_transmissions = 1 << backoff_exponent;
-
-        /* Pick a time for next transmission, within the interval:
-         * [time, time + 2^backoff_exponent * time[ */
-        time = time + (random_rand() % (backoff_transmissions * time));
+           check interval of the underlying radio duty cycling layer.
+           The backoff policy picks the time within a window that
+           grows with the number of transmissions. */
+        time = CSMA_BACKOFF_POLICY.backoff(default_timebase(), num_tx);
 
         if(n->transmissions < metadata->max_transmissions) {
           PRINTF("csma: retransmitting with time %lu %p\n", time, q);
-          ctimer_set(&n->transmit_timer, time,
-                     transmit_packet_list, n);
+          schedule_transmission(n, time);
           /* This is needed to correctly attribute energy that we spent
              transmitting this packet. */
           queuebuf_update_attr_from_packetbuf(q->buf);
@@ -313,6 +464,33 @@ packet_sent(void *ptr, int status, int num_transmissions)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if CSMA_WITH_PRIORITY
+/* Queue q behind all packets of the same or a more urgent class. The
+   head of the queue may already be under transmission and is never
+   preempted, so the whole queue can still be handed to the RDC as one
+   burst. */
+static void
+insert_by_priority(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+  struct rdc_buf_list *prev;
+  struct rdc_buf_list *next;
+  uint8_t priority = ((struct qbuf_metadata *)q->ptr)->priority;
+
+  prev = list_head(n->queued_packet_list);
+  if(prev == NULL) {
+    list_add(n->queued_packet_list, q);
+    return;
+  }
+  for(next = list_item_next(prev); next != NULL; next = list_item_next(next)) {
+    if(((struct qbuf_metadata *)next->ptr)->priority < priority) {
+      break;
+    }
+    prev = next;
+  }
+  list_insert(n->queued_packet_list, prev, q);
+}
+#endif /* CSMA_WITH_PRIORITY */
+/*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
@@ -373,6 +551,22 @@ send_packet(mac_callback_t sent, void *ptr)
             }
             metadata->sent = sent;
             metadata->cptr = ptr;
+            metadata->in_flight = 0;
+#if CSMA_WITH_PRIORITY
+            metadata->priority = packetbuf_attr(PACKETBUF_ATTR_PRIORITY);
+            if(metadata->priority >= PACKETBUF_ATTR_PRIORITY_CLASSES) {
+              metadata->priority = PACKETBUF_ATTR_PRIORITY_CONTROL;
+            }
+#if PACKETBUF_WITH_PACKET_TYPE
+            if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
+               PACKETBUF_ATTR_PACKET_TYPE_ACK &&
+               metadata->priority < PACKETBUF_ATTR_PRIORITY_ACK) {
+              metadata->priority = PACKETBUF_ATTR_PRIORITY_ACK;
+            }
+#endif /* PACKETBUF_WITH_PACKET_TYPE */
+            metadata->enqueued = clock_time();
+            insert_by_priority(n, q);
+#else /* CSMA_WITH_PRIORITY */
 #if PACKETBUF_WITH_PACKET_TYPE
             if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
                PACKETBUF_ATTR_PACKET_TYPE_ACK) {
@@ -382,12 +576,13 @@ send_packet(mac_callback_t sent, void *ptr)
             {
               list_add(n->queued_packet_list, q);
             }
+#endif /* CSMA_WITH_PRIORITY */
 
             PRINTF("csma: send_packet, queue length %d, free packets %d\n",
                    list_length(n->queued_packet_list), memb_numfree(&packet_memb));
             /* If q is the first packet in the neighbor's queue, send asap */
             if(list_head(n->queued_packet_list) == q) {
-              ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
+              schedule_transmission(n, 0);
             }
             return;
           }
@@ -445,6 +640,15 @@ init(void)
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
   memb_init(&neighbor_memb);
+  CSMA_BACKOFF_POLICY.init();
+#if CSMA_WITH_AIRTIME
+  memset(csma_airtime, 0, sizeof(csma_airtime));
+  /* Only the time from now on is charged to a channel */
+  read_energest(&last_transmit, &last_listen, &last_cpu);
+#endif /* CSMA_WITH_AIRTIME */
+#if CSMA_WITH_PRIORITY
+  memset(csma_priority_stats, 0, sizeof(csma_priority_stats));
+#endif /* CSMA_WITH_PRIORITY */
 }
 /*---------------------------------------------------------------------------*/
 const struct mac_driver csma_driver = {
@@ -42,8 +42,67 @@
 #define CSMA_H_
 
 #include "net/mac/mac.h"
+#include "net/packetbuf.h"
 #include "dev/radio.h"
 
+/**
+ * When enabled, CSMA orders each neighbor queue by the
+ * PACKETBUF_ATTR_PRIORITY class of its packets (control before
+ * ACK-sensitive before bulk), and lets the neighbor queue with the most
+ * urgent head packet transmit first.
+ */
+#ifdef CSMA_CONF_WITH_PRIORITY
+#define CSMA_WITH_PRIORITY CSMA_CONF_WITH_PRIORITY
+#else /* CSMA_CONF_WITH_PRIORITY */
+#define CSMA_WITH_PRIORITY 0
+#endif /* CSMA_CONF_WITH_PRIORITY */
+
+#if CSMA_WITH_PRIORITY && !PACKETBUF_WITH_PRIORITY
+#error "CSMA_CONF_WITH_PRIORITY needs PACKETBUF_CONF_WITH_PRIORITY"
+#endif
+
+#if CSMA_WITH_PRIORITY
+/* Queueing delay statistics, per priority class. Delays are measured
+   from enqueueing until the packet leaves the queue, in clock ticks. */
+struct csma_priority_stats {
+  uint32_t packets;
+  uint32_t delay_sum;
+  clock_time_t delay_max;
+};
+
+extern struct csma_priority_stats csma_priority_stats[PACKETBUF_ATTR_PRIORITY_CLASSES];
+#endif /* CSMA_WITH_PRIORITY */
+
+/**
+ * When enabled, CSMA charges the radio transmit and listen time
+ * measured by energest to the channel the radio is on. Requires
+ * ENERGEST_CONF_ON.
+ */
+#ifdef CSMA_CONF_WITH_AIRTIME
+#define CSMA_WITH_AIRTIME CSMA_CONF_WITH_AIRTIME
+#else /* CSMA_CONF_WITH_AIRTIME */
+#define CSMA_WITH_AIRTIME 0
+#endif /* CSMA_CONF_WITH_AIRTIME */
+
+#ifdef CSMA_CONF_AIRTIME_CHANNELS
+#define CSMA_AIRTIME_CHANNELS CSMA_CONF_AIRTIME_CHANNELS
+#else /* CSMA_CONF_AIRTIME_CHANNELS */
+#define CSMA_AIRTIME_CHANNELS 16
+#endif /* CSMA_CONF_AIRTIME_CHANNELS */
+
+#if CSMA_WITH_AIRTIME
+/* Radio time per channel, in rtimer ticks. The duty cycle of a
+   channel is (transmit + listen) / elapsed. Channel c is accounted
+   in entry c % CSMA_AIRTIME_CHANNELS. */
+struct csma_airtime {
+  uint32_t transmit;
+  uint32_t listen;
+  uint32_t elapsed;
+};
+
+extern struct csma_airtime csma_airtime[CSMA_AIRTIME_CHANNELS];
+#endif /* CSMA_WITH_AIRTIME */
+
 extern const struct mac_driver csma_driver;
 
 const struct mac_driver *csma_init(const struct mac_driver *r);
@@ -50,15 +50,59 @@
 #define PHASE_DRIFT_CORRECT 0
 #endif
 
+/* Store the learned drift of each neighbor in CFS, so that it is
+   known again right after a reboot. The phases themselves cannot be
+   kept, since they are relative to our rtimer, which restarts when
+   we reboot. */
+#ifdef PHASE_CONF_PERSISTENT
+#define PHASE_PERSISTENT (PHASE_CONF_PERSISTENT && PHASE_DRIFT_CORRECT)
+#else
+#define PHASE_PERSISTENT 0
+#endif
+
+#if PHASE_PERSISTENT
+#include "cfs/cfs.h"
+
+#ifdef PHASE_CONF_PERSISTENT_FILENAME
+#define PHASE_PERSISTENT_FILENAME PHASE_CONF_PERSISTENT_FILENAME
+#else
+#define PHASE_PERSISTENT_FILENAME "phase"
+#endif
+
+#ifdef PHASE_CONF_PERSISTENT_INTERVAL
+#define PHASE_PERSISTENT_INTERVAL PHASE_CONF_PERSISTENT_INTERVAL
+#else
+#define PHASE_PERSISTENT_INTERVAL (CLOCK_SECOND * 60 * 10)
+#endif
+#endif /* PHASE_PERSISTENT */
+
+/* The drift is kept in fractions of rtimer ticks per cycle */
+#define DRIFT_SCALE           256
+
 struct phase {
   rtimer_clock_t time;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  /* The clock time at which the phase was recorded, to tell how many
+     cycles have passed even when the rtimer has wrapped */
+  clock_time_t clock_time;
+  /* Estimated drift of the neighbor's wake-ups, in 1/DRIFT_SCALE
+     rtimer ticks per cycle */
+  int32_t drift;
+  uint8_t drift_samples;
 #endif
   uint8_t noacks;
   struct timer noacks_timer;
 };
 
+#if PHASE_PERSISTENT
+struct phase_record {
+  linkaddr_t addr;
+  int32_t drift;
+};
+
+static struct ctimer persist_timer;
+#endif /* PHASE_PERSISTENT */
+
 struct phase_queueitem {
   struct ctimer timer;
   mac_callback_t mac_callback;
@@ -87,9 +131,110 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+/* The number of whole cycles since the phase of e was recorded */
+static uint32_t
+cycles_since(struct phase *e, rtimer_clock_t cycle_time)
+{
+  clock_time_t diff;
+  uint32_t elapsed;
+
+  /* Convert to rtimer ticks in two steps to avoid overflow */
+  diff = clock_time() - e->clock_time;
+  elapsed = (uint32_t)(diff / CLOCK_SECOND) * RTIMER_ARCH_SECOND +
+    (uint32_t)(diff % CLOCK_SECOND) * RTIMER_ARCH_SECOND / CLOCK_SECOND;
+  return (elapsed + cycle_time / 2) / cycle_time;
+}
+/*---------------------------------------------------------------------------*/
+/* Estimate how much the wake-up of the neighbor moved per cycle since
+   its last recorded phase, and fold it into the drift estimate. */
+static void
+update_drift(struct phase *e, rtimer_clock_t time, rtimer_clock_t cycle_time)
+{
+  uint32_t cycles;
+  rtimer_clock_t diff;
+  int32_t offset;
+  int32_t sample;
+
+  cycles = cycles_since(e, cycle_time);
+  if(cycles == 0) {
+    return;
+  }
+
+  /* The offset of the new phase from the predicted one, as a signed
+     number of rtimer ticks */
+  diff = time - e->time - (rtimer_clock_t)(cycles * cycle_time);
+  if(diff < (rtimer_clock_t)~0 / 2) {
+    offset = (int32_t)diff;
+  } else {
+    offset = -(int32_t)(rtimer_clock_t)-diff;
+  }
+  if(offset > (int32_t)cycle_time / 2 || -offset > (int32_t)cycle_time / 2) {
+    /* Most likely not the same phase, e.g. the neighbor has rebooted */
+    return;
+  }
+
+  sample = offset * DRIFT_SCALE / (int32_t)cycles;
+  if(e->drift_samples == 0) {
+    e->drift = sample;
+  } else {
+    e->drift = (e->drift * 3 + sample) / 4;
+  }
+  if(e->drift_samples < 0xff) {
+    e->drift_samples++;
+  }
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
+#if PHASE_PERSISTENT
+static int32_t
+persisted_drift(const linkaddr_t *neighbor)
+{
+  struct phase_record r;
+  int fd;
+
+  fd = cfs_open(PHASE_PERSISTENT_FILENAME, CFS_READ);
+  if(fd < 0) {
+    return 0;
+  }
+  while(cfs_read(fd, &r, sizeof(r)) == sizeof(r)) {
+    if(linkaddr_cmp(&r.addr, neighbor)) {
+      cfs_close(fd);
+      return r.drift;
+    }
+  }
+  cfs_close(fd);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+persist(void *ptr)
+{
+  struct phase_record r;
+  struct phase *e;
+  int fd;
+
+  cfs_remove(PHASE_PERSISTENT_FILENAME);
+  fd = cfs_open(PHASE_PERSISTENT_FILENAME, CFS_WRITE);
+  if(fd >= 0) {
+    for(e = nbr_table_head(nbr_phase); e != NULL; e = nbr_table_next(nbr_phase, e)) {
+      if(e->drift_samples > 0) {
+        linkaddr_copy(&r.addr, nbr_table_get_lladdr(nbr_phase, e));
+        r.drift = e->drift;
+        if(cfs_write(fd, &r, sizeof(r)) != sizeof(r)) {
+          break;
+        }
+      }
+    }
+    cfs_close(fd);
+  }
+  ctimer_set(&persist_timer, PHASE_PERSISTENT_INTERVAL, persist, NULL);
+}
+#endif /* PHASE_PERSISTENT */
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
-             int mac_status)
+             rtimer_clock_t cycle_time, int mac_status)
 {
   struct phase *e;
 
@@ -98,7 +243,8 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
 #if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
+      update_drift(e, time, cycle_time);
+      e->clock_time = clock_time();
 #endif
       e->time = time;
     }
@@ -126,9 +272,15 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
       if(e) {
         e->time = time;
 #if PHASE_DRIFT_CORRECT
-      e->drift = 0;
+        e->clock_time = clock_time();
+#if PHASE_PERSISTENT
+        e->drift = persisted_drift(neighbor);
+#else /* PHASE_PERSISTENT */
+        e->drift = 0;
+#endif /* PHASE_PERSISTENT */
+        e->drift_samples = e->drift != 0;
 #endif
-      e->noacks = 0;
+        e->noacks = 0;
       }
     }
   }
@@ -186,14 +338,11 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
     sync = (e == NULL) ? now : e->time;
 
 #if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
+    /* Move the phase by the drift accumulated since it was recorded.
+       Only the shift within a cycle matters; the product is computed
+       in 64 bits as it overflows for neighbors idle for long. */
+    sync += (rtimer_clock_t)((int64_t)cycles_since(e, cycle_time) *
+                             e->drift / DRIFT_SCALE % cycle_time);
 #endif
 
     /* Check if cycle_time is a power of two */
@@ -243,5 +392,8 @@ phase_init(void)
 {
   memb_init(&queued_packets_memb);
   nbr_table_register(nbr_phase, NULL);
+#if PHASE_PERSISTENT
+  ctimer_set(&persist_timer, PHASE_PERSISTENT_INTERVAL, persist, NULL);
+#endif /* PHASE_PERSISTENT */
 }
 /*---------------------------------------------------------------------------*/
@@ -60,7 +60,8 @@ phase_status_t phase_wait(const linkaddr_t *neighbor,
                           mac_callback_t mac_callback, void *mac_callback_ptr,
                           struct rdc_buf_list *buf_list);
 void phase_update(const linkaddr_t *neighbor,
-                  rtimer_clock_t time, int mac_status);
+                  rtimer_clock_t time, rtimer_clock_t cycle_time,
+                  int mac_status);
 void phase_remove(const linkaddr_t *neighbor);
 
 #endif /* PHASE_H */
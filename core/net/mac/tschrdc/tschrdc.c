@@ -0,0 +1,978 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A time-slotted channel hopping (TSCH) radio duty cycling
+ *         layer. Time is divided into slots that repeat in a
+ *         slotframe. A small cell table tells, for each timeslot, on
+ *         which channel offset the node transmits or listens, and to
+ *         which neighbor. The channel of a cell changes from one
+ *         slotframe to the next, following a hopping sequence.
+ *
+ *         The coordinator defines the slot timing and advertises the
+ *         absolute slot number (ASN) in Enhanced Beacons. Other nodes
+ *         scan until they hear a beacon, synchronize to its sender,
+ *         and keep synchronized on subsequent beacons from it.
+ *
+ *         Once synchronized, the slot operation reads all frames
+ *         itself and acknowledges them within the timeslot. The
+ *         radio needs to support RADIO_RX_MODE_POLL_MODE and
+ *         RADIO_PARAM_LAST_PACKET_TIMESTAMP for this.
+ */
+
+#include "contiki.h"
+#include "net/mac/tschrdc/tschrdc.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/mac-sequence.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "sys/rtimer.h"
+#include "sys/pt.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* The duration of a timeslot, in rtimer ticks */
+#ifdef TSCHRDC_CONF_SLOT_DURATION
+#define TSCHRDC_SLOT_DURATION TSCHRDC_CONF_SLOT_DURATION
+#else
+#define TSCHRDC_SLOT_DURATION (RTIMER_ARCH_SECOND / 100)
+#endif
+
+/* The number of timeslots in a slotframe */
+#ifdef TSCHRDC_CONF_SLOTFRAME_LENGTH
+#define TSCHRDC_SLOTFRAME_LENGTH TSCHRDC_CONF_SLOTFRAME_LENGTH
+#else
+#define TSCHRDC_SLOTFRAME_LENGTH 7
+#endif
+
+/* The time from the start of a timeslot to the start of a
+   transmission, in rtimer ticks */
+#ifdef TSCHRDC_CONF_TX_OFFSET
+#define TSCHRDC_TX_OFFSET TSCHRDC_CONF_TX_OFFSET
+#else
+#define TSCHRDC_TX_OFFSET (RTIMER_ARCH_SECOND / 1000)
+#endif
+
+/* The time to wait for an acknowledgement after a transmission */
+#ifdef TSCHRDC_CONF_ACK_WAIT_TIME
+#define TSCHRDC_ACK_WAIT_TIME TSCHRDC_CONF_ACK_WAIT_TIME
+#else
+#define TSCHRDC_ACK_WAIT_TIME (RTIMER_ARCH_SECOND / 250)
+#endif
+
+/* How long a receiving node listens for a frame in a reception
+   cell, from the transmission offset. Covers the longest frame. */
+#ifdef TSCHRDC_CONF_RX_WAIT
+#define TSCHRDC_RX_WAIT TSCHRDC_CONF_RX_WAIT
+#else
+#define TSCHRDC_RX_WAIT (RTIMER_ARCH_SECOND / 200)
+#endif
+
+/* The delay from the start of a transmission to the SFD timestamp
+   the receiving radio stores in PACKETBUF_ATTR_TIMESTAMP. Used when
+   synchronizing. */
+#ifdef TSCHRDC_CONF_RX_DELAY
+#define TSCHRDC_RX_DELAY TSCHRDC_CONF_RX_DELAY
+#else
+#define TSCHRDC_RX_DELAY 0
+#endif
+
+/* The channel hopping sequence */
+#ifdef TSCHRDC_CONF_HOPPING_SEQUENCE
+#define TSCHRDC_HOPPING_SEQUENCE TSCHRDC_CONF_HOPPING_SEQUENCE
+#else
+#define TSCHRDC_HOPPING_SEQUENCE { 15, 25, 26, 20 }
+#endif
+
+/* The maximum number of cells in the slotframe */
+#ifdef TSCHRDC_CONF_MAX_CELLS
+#define TSCHRDC_MAX_CELLS TSCHRDC_CONF_MAX_CELLS
+#else
+#define TSCHRDC_MAX_CELLS 4
+#endif
+
+/* The number of frames that can wait for a cell */
+#ifdef TSCHRDC_CONF_QUEUE_SIZE
+#define TSCHRDC_QUEUE_SIZE TSCHRDC_CONF_QUEUE_SIZE
+#else
+#define TSCHRDC_QUEUE_SIZE 4
+#endif
+
+/* The number of received frames that can wait for the process */
+#ifdef TSCHRDC_CONF_INPUT_QUEUE_SIZE
+#define TSCHRDC_INPUT_QUEUE_SIZE TSCHRDC_CONF_INPUT_QUEUE_SIZE
+#else
+#define TSCHRDC_INPUT_QUEUE_SIZE 2
+#endif
+
+/* The period of Enhanced Beacons */
+#ifdef TSCHRDC_CONF_EB_PERIOD
+#define TSCHRDC_EB_PERIOD TSCHRDC_CONF_EB_PERIOD
+#else
+#define TSCHRDC_EB_PERIOD (4 * CLOCK_SECOND)
+#endif
+
+/* The time spent listening on each channel while scanning */
+#ifdef TSCHRDC_CONF_SCAN_PERIOD
+#define TSCHRDC_SCAN_PERIOD TSCHRDC_CONF_SCAN_PERIOD
+#else
+#define TSCHRDC_SCAN_PERIOD (CLOCK_SECOND / 2)
+#endif
+
+/* Without beacons from the time source for this long, the node is
+   considered desynchronized and starts scanning again */
+#ifdef TSCHRDC_CONF_DESYNC_TIMEOUT
+#define TSCHRDC_DESYNC_TIMEOUT TSCHRDC_CONF_DESYNC_TIMEOUT
+#else
+#define TSCHRDC_DESYNC_TIMEOUT (4 * TSCHRDC_EB_PERIOD)
+#endif
+
+/* Install a single shared cell for transmission, reception and
+   beacons at timeslot 0, channel offset 0 */
+#ifdef TSCHRDC_CONF_WITH_MINIMAL_SCHEDULE
+#define TSCHRDC_WITH_MINIMAL_SCHEDULE TSCHRDC_CONF_WITH_MINIMAL_SCHEDULE
+#else
+#define TSCHRDC_WITH_MINIMAL_SCHEDULE 1
+#endif
+
+#define ACK_LEN 3
+
+/* How often the radio is checked for a frame in a reception cell */
+#define RX_POLL_INTERVAL (RTIMER_ARCH_SECOND / 2000 + 1)
+
+/* Enhanced Beacon payload: an MLME payload IE holding the TSCH
+   Synchronization sub-IE, i.e., the ASN (5 bytes) and the join
+   priority (1 byte). */
+#define EB_PAYLOAD_LEN          10
+#define EB_ASN_OFFSET           4
+#define EB_JOIN_PRIORITY_OFFSET 9
+static const uint8_t eb_ie_header[EB_ASN_OFFSET] = {
+  /* Payload IE: length 8, group MLME, type payload */
+  0x08, 0x88,
+  /* Short MLME sub-IE: length 6, TSCH Synchronization */
+  0x06, 0x1a
+};
+
+struct cell {
+  linkaddr_t neighbor;
+  uint16_t timeslot;
+  uint8_t channel_offset;
+  uint8_t options;
+};
+
+enum {
+  PACKET_FREE,
+  PACKET_QUEUED,
+  PACKET_DONE
+};
+
+struct tx_packet {
+  volatile uint8_t state;
+  uint8_t len;
+  uint8_t seqno;
+  uint8_t status;
+  uint16_t order;
+  linkaddr_t receiver;
+  mac_callback_t sent;
+  void *ptr;
+  uint8_t frame[PACKETBUF_SIZE];
+};
+
+/* A frame received in the slot operation, for the process */
+struct rx_packet {
+  volatile uint8_t len;
+  uint16_t timestamp;
+  uint8_t frame[PACKETBUF_SIZE];
+};
+
+static const uint8_t hopping_sequence[] = TSCHRDC_HOPPING_SEQUENCE;
+
+static struct cell cells[TSCHRDC_MAX_CELLS];
+static struct tx_packet queue[TSCHRDC_QUEUE_SIZE];
+static struct tx_packet eb;
+static struct rx_packet input_queue[TSCHRDC_INPUT_QUEUE_SIZE];
+static uint8_t eb_asn_offset;
+static uint16_t next_order;
+
+static struct rtimer rt;
+static struct pt slot_pt;
+
+/* The slot currently scheduled, and its start time */
+static volatile uint32_t asn;
+static volatile rtimer_clock_t slot_start;
+/* A pending correction of the slot timing, from the time source */
+static volatile rtimer_clock_t sync_correction;
+
+static volatile uint8_t tschrdc_is_on;
+static volatile uint8_t associated;
+static uint8_t is_coordinator;
+static uint8_t join_priority;
+static linkaddr_t time_source;
+static struct timer desync_timer;
+static uint8_t scan_index;
+
+static volatile uint8_t waiting_for_ack;
+static volatile uint8_t ack_received;
+static uint8_t ack_seqno;
+
+/* The cell and packet of the current slot */
+static struct cell *current_cell;
+static struct tx_packet *current_packet;
+
+PROCESS(tschrdc_process, "TSCH RDC process");
+
+static char slot_operation(struct rtimer *t, void *ptr);
+static int on(void);
+static int off(int keep_radio_on);
+
+/*---------------------------------------------------------------------------*/
+static void
+schedule_slot(struct rtimer *t, rtimer_clock_t time)
+{
+  if(RTIMER_CLOCK_LT(time, RTIMER_NOW() + 2)) {
+    time = RTIMER_NOW() + 2;
+  }
+  if(rtimer_set(t, time, 1,
+                (void (*)(struct rtimer *, void *))slot_operation,
+                NULL) != RTIMER_OK) {
+    PRINTF("tschrdc: could not set rtimer\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+packet_matches_cell(struct tx_packet *p, struct cell *c)
+{
+  return linkaddr_cmp(&c->neighbor, &linkaddr_null) ||
+    linkaddr_cmp(&c->neighbor, &p->receiver);
+}
+/*---------------------------------------------------------------------------*/
+/* Pick the cell to use in the current timeslot, and the packet to send
+   in it, if any. Transmissions take precedence over reception. */
+static void
+select_cell(uint16_t timeslot)
+{
+  struct cell *c;
+  struct tx_packet *p;
+  int i;
+
+  current_cell = NULL;
+  current_packet = NULL;
+
+  for(c = cells; c < &cells[TSCHRDC_MAX_CELLS]; c++) {
+    if(c->options == 0 || c->timeslot != timeslot) {
+      continue;
+    }
+    if(c->options & TSCHRDC_CELL_TX) {
+      if((c->options & TSCHRDC_CELL_ADV) && eb.state == PACKET_QUEUED) {
+        current_cell = c;
+        current_packet = &eb;
+        return;
+      }
+      for(i = 0; i < TSCHRDC_QUEUE_SIZE; i++) {
+        p = &queue[i];
+        if(p->state == PACKET_QUEUED && packet_matches_cell(p, c) &&
+           (current_packet == NULL ||
+            (int16_t)(p->order - current_packet->order) < 0)) {
+          current_cell = c;
+          current_packet = p;
+        }
+      }
+      if(current_packet != NULL) {
+        return;
+      }
+    }
+    if(current_cell == NULL && (c->options & TSCHRDC_CELL_RX)) {
+      current_cell = c;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_asn(uint8_t *buf, uint32_t n)
+{
+  buf[0] = n & 0xff;
+  buf[1] = (n >> 8) & 0xff;
+  buf[2] = (n >> 16) & 0xff;
+  buf[3] = (n >> 24) & 0xff;
+  /* The most significant byte of the 5-byte ASN */
+  buf[4] = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+read_asn(const uint8_t *buf)
+{
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+    ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+/*---------------------------------------------------------------------------*/
+/* Read the frame received in a reception cell, and acknowledge it
+   right away if it is a data frame for us that asks for it. The
+   frame is then left for the process to pass up the stack. Run from
+   rtimer context. */
+static void
+slot_input(void)
+{
+  struct rx_packet *in;
+  uint8_t ackdata[ACK_LEN];
+  frame802154_t info154;
+  rtimer_clock_t timestamp;
+  int len;
+  int i;
+
+  for(in = NULL, i = 0; i < TSCHRDC_INPUT_QUEUE_SIZE; i++) {
+    if(input_queue[i].len == 0) {
+      in = &input_queue[i];
+      break;
+    }
+  }
+  if(in == NULL) {
+    /* Flushed by reading it into a buffer too small for it. Not
+       acknowledged, so the sender tries again later. */
+    NETSTACK_RADIO.read(ackdata, sizeof(ackdata));
+    return;
+  }
+
+  len = NETSTACK_RADIO.read(in->frame, sizeof(in->frame));
+  if(len <= ACK_LEN) {
+    return;
+  }
+  if(NETSTACK_RADIO.get_object(RADIO_PARAM_LAST_PACKET_TIMESTAMP,
+                               &timestamp, sizeof(timestamp)) != RADIO_RESULT_OK) {
+    /* Dated to when the frame is processed */
+    timestamp = 0;
+  }
+
+  if(frame802154_parse(in->frame, len, &info154) &&
+     info154.fcf.frame_type == FRAME802154_DATAFRAME &&
+     info154.fcf.ack_required != 0 &&
+     info154.fcf.dest_addr_mode != 0 &&
+     linkaddr_cmp((linkaddr_t *)&info154.dest_addr, &linkaddr_node_addr)) {
+    ackdata[0] = FRAME802154_ACKFRAME;
+    ackdata[1] = 0;
+    ackdata[2] = info154.seq;
+    NETSTACK_RADIO.send(ackdata, ACK_LEN);
+  }
+
+  in->timestamp = (uint16_t)timestamp;
+  in->len = len;
+  process_poll(&tschrdc_process);
+}
+/*---------------------------------------------------------------------------*/
+/* Run at the start of each timeslot, from rtimer context */
+static char
+slot_operation(struct rtimer *t, void *ptr)
+{
+  static uint8_t status;
+  uint8_t ackbuf[ACK_LEN];
+  int ret;
+
+  PT_BEGIN(&slot_pt);
+
+  while(tschrdc_is_on && associated) {
+    select_cell(asn % TSCHRDC_SLOTFRAME_LENGTH);
+
+    if(current_cell == NULL) {
+      NETSTACK_RADIO.off();
+    } else {
+      NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL,
+                               hopping_sequence[(asn + current_cell->channel_offset) %
+                                                sizeof(hopping_sequence)]);
+      if(current_packet != NULL) {
+        NETSTACK_RADIO.off();
+        if(current_packet == &eb) {
+          write_asn(&eb.frame[eb_asn_offset], asn);
+        }
+        NETSTACK_RADIO.prepare(current_packet->frame, current_packet->len);
+
+        schedule_slot(t, slot_start + TSCHRDC_TX_OFFSET);
+        PT_YIELD(&slot_pt);
+
+        ret = NETSTACK_RADIO.transmit(current_packet->len);
+        if(ret == RADIO_TX_OK) {
+          if(linkaddr_cmp(&current_packet->receiver, &linkaddr_null)) {
+            status = MAC_TX_OK;
+          } else {
+            ack_seqno = current_packet->seqno;
+            ack_received = 0;
+            waiting_for_ack = 1;
+            NETSTACK_RADIO.on();
+
+            schedule_slot(t, RTIMER_NOW() + TSCHRDC_ACK_WAIT_TIME);
+            PT_YIELD(&slot_pt);
+
+            status = MAC_TX_NOACK;
+            if(!ack_received && NETSTACK_RADIO.pending_packet()) {
+              if(NETSTACK_RADIO.read(ackbuf, ACK_LEN) == ACK_LEN &&
+                 ackbuf[0] == FRAME802154_ACKFRAME &&
+                 ackbuf[2] == current_packet->seqno) {
+                ack_received = 1;
+              } else {
+                status = MAC_TX_COLLISION;
+              }
+            }
+            if(ack_received) {
+              status = MAC_TX_OK;
+            }
+            waiting_for_ack = 0;
+            NETSTACK_RADIO.off();
+          }
+        } else if(ret == RADIO_TX_COLLISION) {
+          status = MAC_TX_COLLISION;
+        } else {
+          status = MAC_TX_ERR;
+        }
+
+        if(current_packet == &eb) {
+          eb.state = PACKET_FREE;
+        } else {
+          current_packet->status = status;
+          current_packet->state = PACKET_DONE;
+          process_poll(&tschrdc_process);
+        }
+      } else if(current_cell->options & TSCHRDC_CELL_RX) {
+        /* Listen until a frame has been received, or until the
+           longest frame sent at the transmission offset would have
+           been. The ACK then goes out within the sender's ACK wait. */
+        NETSTACK_RADIO.on();
+        while(!NETSTACK_RADIO.pending_packet() &&
+              RTIMER_CLOCK_LT(RTIMER_NOW(),
+                              slot_start + TSCHRDC_TX_OFFSET + TSCHRDC_RX_WAIT)) {
+          schedule_slot(t, RTIMER_NOW() + RX_POLL_INTERVAL);
+          PT_YIELD(&slot_pt);
+        }
+        if(NETSTACK_RADIO.pending_packet()) {
+          slot_input();
+        }
+        NETSTACK_RADIO.off();
+      } else {
+        NETSTACK_RADIO.off();
+      }
+    }
+
+    /* Move on to the next timeslot, skipping any we are too late for */
+    do {
+      asn++;
+      slot_start += TSCHRDC_SLOT_DURATION;
+    } while(RTIMER_CLOCK_LT(slot_start, RTIMER_NOW() + 2));
+    slot_start += sync_correction;
+    sync_correction = 0;
+
+    schedule_slot(t, slot_start);
+    PT_YIELD(&slot_pt);
+  }
+
+  PT_END(&slot_pt);
+}
+/*---------------------------------------------------------------------------*/
+/* Start the slot operation with the given slot as the next one */
+static void
+associate(uint32_t next_asn, rtimer_clock_t next_slot_start)
+{
+  /* The slot operation reads all frames itself from now on */
+  if(NETSTACK_RADIO.set_value(RADIO_PARAM_RX_MODE,
+                              RADIO_RX_MODE_POLL_MODE) != RADIO_RESULT_OK) {
+    PRINTF("tschrdc: the radio does not support poll mode\n");
+  }
+  asn = next_asn;
+  slot_start = next_slot_start;
+  sync_correction = 0;
+  associated = 1;
+  timer_set(&desync_timer, TSCHRDC_DESYNC_TIMEOUT);
+  PT_INIT(&slot_pt);
+  schedule_slot(&rt, slot_start);
+}
+/*---------------------------------------------------------------------------*/
+/* Leave the slot operation, and have the radio pass frames to
+   packet_input() again while scanning */
+static void
+disassociate(void)
+{
+  associated = 0;
+  NETSTACK_RADIO.set_value(RADIO_PARAM_RX_MODE, 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+fail_queued_packets(void)
+{
+  int i;
+
+  for(i = 0; i < TSCHRDC_QUEUE_SIZE; i++) {
+    if(queue[i].state == PACKET_QUEUED) {
+      queue[i].status = MAC_TX_ERR;
+      queue[i].state = PACKET_DONE;
+    }
+  }
+  process_poll(&tschrdc_process);
+}
+/*---------------------------------------------------------------------------*/
+/* The rtimer time at which the frame in the packetbuf was received,
+   from the SFD timestamp of the radio. The attribute only holds the
+   low 16 bits of the rtimer clock. Radios that do not timestamp
+   frames leave it at zero, and the reception is then dated to now,
+   which includes the delay until the frame got processed. */
+static rtimer_clock_t
+rx_timestamp(void)
+{
+  rtimer_clock_t now = RTIMER_NOW();
+  uint16_t timestamp = packetbuf_attr(PACKETBUF_ATTR_TIMESTAMP);
+
+  if(timestamp == 0) {
+    return now;
+  }
+  return now - (uint16_t)((uint16_t)now - timestamp);
+}
+/*---------------------------------------------------------------------------*/
+static void
+eb_input(void)
+{
+  uint8_t *payload = packetbuf_dataptr();
+  const linkaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  rtimer_clock_t eb_slot_start;
+  rtimer_clock_t our_slot_start;
+  rtimer_clock_t diff;
+  uint32_t eb_asn;
+  uint8_t eb_join_priority;
+
+  if(packetbuf_datalen() < EB_PAYLOAD_LEN ||
+     memcmp(payload, eb_ie_header, EB_ASN_OFFSET) != 0) {
+    PRINTF("tschrdc: not an Enhanced Beacon\n");
+    return;
+  }
+  eb_asn = read_asn(&payload[EB_ASN_OFFSET]);
+  eb_join_priority = payload[EB_JOIN_PRIORITY_OFFSET];
+  eb_slot_start = rx_timestamp() - TSCHRDC_RX_DELAY - TSCHRDC_TX_OFFSET;
+
+  if(is_coordinator) {
+    return;
+  }
+
+  if(!associated) {
+    PRINTF("tschrdc: associating at asn %lu, join priority %u\n",
+           (unsigned long)eb_asn, eb_join_priority + 1);
+    linkaddr_copy(&time_source, sender);
+    join_priority = eb_join_priority + 1;
+    associate(eb_asn + 1, eb_slot_start + TSCHRDC_SLOT_DURATION);
+    return;
+  }
+
+  if(!linkaddr_cmp(sender, &time_source)) {
+    if(eb_join_priority + 1 < join_priority) {
+      /* A better time source; resynchronize on its next beacon */
+      linkaddr_copy(&time_source, sender);
+      join_priority = eb_join_priority + 1;
+    }
+    return;
+  }
+
+  /* Where our clock puts the start of the beacon's slot */
+  our_slot_start = slot_start -
+    (rtimer_clock_t)((asn - eb_asn) * TSCHRDC_SLOT_DURATION);
+  diff = eb_slot_start - our_slot_start;
+  if(RTIMER_CLOCK_LT(diff, TSCHRDC_SLOT_DURATION / 2) &&
+     RTIMER_CLOCK_LT(-diff, TSCHRDC_SLOT_DURATION / 2)) {
+    sync_correction = diff;
+    timer_set(&desync_timer, TSCHRDC_DESYNC_TIMEOUT);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+queue_eb(void)
+{
+  int hdr_len;
+
+  if(eb.state != PACKET_FREE) {
+    return;
+  }
+
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), eb_ie_header, EB_ASN_OFFSET);
+  ((uint8_t *)packetbuf_dataptr())[EB_JOIN_PRIORITY_OFFSET] = join_priority;
+  packetbuf_set_datalen(EB_PAYLOAD_LEN);
+  packetbuf_set_attr(PACKETBUF_ATTR_FRAME_TYPE, FRAME802154_BEACONFRAME);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+
+  hdr_len = NETSTACK_FRAMER.create();
+  if(hdr_len < 0) {
+    PRINTF("tschrdc: failed to create Enhanced Beacon\n");
+    return;
+  }
+  eb.len = packetbuf_copyto(eb.frame);
+  eb_asn_offset = hdr_len + EB_ASN_OFFSET;
+  linkaddr_copy(&eb.receiver, &linkaddr_null);
+  eb.state = PACKET_QUEUED;
+}
+/*---------------------------------------------------------------------------*/
+static int
+queue_packet(mac_callback_t sent, void *ptr)
+{
+  struct tx_packet *p;
+  int i;
+
+  if(!associated) {
+    return MAC_TX_ERR;
+  }
+
+  for(i = 0; i < TSCHRDC_QUEUE_SIZE; i++) {
+    if(queue[i].state == PACKET_QUEUED &&
+       queue[i].seqno == packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO) &&
+       linkaddr_cmp(&queue[i].receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER))) {
+      /* Already waiting for a cell */
+      return MAC_TX_DEFERRED;
+    }
+  }
+
+  for(p = NULL, i = 0; i < TSCHRDC_QUEUE_SIZE; i++) {
+    if(queue[i].state == PACKET_FREE) {
+      p = &queue[i];
+      break;
+    }
+  }
+  if(p == NULL) {
+    PRINTF("tschrdc: queue full\n");
+    return MAC_TX_COLLISION;
+  }
+
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+  if(!packetbuf_holds_broadcast()) {
+    packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+  }
+  if(!packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED) &&
+     NETSTACK_FRAMER.create_and_secure() < 0) {
+    PRINTF("tschrdc: send failed, too large header\n");
+    return MAC_TX_ERR_FATAL;
+  }
+
+  p->len = packetbuf_copyto(p->frame);
+  if(p->len == 0) {
+    return MAC_TX_ERR_FATAL;
+  }
+  p->seqno = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+  linkaddr_copy(&p->receiver, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  p->sent = sent;
+  p->ptr = ptr;
+  p->order = next_order++;
+  p->state = PACKET_QUEUED;
+  return MAC_TX_DEFERRED;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  int ret;
+
+  ret = queue_packet(sent, ptr);
+  if(ret != MAC_TX_DEFERRED) {
+    mac_call_sent_callback(sent, ptr, ret, 1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
+{
+  while(buf_list != NULL) {
+    /* We backup the next pointer, as it may be nullified by
+     * mac_call_sent_callback() */
+    struct rdc_buf_list *next = buf_list->next;
+    int ret;
+
+    queuebuf_to_packetbuf(buf_list->buf);
+    ret = queue_packet(sent, ptr);
+    if(ret != MAC_TX_DEFERRED) {
+      mac_call_sent_callback(sent, ptr, ret, 1);
+      return;
+    }
+    buf_list = next;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Report the outcome of the transmissions done in the slot operation */
+static void
+report_sent_packets(void)
+{
+  struct tx_packet *p;
+  mac_callback_t sent;
+  void *ptr;
+  int i;
+
+  for(i = 0; i < TSCHRDC_QUEUE_SIZE; i++) {
+    p = &queue[i];
+    if(p->state == PACKET_DONE) {
+      /* The upper layers find the packet by its sequence number */
+      packetbuf_clear();
+      packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, p->seqno);
+      packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &p->receiver);
+      sent = p->sent;
+      ptr = p->ptr;
+      p->state = PACKET_FREE;
+      mac_call_sent_callback(sent, ptr, p->status, 1);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_input(void)
+{
+  if(packetbuf_datalen() == ACK_LEN) {
+    uint8_t *ack = packetbuf_dataptr();
+    if(waiting_for_ack && ack[0] == FRAME802154_ACKFRAME &&
+       ack[2] == ack_seqno) {
+      ack_received = 1;
+    }
+    return;
+  }
+
+  if(NETSTACK_FRAMER.parse() < 0) {
+    PRINTF("tschrdc: failed to parse %u\n", packetbuf_datalen());
+    return;
+  }
+
+  if(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) == FRAME802154_BEACONFRAME) {
+    eb_input();
+    return;
+  }
+
+  if(!associated) {
+    return;
+  }
+
+  if(!linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                   &linkaddr_node_addr) &&
+     !packetbuf_holds_broadcast()) {
+    PRINTF("tschrdc: not for us\n");
+    return;
+  }
+
+#if RDC_WITH_DUPLICATE_DETECTION
+  if(mac_sequence_is_duplicate()) {
+    PRINTF("tschrdc: drop duplicate link layer packet %u\n",
+           packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO));
+    return;
+  }
+  mac_sequence_register_seqno();
+#endif /* RDC_WITH_DUPLICATE_DETECTION */
+
+  NETSTACK_MAC.input();
+}
+/*---------------------------------------------------------------------------*/
+/* Pass the frames received in the slot operation up the stack */
+static void
+deliver_input(void)
+{
+  struct rx_packet *in;
+  int i;
+
+  for(i = 0; i < TSCHRDC_INPUT_QUEUE_SIZE; i++) {
+    in = &input_queue[i];
+    if(in->len > 0) {
+      packetbuf_clear();
+      packetbuf_copyfrom(in->frame, in->len);
+      packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, in->timestamp);
+      in->len = 0;
+      packet_input();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tschrdc_process, ev, data)
+{
+  static struct etimer eb_timer;
+  static struct etimer scan_timer;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&eb_timer, TSCHRDC_EB_PERIOD);
+  etimer_set(&scan_timer, TSCHRDC_SCAN_PERIOD);
+
+  while(1) {
+    PROCESS_YIELD();
+
+    if(ev == PROCESS_EVENT_POLL) {
+      report_sent_packets();
+      deliver_input();
+    } else if(ev == PROCESS_EVENT_TIMER && data == &eb_timer) {
+      if(tschrdc_is_on && associated) {
+        queue_eb();
+      }
+      etimer_reset(&eb_timer);
+    } else if(ev == PROCESS_EVENT_TIMER && data == &scan_timer) {
+      if(tschrdc_is_on && associated && !is_coordinator &&
+         timer_expired(&desync_timer)) {
+        PRINTF("tschrdc: lost synchronization\n");
+        disassociate();
+        fail_queued_packets();
+      }
+      if(tschrdc_is_on && !associated) {
+        /* Listen on the next channel of the hopping sequence */
+        scan_index = (scan_index + 1) % sizeof(hopping_sequence);
+        NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL,
+                                 hopping_sequence[scan_index]);
+        NETSTACK_RADIO.on();
+      }
+      etimer_reset(&scan_timer);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+int
+tschrdc_add_cell(uint16_t timeslot, uint8_t channel_offset,
+                 uint8_t options, const linkaddr_t *neighbor)
+{
+  struct cell *c;
+
+  for(c = cells; c < &cells[TSCHRDC_MAX_CELLS]; c++) {
+    if(c->options == 0) {
+      c->timeslot = timeslot % TSCHRDC_SLOTFRAME_LENGTH;
+      c->channel_offset = channel_offset;
+      linkaddr_copy(&c->neighbor, neighbor != NULL ? neighbor : &linkaddr_null);
+      c->options = options;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tschrdc_remove_cell(uint16_t timeslot, uint8_t channel_offset)
+{
+  struct cell *c;
+
+  for(c = cells; c < &cells[TSCHRDC_MAX_CELLS]; c++) {
+    if(c->options != 0 && c->timeslot == timeslot &&
+       c->channel_offset == channel_offset) {
+      c->options = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+tschrdc_set_coordinator(int enable)
+{
+  if(is_coordinator == (enable != 0)) {
+    return;
+  }
+  is_coordinator = enable != 0;
+  join_priority = is_coordinator ? 0 : 0xff;
+  if(tschrdc_is_on) {
+    /* Start over, either as the coordinator or by scanning */
+    off(0);
+    on();
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+tschrdc_is_associated(void)
+{
+  return associated;
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  if(!tschrdc_is_on) {
+    tschrdc_is_on = 1;
+    if(is_coordinator) {
+      associate(0, RTIMER_NOW() + TSCHRDC_SLOT_DURATION);
+    } else {
+      NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL,
+                               hopping_sequence[scan_index]);
+      NETSTACK_RADIO.on();
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on)
+{
+  tschrdc_is_on = 0;
+  disassociate();
+  fail_queued_packets();
+  if(keep_radio_on) {
+    return NETSTACK_RADIO.on();
+  } else {
+    return NETSTACK_RADIO.off();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  unsigned long interval;
+
+  /* The duration of a slotframe, in clock ticks */
+  interval = (unsigned long)TSCHRDC_SLOTFRAME_LENGTH * TSCHRDC_SLOT_DURATION *
+    CLOCK_SECOND / RTIMER_ARCH_SECOND;
+  return interval > 0 ? interval : 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  memset(cells, 0, sizeof(cells));
+  memset(queue, 0, sizeof(queue));
+  memset(input_queue, 0, sizeof(input_queue));
+  eb.state = PACKET_FREE;
+  if(!is_coordinator) {
+    join_priority = 0xff;
+  }
+#if TSCHRDC_WITH_MINIMAL_SCHEDULE
+  tschrdc_add_cell(0, 0, TSCHRDC_CELL_TX | TSCHRDC_CELL_RX |
+                   TSCHRDC_CELL_SHARED | TSCHRDC_CELL_ADV, NULL);
+#endif /* TSCHRDC_WITH_MINIMAL_SCHEDULE */
+  process_start(&tschrdc_process, NULL);
+  on();
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver tschrdc_driver = {
+  "tschrdc",
+  init,
+  send_packet,
+  send_list,
+  packet_input,
+  on,
+  off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Header file for a time-slotted channel hopping (TSCH) radio
+ *         duty cycling layer
+ */
+
+#ifndef TSCHRDC_H_
+#define TSCHRDC_H_
+
+#include "net/mac/rdc.h"
+#include "net/linkaddr.h"
+
+/* Cell options */
+#define TSCHRDC_CELL_TX         0x01
+#define TSCHRDC_CELL_RX         0x02
+#define TSCHRDC_CELL_SHARED     0x04
+#define TSCHRDC_CELL_ADV        0x08
+
+/**
+ * \brief      Add a cell to the slotframe
+ * \param timeslot The timeslot of the cell within the slotframe
+ * \param channel_offset The channel offset of the cell
+ * \param options A combination of the TSCHRDC_CELL_* options
+ * \param neighbor The neighbor the cell is dedicated to, or NULL for a
+ *                 cell that may be used with any neighbor
+ * \retval 1   The cell was added
+ * \retval 0   The cell table is full
+ */
+int tschrdc_add_cell(uint16_t timeslot, uint8_t channel_offset,
+                     uint8_t options, const linkaddr_t *neighbor);
+
+/**
+ * \brief      Remove a cell from the slotframe
+ * \retval 1   The cell was removed
+ * \retval 0   There was no such cell
+ */
+int tschrdc_remove_cell(uint16_t timeslot, uint8_t channel_offset);
+
+/**
+ * \brief      Make this node the coordinator of the network. The
+ *             coordinator defines the slot timing and starts sending
+ *             Enhanced Beacons right away. If the RDC layer is on, it
+ *             starts over in the new role, and the frames waiting for
+ *             a cell are reported as failed.
+ */
+void tschrdc_set_coordinator(int enable);
+
+/**
+ * \brief      Tell if the node is synchronized to the network
+ */
+int tschrdc_is_associated(void);
+
+extern const struct rdc_driver tschrdc_driver;
+
+#endif /* TSCHRDC_H_ */
@@ -50,6 +50,7 @@
 
 struct packetbuf_attr packetbuf_attrs[PACKETBUF_NUM_ATTRS];
 struct packetbuf_addr packetbuf_addrs[PACKETBUF_NUM_ADDRS];
+uint8_t packetbuf_attr_bitmap[PACKETBUF_ATTR_BITMAP_LEN];
 
 
 static uint16_t buflen, bufptr;
@@ -242,21 +243,20 @@ packetbuf_totlen(void)
 void
 packetbuf_attr_clear(void)
 {
-  int i;
-  for(i = 0; i < PACKETBUF_NUM_ATTRS; ++i) {
-    packetbuf_attrs[i].val = 0;
-  }
-  for(i = 0; i < PACKETBUF_NUM_ADDRS; ++i) {
-    linkaddr_copy(&packetbuf_addrs[i].addr, &linkaddr_null);
-  }
+  memset(packetbuf_attr_bitmap, 0, sizeof(packetbuf_attr_bitmap));
 }
 /*---------------------------------------------------------------------------*/
 void
 packetbuf_attr_copyto(struct packetbuf_attr *attrs,
 		    struct packetbuf_addr *addrs)
 {
-  memcpy(attrs, packetbuf_attrs, sizeof(packetbuf_attrs));
-  memcpy(addrs, packetbuf_addrs, sizeof(packetbuf_addrs));
+  int i;
+  for(i = 0; i < PACKETBUF_NUM_ATTRS; ++i) {
+    attrs[i].val = packetbuf_attr(i);
+  }
+  for(i = 0; i < PACKETBUF_NUM_ADDRS; ++i) {
+    linkaddr_copy(&addrs[i].addr, packetbuf_addr(PACKETBUF_ADDR_FIRST + i));
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -265,6 +265,112 @@ packetbuf_attr_copyfrom(struct packetbuf_attr *attrs,
 {
   memcpy(packetbuf_attrs, attrs, sizeof(packetbuf_attrs));
   memcpy(packetbuf_addrs, addrs, sizeof(packetbuf_addrs));
+  memset(packetbuf_attr_bitmap, 0xff, sizeof(packetbuf_attr_bitmap));
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_attr_pack(uint8_t *buf)
+{
+  uint8_t type;
+  int len;
+  packetbuf_attr_t val;
+  const linkaddr_t *addr;
+
+  if(buf != NULL) {
+    memset(buf, 0, PACKETBUF_ATTR_BITMAP_LEN);
+  }
+  len = PACKETBUF_ATTR_BITMAP_LEN;
+
+  for(type = 0; type < PACKETBUF_ADDR_FIRST; type++) {
+    val = packetbuf_attr(type);
+    if(val != 0) {
+      if(buf != NULL) {
+        buf[type >> 3] |= 1 << (type & 7);
+        memcpy(&buf[len], &val, sizeof(val));
+      }
+      len += sizeof(val);
+    }
+  }
+  for(; type < PACKETBUF_ATTR_MAX; type++) {
+    addr = packetbuf_addr(type);
+    if(!linkaddr_cmp(addr, &linkaddr_null)) {
+      if(buf != NULL) {
+        buf[type >> 3] |= 1 << (type & 7);
+        linkaddr_copy((linkaddr_t *)&buf[len], addr);
+      }
+      len += sizeof(linkaddr_t);
+    }
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+void
+packetbuf_attr_unpack(const uint8_t *buf)
+{
+  uint8_t type;
+  int len;
+
+  memcpy(packetbuf_attr_bitmap, buf, sizeof(packetbuf_attr_bitmap));
+  len = PACKETBUF_ATTR_BITMAP_LEN;
+
+  for(type = 0; type < PACKETBUF_ADDR_FIRST; type++) {
+    if(PACKETBUF_ATTR_IS_SET(type)) {
+      memcpy(&packetbuf_attrs[type].val, &buf[len], sizeof(packetbuf_attr_t));
+      len += sizeof(packetbuf_attr_t);
+    }
+  }
+  for(; type < PACKETBUF_ATTR_MAX; type++) {
+    if(PACKETBUF_ATTR_IS_SET(type)) {
+      linkaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr,
+                    (const linkaddr_t *)&buf[len]);
+      len += sizeof(linkaddr_t);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The offset of a value in packed attributes, or 0 if it is not set */
+static int
+packed_offset(const uint8_t *buf, uint8_t type)
+{
+  uint8_t t;
+  int len;
+
+  if(!(buf[type >> 3] & (1 << (type & 7)))) {
+    return 0;
+  }
+  len = PACKETBUF_ATTR_BITMAP_LEN;
+  for(t = 0; t < type; t++) {
+    if(buf[t >> 3] & (1 << (t & 7))) {
+      len += PACKETBUF_IS_ADDR(t) ? sizeof(linkaddr_t) : sizeof(packetbuf_attr_t);
+    }
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+packetbuf_attr_t
+packetbuf_attr_packed(const uint8_t *buf, uint8_t type)
+{
+  packetbuf_attr_t val;
+  int offset;
+
+  offset = packed_offset(buf, type);
+  if(offset == 0) {
+    return 0;
+  }
+  memcpy(&val, &buf[offset], sizeof(val));
+  return val;
+}
+/*---------------------------------------------------------------------------*/
+const linkaddr_t *
+packetbuf_addr_packed(const uint8_t *buf, uint8_t type)
+{
+  int offset;
+
+  offset = packed_offset(buf, type);
+  if(offset == 0) {
+    return &linkaddr_null;
+  }
+  return (const linkaddr_t *)&buf[offset];
 }
 /*---------------------------------------------------------------------------*/
 #if !PACKETBUF_CONF_ATTRS_INLINE
@@ -273,13 +379,14 @@ packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
 /*   packetbuf_attrs[type].type = type; */
   packetbuf_attrs[type].val = val;
+  PACKETBUF_ATTR_MARK_SET(type);
   return 1;
 }
 /*---------------------------------------------------------------------------*/
 packetbuf_attr_t
 packetbuf_attr(uint8_t type)
 {
-  return packetbuf_attrs[type].val;
+  return PACKETBUF_ATTR_IS_SET(type) ? packetbuf_attrs[type].val : 0;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -287,20 +394,22 @@ packetbuf_set_addr(uint8_t type, const linkaddr_t *addr)
 {
 /*   packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].type = type; */
   linkaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
+  PACKETBUF_ATTR_MARK_SET(type);
   return 1;
 }
 /*---------------------------------------------------------------------------*/
 const linkaddr_t *
 packetbuf_addr(uint8_t type)
 {
-  return &packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  return PACKETBUF_ATTR_IS_SET(type) ?
+    &packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr : &linkaddr_null;
 }
 /*---------------------------------------------------------------------------*/
 #endif /* PACKETBUF_CONF_ATTRS_INLINE */
 int
 packetbuf_holds_broadcast(void)
 {
-  return linkaddr_cmp(&packetbuf_addrs[PACKETBUF_ADDR_RECEIVER - PACKETBUF_ADDR_FIRST].addr, &linkaddr_null);
+  return linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &linkaddr_null);
 }
 /*---------------------------------------------------------------------------*/
 
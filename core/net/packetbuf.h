@@ -80,6 +80,16 @@
 #define PACKETBUF_WITH_PACKET_TYPE NETSTACK_CONF_WITH_RIME
 #endif
 
+/* PACKETBUF_ATTR_PRIORITY is only needed by a MAC layer that
+   schedules by priority class */
+#ifdef PACKETBUF_CONF_WITH_PRIORITY
+#define PACKETBUF_WITH_PRIORITY PACKETBUF_CONF_WITH_PRIORITY
+#elif defined(CSMA_CONF_WITH_PRIORITY)
+#define PACKETBUF_WITH_PRIORITY CSMA_CONF_WITH_PRIORITY
+#else
+#define PACKETBUF_WITH_PRIORITY 0
+#endif
+
 /**
  * \brief      Clear and reset the packetbuf
  *
@@ -297,6 +307,12 @@ struct packetbuf_addr {
 #define PACKETBUF_ATTR_PACKET_TYPE_STREAM_END 3
 #define PACKETBUF_ATTR_PACKET_TYPE_TIMESTAMP 4
 
+/* Transmission priority classes, in increasing order of urgency */
+#define PACKETBUF_ATTR_PRIORITY_BULK         0
+#define PACKETBUF_ATTR_PRIORITY_ACK          1
+#define PACKETBUF_ATTR_PRIORITY_CONTROL      2
+#define PACKETBUF_ATTR_PRIORITY_CLASSES      3
+
 enum {
   PACKETBUF_ATTR_NONE,
 
@@ -313,6 +329,9 @@ enum {
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
   PACKETBUF_ATTR_IS_CREATED_AND_SECURED,
+#if PACKETBUF_WITH_PRIORITY
+  PACKETBUF_ATTR_PRIORITY,
+#endif /* PACKETBUF_WITH_PRIORITY */
   
   /* Scope 1 attributes: used between two neighbors only. */
 #if PACKETBUF_WITH_PACKET_TYPE
@@ -386,6 +405,24 @@ enum {
 
 #define PACKETBUF_IS_ADDR(type) ((type) >= PACKETBUF_ADDR_FIRST)
 
+/* Attributes and addresses that have been set since the last
+   packetbuf_attr_clear() are marked in a bitmap, so that clearing
+   them does not require touching every value. The bitmap has an even
+   length, so that the packed form below stays 16-bit aligned. */
+#define PACKETBUF_ATTR_BITMAP_LEN (((PACKETBUF_ATTR_MAX + 15) / 16) * 2)
+
+extern uint8_t packetbuf_attr_bitmap[];
+
+#define PACKETBUF_ATTR_IS_SET(type) \
+  (packetbuf_attr_bitmap[(type) >> 3] & (1 << ((type) & 7)))
+#define PACKETBUF_ATTR_MARK_SET(type) \
+  (packetbuf_attr_bitmap[(type) >> 3] |= (1 << ((type) & 7)))
+
+/* The maximum size of the packed attributes, see packetbuf_attr_pack() */
+#define PACKETBUF_ATTR_PACKED_MAX (PACKETBUF_ATTR_BITMAP_LEN + \
+                                   PACKETBUF_NUM_ATTRS * sizeof(packetbuf_attr_t) + \
+                                   PACKETBUF_NUM_ADDRS * sizeof(linkaddr_t))
+
 #if PACKETBUF_CONF_ATTRS_INLINE
 
 extern struct packetbuf_attr packetbuf_attrs[];
@@ -401,12 +438,13 @@ packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
 /*   packetbuf_attrs[type].type = type; */
   packetbuf_attrs[type].val = val;
+  PACKETBUF_ATTR_MARK_SET(type);
   return 1;
 }
 static inline packetbuf_attr_t
 packetbuf_attr(uint8_t type)
 {
-  return packetbuf_attrs[type].val;
+  return PACKETBUF_ATTR_IS_SET(type) ? packetbuf_attrs[type].val : 0;
 }
 
 static inline int
@@ -414,13 +452,15 @@ packetbuf_set_addr(uint8_t type, const linkaddr_t *addr)
 {
 /*   packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].type = type; */
   linkaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
+  PACKETBUF_ATTR_MARK_SET(type);
   return 1;
 }
 
 static inline const linkaddr_t *
 packetbuf_addr(uint8_t type)
 {
-  return &packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  return PACKETBUF_ATTR_IS_SET(type) ?
+    &packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr : &linkaddr_null;
 }
 #else /* PACKETBUF_CONF_ATTRS_INLINE */
 int               packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val);
@@ -442,6 +482,44 @@ void              packetbuf_attr_copyto(struct packetbuf_attr *attrs,
 void              packetbuf_attr_copyfrom(struct packetbuf_attr *attrs,
 					struct packetbuf_addr *addrs);
 
+/**
+ * \brief      Pack the attributes and addresses that are set
+ * \param buf  The buffer to pack into, 16-bit aligned and at least
+ *             PACKETBUF_ATTR_PACKED_MAX bytes long, or NULL to only
+ *             compute the length
+ * \return     The length of the packed attributes
+ *
+ *             Only attributes that are set to a non-zero value, and
+ *             addresses other than the null address, are packed. The
+ *             packed form is a bitmap of these followed by their
+ *             values, in type order. It is much shorter than the full
+ *             attribute and address arrays for a typical packet.
+ */
+int               packetbuf_attr_pack(uint8_t *buf);
+
+/**
+ * \brief      Replace the attributes and addresses with packed ones
+ * \param buf  Attributes packed by packetbuf_attr_pack()
+ */
+void              packetbuf_attr_unpack(const uint8_t *buf);
+
+/**
+ * \brief      Get an attribute from packed attributes
+ * \param buf  Attributes packed by packetbuf_attr_pack()
+ * \param type The attribute type
+ * \return     The value of the attribute, or zero if it was not set
+ */
+packetbuf_attr_t  packetbuf_attr_packed(const uint8_t *buf, uint8_t type);
+
+/**
+ * \brief      Get an address from packed attributes
+ * \param buf  Attributes packed by packetbuf_attr_pack()
+ * \param type The address type
+ * \return     A pointer to the address within buf, or to
+ *             linkaddr_null if it was not set
+ */
+const linkaddr_t *packetbuf_addr_packed(const uint8_t *buf, uint8_t type);
+
 #define PACKETBUF_ATTRIBUTES(...) { __VA_ARGS__ PACKETBUF_ATTR_LAST }
 #define PACKETBUF_ATTR_LAST { PACKETBUF_ATTR_NONE, 0 }
 
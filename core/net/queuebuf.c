@@ -48,6 +48,11 @@
 #include "cfs/cfs.h"
 #endif
 
+#if QUEUEBUF_ARENA
+#include "lib/mmem.h"
+#endif
+
+#include <stddef.h> /* for offsetof() */
 #include <string.h> /* for memcpy() */
 
 /* Structure pointing to a buffer either stored
@@ -59,6 +64,9 @@ struct queuebuf {
   int line;
   clock_time_t time;
 #endif /* QUEUEBUF_DEBUG */
+#if QUEUEBUF_ARENA
+  struct mmem mem;
+#else /* QUEUEBUF_ARENA */
 #if WITH_SWAP
   enum {IN_RAM, IN_CFS} location;
   union {
@@ -67,47 +75,88 @@ struct queuebuf {
 #if WITH_SWAP
     int swap_id;
   };
+  /* The order in which swapped queuebufs were created */
+  uint16_t swap_seq;
 #endif
+#endif /* QUEUEBUF_ARENA */
 };
 
-/* The actual queuebuf data */
+/* The actual queuebuf data: the packet, followed by its attributes
+   as packed by packetbuf_attr_pack(), at an even offset. Arena
+   allocations are cut short after the bytes actually used. */
 struct queuebuf_data {
-  uint8_t data[PACKETBUF_SIZE];
   uint16_t len;
-  struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
-  struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+  uint16_t attrlen;
+  uint8_t data[PACKETBUF_SIZE + 1 + PACKETBUF_ATTR_PACKED_MAX];
 };
 
+#define QUEUEBUF_ATTR_OFFSET(len) (((len) + 1) & ~1)
+#define QUEUEBUF_ATTRS(d) (&(d)->data[QUEUEBUF_ATTR_OFFSET((d)->len)])
+
+/* The size of a queuebuf_data holding len bytes of data and attrlen
+   bytes of packed attributes, rounded up to keep arena blocks
+   aligned */
+#define QUEUEBUF_DATA_SIZE(len, attrlen)                                \
+  ((offsetof(struct queuebuf_data, data) + QUEUEBUF_ATTR_OFFSET(len) +  \
+    (attrlen) + 3) & ~3)
+
 MEMB(bufmem, struct queuebuf, QUEUEBUF_NUM);
+#if !QUEUEBUF_ARENA
 MEMB(buframmem, struct queuebuf_data, QUEUEBUFRAM_NUM);
+#endif /* !QUEUEBUF_ARENA */
 
 #if WITH_SWAP
 
 /* Swapping allows to store up to QUEUEBUF_NUM - QUEUEBUFRAM_NUM
-   queuebufs in CFS. The swap is made of several large CFS files.
-   Every buffer stored in CFS has a swap id, referring to a specific
-   offset in one of these files. */
+   queuebufs in CFS. The swap is a log made of several large CFS
+   files that are written in order. Every record stored in CFS has a
+   swap id, referring to a specific offset in one of these files. A
+   file is removed and reused once none of its records is in use.
+
+   A swapped queuebuf gets its swap id when it is created, so that
+   queuebuf_new_from_packetbuf() fails right away when the swap is
+   full. Swapped queuebufs are accessed through a few RAM slots. New
+   and updated queuebufs are only marked dirty in their slot, and the
+   dirty slots are written to their records together from a ctimer
+   callback, outside of the radio and MAC processing that created
+   them. A dirty slot is only reused once it has been written, and
+   while all slots are dirty queuebuf_new_from_packetbuf() fails
+   rather than write them itself. The same callback then loads the oldest swapped queuebufs, which are
+   normally the next ones to be sent, into the free slots. */
 #define NQBUF_FILES 4
 #define NQBUF_PER_FILE 256
-#define QBUF_FILE_SIZE (NQBUF_PER_FILE*sizeof(struct queuebuf_data))
 #define NQBUF_ID (NQBUF_PER_FILE * NQBUF_FILES)
 
+/* The number of RAM slots for swapped queuebufs */
+#ifdef QUEUEBUF_CONF_SWAP_SLOTS
+#define QUEUEBUF_SWAP_SLOTS QUEUEBUF_CONF_SWAP_SLOTS
+#else
+#define QUEUEBUF_SWAP_SLOTS 4
+#endif
+
 struct qbuf_file {
   int fd;
   int usage;
   int renewable;
 };
 
-/* A statically allocated queuebuf used as a cache for swapped qbufs */
-static struct queuebuf_data tmpdata;
-/* A pointer to the qbuf associated to the data in tmpdata */
-static struct queuebuf *tmpdata_qbuf = NULL;
+struct swap_slot {
+  /* The swapped queuebuf held in this slot, or NULL */
+  struct queuebuf *qbuf;
+  /* Set when the slot is newer than the record in CFS */
+  uint8_t dirty;
+  struct queuebuf_data data;
+};
+
+static struct swap_slot swap_slots[QUEUEBUF_SWAP_SLOTS];
 /* The swap id counter */
 static int next_swap_id = 0;
+/* The sequence number of the next swapped queuebuf */
+static uint16_t next_swap_seq;
 /* The swap files */
 static struct qbuf_file qbuf_files[NQBUF_FILES];
-/* The timer used to renew files during inactivity periods */
-static struct ctimer renew_timer;
+/* The timer used to flush slots and renew files after packet processing */
+static struct ctimer flush_timer;
 
 #endif
 
@@ -135,6 +184,7 @@ uint8_t queuebuf_len, queuebuf_max_len;
 #endif /* QUEUEBUF_STATS */
 
 #if WITH_SWAP
+static void swap_flush(void *unused);
 /*---------------------------------------------------------------------------*/
 static void
 qbuf_renew_file(int file)
@@ -158,7 +208,7 @@ qbuf_renew_file(int file)
 /*---------------------------------------------------------------------------*/
 /* Renews every file with renewable flag set */
 static void
-qbuf_renew_all(void *unused)
+qbuf_renew_all(void)
 {
   int i;
   for(i=0; i<NQBUF_FILES; i++) {
@@ -168,6 +218,12 @@ qbuf_renew_all(void *unused)
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+schedule_flush(void)
+{
+  ctimer_set(&flush_timer, 0, swap_flush, NULL);
+}
+/*---------------------------------------------------------------------------*/
 /* Removes a queuebuf from its swap file */
 static void
 queuebuf_remove_from_file(int swap_id)
@@ -180,12 +236,8 @@ queuebuf_remove_from_file(int swap_id)
     /* The file is full but doesn't contain any more queuebuf, mark it as renewable */
     if(qbuf_files[fileid].usage == 0 && fileid != next_swap_id / NQBUF_PER_FILE) {
       qbuf_files[fileid].renewable = 1;
-      /* This file is renewable, set a timer to renew files */
-      ctimer_set(&renew_timer, 0, qbuf_renew_all, NULL);
-    }
-
-    if(tmpdata_qbuf->swap_id == swap_id) {
-      tmpdata_qbuf->swap_id = -1;
+      /* This file is renewable, renew it with the next flush */
+      schedule_flush();
     }
   }
 }
@@ -209,64 +261,226 @@ get_new_swap_id(void)
   return swap_id;
 }
 /*---------------------------------------------------------------------------*/
-/* Flush tmpdata to CFS */
+/* Write a dirty slot to the record of its queuebuf */
 static int
-queuebuf_flush_tmpdata(void)
+write_slot(struct swap_slot *slot)
 {
   int fileid, fd, ret;
   cfs_offset_t offset;
-  if(tmpdata_qbuf) {
-    queuebuf_remove_from_file(tmpdata_qbuf->swap_id);
-    tmpdata_qbuf->swap_id = get_new_swap_id();
-    if(tmpdata_qbuf->swap_id == -1) {
-      return -1;
+  struct queuebuf *b = slot->qbuf;
+
+  fileid = b->swap_id / NQBUF_PER_FILE;
+  offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
+  fd = qbuf_files[fileid].fd;
+  ret = cfs_seek(fd, offset, CFS_SEEK_SET);
+  if(ret == -1) {
+    PRINTF("write_slot: cfs seek error\n");
+    return -1;
+  }
+  ret = cfs_write(fd, &slot->data, sizeof(struct queuebuf_data));
+  if(ret == -1) {
+    PRINTF("write_slot: cfs write error\n");
+    return -1;
+  }
+  slot->dirty = 0;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Read the record of a swapped queuebuf into a slot. The slot is
+   left free if the record cannot be read. */
+static int
+read_slot(struct swap_slot *slot, struct queuebuf *b)
+{
+  int fileid, fd;
+  cfs_offset_t offset;
+
+  fileid = b->swap_id / NQBUF_PER_FILE;
+  offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
+  fd = qbuf_files[fileid].fd;
+  if(cfs_seek(fd, offset, CFS_SEEK_SET) == -1) {
+    PRINTF("read_slot: cfs seek error\n");
+    return -1;
+  }
+  if(cfs_read(fd, &slot->data, sizeof(struct queuebuf_data)) !=
+     sizeof(struct queuebuf_data)) {
+    PRINTF("read_slot: cfs read error\n");
+    return -1;
+  }
+  slot->qbuf = b;
+  slot->dirty = 0;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Write all dirty slots. A slot that cannot be written stays dirty
+   until a later attempt. */
+static void
+write_dirty_slots(void)
+{
+  int i;
+
+  for(i = 0; i < QUEUEBUF_SWAP_SLOTS; i++) {
+    if(swap_slots[i].qbuf != NULL && swap_slots[i].dirty) {
+      if(write_slot(&swap_slots[i]) == -1) {
+        PRINTF("write_dirty_slots: could not write slot %d\n", i);
+      }
     }
-    fileid = tmpdata_qbuf->swap_id / NQBUF_PER_FILE;
-    offset = (tmpdata_qbuf->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-    fd = qbuf_files[fileid].fd;
-    ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs seek error\n");
-      return -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static struct swap_slot *
+find_slot(struct queuebuf *b)
+{
+  int i;
+  for(i = 0; i < QUEUEBUF_SWAP_SLOTS; i++) {
+    if(swap_slots[i].qbuf == b) {
+      return &swap_slots[i];
     }
-    ret = cfs_write(fd, &tmpdata, sizeof(struct queuebuf_data));
-    if(ret == -1) {
-      PRINTF("queuebuf_flush_tmpdata: cfs write error\n");
-      return -1;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* The clean slot holding the most recently swapped queuebuf, which
+   will be needed last, or NULL if all slots are dirty */
+static struct swap_slot *
+newest_clean_slot(void)
+{
+  struct swap_slot *slot;
+  struct swap_slot *victim;
+  int i;
+
+  victim = NULL;
+  for(i = 0; i < QUEUEBUF_SWAP_SLOTS; i++) {
+    slot = &swap_slots[i];
+    if(!slot->dirty &&
+       (victim == NULL ||
+        (uint16_t)(next_swap_seq - slot->qbuf->swap_seq) <
+        (uint16_t)(next_swap_seq - victim->qbuf->swap_seq))) {
+      victim = slot;
     }
   }
-  return 0;
+  return victim;
 }
 /*---------------------------------------------------------------------------*/
-/* If the queuebuf is in CFS, load it to tmpdata */
+/* Get a slot for a queuebuf. A free slot is used if there is one.
+   Otherwise a clean slot is reused. If all slots are dirty, they are
+   only written here when may_write is set; otherwise NULL is returned
+   and the deferred flush catches up. */
+static struct swap_slot *
+get_slot(int may_write)
+{
+  struct swap_slot *victim;
+
+  victim = find_slot(NULL);
+  if(victim != NULL) {
+    return victim;
+  }
+  victim = newest_clean_slot();
+  if(victim == NULL) {
+    if(!may_write) {
+      schedule_flush();
+      return NULL;
+    }
+    write_dirty_slots();
+    victim = newest_clean_slot();
+    if(victim == NULL) {
+      PRINTF("get_slot: no slot could be written\n");
+      return NULL;
+    }
+  }
+  victim->qbuf = NULL;
+  return victim;
+}
+/*---------------------------------------------------------------------------*/
+/* Mark a swapped queuebuf as changed, so that it is written again */
+static void
+swap_mark_dirty(struct queuebuf *b)
+{
+  struct swap_slot *slot;
+  if(b->location == IN_CFS) {
+    slot = find_slot(b);
+    if(slot != NULL) {
+      slot->dirty = 1;
+      schedule_flush();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Load the oldest swapped queuebufs that are not in a slot into the
+   free slots */
+static void
+swap_prefetch(void)
+{
+  struct queuebuf *b;
+  struct queuebuf *oldest;
+  struct swap_slot *slot;
+  int i;
+
+  while((slot = find_slot(NULL)) != NULL) {
+    oldest = NULL;
+    for(i = 0; i < QUEUEBUF_NUM; i++) {
+      b = &((struct queuebuf *)bufmem.mem)[i];
+      if(bufmem.count[i] > 0 && b->location == IN_CFS &&
+         find_slot(b) == NULL &&
+         (oldest == NULL ||
+          (uint16_t)(next_swap_seq - b->swap_seq) >
+          (uint16_t)(next_swap_seq - oldest->swap_seq))) {
+        oldest = b;
+      }
+    }
+    if(oldest == NULL || read_slot(slot, oldest) == -1) {
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+swap_flush(void *unused)
+{
+  write_dirty_slots();
+  qbuf_renew_all();
+  swap_prefetch();
+}
+/*---------------------------------------------------------------------------*/
+/* If the queuebuf is in CFS, load it to a slot. Returns NULL if it
+   cannot be loaded. */
 static struct queuebuf_data *
 queuebuf_load_to_ram(struct queuebuf *b)
 {
-  int fileid, fd, ret;
-  cfs_offset_t offset;
+  struct swap_slot *slot;
   if(b->location == IN_RAM) { /* the qbuf is loacted in RAM */
     return b->ram_ptr;
   } else { /* the qbuf is located in CFS */
-    if(tmpdata_qbuf && tmpdata_qbuf->swap_id == b->swap_id) { /* the qbuf is already in tmpdata */
-      return &tmpdata;
-    } else { /* the qbuf needs to be loaded from CFS */
-      tmpdata_qbuf = b;
-      /* read the qbuf from CFS */
-      fileid = b->swap_id / NQBUF_PER_FILE;
-      offset = (b->swap_id % NQBUF_PER_FILE) * sizeof(struct queuebuf_data);
-      fd = qbuf_files[fileid].fd;
-      ret = cfs_seek(fd, offset, CFS_SEEK_SET);
-      if(ret == -1) {
-        PRINTF("queuebuf_load_to_ram: cfs seek error\n");
-      }
-      ret = cfs_read(fd, &tmpdata, sizeof(struct queuebuf_data));
-      if(ret == -1) {
-        PRINTF("queuebuf_load_to_ram: cfs read error\n");
+    slot = find_slot(b);
+    if(slot == NULL) { /* the qbuf needs to be loaded from CFS */
+      /* A queuebuf that is accessed is usually about to be sent, so
+         the dirty slots are written right away if need be */
+      slot = get_slot(1);
+      if(slot == NULL || read_slot(slot, b) == -1) {
+        return NULL;
       }
-      return &tmpdata;
     }
+    return &slot->data;
   }
 }
+#elif QUEUEBUF_ARENA
+/*---------------------------------------------------------------------------*/
+static struct queuebuf_data *
+queuebuf_load_to_ram(struct queuebuf *b)
+{
+  return (struct queuebuf_data *)MMEM_PTR(&b->mem);
+}
+/*---------------------------------------------------------------------------*/
+/* Allocate arena space for the packetbuf contents. The queuebuf must
+   not hold any space already. */
+static struct queuebuf_data *
+arena_alloc(struct queuebuf *b)
+{
+  if(mmem_alloc(&b->mem, QUEUEBUF_DATA_SIZE(packetbuf_totlen(),
+                                            packetbuf_attr_pack(NULL))) == 0) {
+    return NULL;
+  }
+  return (struct queuebuf_data *)MMEM_PTR(&b->mem);
+}
 #else /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
 static struct queuebuf_data *
@@ -276,6 +490,13 @@ queuebuf_load_to_ram(struct queuebuf *b)
 }
 #endif /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
+static void
+store_packetbuf(struct queuebuf_data *d)
+{
+  d->len = packetbuf_copyto(d->data);
+  d->attrlen = packetbuf_attr_pack(QUEUEBUF_ATTRS(d));
+}
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_init(void)
 {
@@ -285,8 +506,15 @@ queuebuf_init(void)
     qbuf_files[i].renewable = 1;
     qbuf_renew_file(i);
   }
+  for(i = 0; i < QUEUEBUF_SWAP_SLOTS; i++) {
+    swap_slots[i].qbuf = NULL;
+  }
 #endif
+#if QUEUEBUF_ARENA
+  mmem_init();
+#else /* QUEUEBUF_ARENA */
   memb_init(&buframmem);
+#endif /* QUEUEBUF_ARENA */
   memb_init(&bufmem);
 #if QUEUEBUF_STATS
   queuebuf_max_len = 0;
@@ -318,19 +546,47 @@ queuebuf_new_from_packetbuf(void)
     buf->line = line;
     buf->time = clock_time();
 #endif /* QUEUEBUF_DEBUG */
+#if QUEUEBUF_ARENA
+    buframptr = arena_alloc(buf);
+    if(buframptr == NULL) {
+      PRINTF("queuebuf_new_from_packetbuf: could not allocate queuebuf data\n");
+      memb_free(&bufmem, buf);
+      return NULL;
+    }
+#elif WITH_SWAP
     buf->ram_ptr = memb_alloc(&buframmem);
-#if WITH_SWAP
     /* If the allocation failed, store the qbuf in swap files */
     if(buf->ram_ptr != NULL) {
       buf->location = IN_RAM;
       buframptr = buf->ram_ptr;
     } else {
+      struct swap_slot *slot;
+      /* Reserve the record in CFS now, so that the queuebuf can
+         always be written out later */
+      buf->swap_id = get_new_swap_id();
+      if(buf->swap_id == -1) {
+        PRINTF("queuebuf_new_from_packetbuf: swap is full\n");
+        memb_free(&bufmem, buf);
+        return NULL;
+      }
+      /* Never write to CFS on the send path: when all slots wait for
+         the deferred flush, the allocation fails instead */
+      slot = get_slot(0);
+      if(slot == NULL) {
+        PRINTF("queuebuf_new_from_packetbuf: no free swap slot\n");
+        queuebuf_remove_from_file(buf->swap_id);
+        memb_free(&bufmem, buf);
+        return NULL;
+      }
       buf->location = IN_CFS;
-      buf->swap_id = -1;
-      tmpdata_qbuf = buf;
-      buframptr = &tmpdata;
+      buf->swap_seq = next_swap_seq++;
+      slot->qbuf = buf;
+      slot->dirty = 1;
+      buframptr = &slot->data;
+      schedule_flush();
     }
 #else
+    buf->ram_ptr = memb_alloc(&buframmem);
     if(buf->ram_ptr == NULL) {
       PRINTF("queuebuf_new_from_packetbuf: could not queuebuf data\n");
       memb_free(&bufmem, buf);
@@ -339,18 +595,7 @@ queuebuf_new_from_packetbuf(void)
     buframptr = buf->ram_ptr;
 #endif
 
-    buframptr->len = packetbuf_copyto(buframptr->data);
-    packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
-
-#if WITH_SWAP
-    if(buf->location == IN_CFS) {
-      if(queuebuf_flush_tmpdata() == -1) {
-        /* We were unable to write the data in the swap */
-        memb_free(&bufmem, buf);
-        return NULL;
-      }
-    }
-#endif
+    store_packetbuf(buframptr);
 
 #if QUEUEBUF_STATS
     ++queuebuf_len;
@@ -370,35 +615,72 @@ void
 queuebuf_update_attr_from_packetbuf(struct queuebuf *buf)
 {
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
-  packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
-#if WITH_SWAP
-  if(buf->location == IN_CFS) {
-    queuebuf_flush_tmpdata();
+#if QUEUEBUF_ARENA
+  unsigned int size;
+#endif /* QUEUEBUF_ARENA */
+
+  if(buframptr == NULL) {
+    PRINTF("queuebuf_update_attr_from_packetbuf: could not load queuebuf\n");
+    return;
+  }
+#if QUEUEBUF_ARENA
+  size = QUEUEBUF_DATA_SIZE(buframptr->len, packetbuf_attr_pack(NULL));
+  if(size > buf->mem.size) {
+    /* More attributes are set than when the queuebuf was created */
+    if(mmem_realloc(&buf->mem, size) == 0) {
+      PRINTF("queuebuf_update_attr_from_packetbuf: could not grow queuebuf data\n");
+      return;
+    }
+    buframptr = (struct queuebuf_data *)MMEM_PTR(&buf->mem);
   }
+#endif /* QUEUEBUF_ARENA */
+  buframptr->attrlen = packetbuf_attr_pack(QUEUEBUF_ATTRS(buframptr));
+#if WITH_SWAP
+  swap_mark_dirty(buf);
 #endif
 }
 /*---------------------------------------------------------------------------*/
-void
+int
 queuebuf_update_from_packetbuf(struct queuebuf *buf)
 {
-  struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
-  packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
-  buframptr->len = packetbuf_copyto(buframptr->data);
-#if WITH_SWAP
-  if(buf->location == IN_CFS) {
-    queuebuf_flush_tmpdata();
+  struct queuebuf_data *buframptr;
+#if QUEUEBUF_ARENA
+  unsigned int size;
+
+  size = QUEUEBUF_DATA_SIZE(packetbuf_totlen(), packetbuf_attr_pack(NULL));
+  if(size > buf->mem.size && mmem_realloc(&buf->mem, size) == 0) {
+    /* The packet has grown, typically by a MAC header, and the arena
+       is full. The queuebuf keeps the old packet. */
+    PRINTF("queuebuf_update_from_packetbuf: could not grow queuebuf data\n");
+    return 0;
+  }
+#endif /* QUEUEBUF_ARENA */
+  buframptr = queuebuf_load_to_ram(buf);
+  if(buframptr == NULL) {
+    PRINTF("queuebuf_update_from_packetbuf: could not load queuebuf\n");
+    return 0;
   }
+  store_packetbuf(buframptr);
+#if WITH_SWAP
+  swap_mark_dirty(buf);
 #endif
+  return 1;
 }
 /*---------------------------------------------------------------------------*/
 void
 queuebuf_free(struct queuebuf *buf)
 {
   if(memb_inmemb(&bufmem, buf)) {
-#if WITH_SWAP
+#if QUEUEBUF_ARENA
+    mmem_free(&buf->mem);
+#elif WITH_SWAP
     if(buf->location == IN_RAM) {
       memb_free(&buframmem, buf->ram_ptr);
     } else {
+      struct swap_slot *slot = find_slot(buf);
+      if(slot != NULL) {
+        slot->qbuf = NULL;
+      }
       queuebuf_remove_from_file(buf->swap_id);
     }
 #else
@@ -420,8 +702,29 @@ queuebuf_to_packetbuf(struct queuebuf *b)
 {
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+    if(buframptr == NULL) {
+      PRINTF("queuebuf_to_packetbuf: could not load queuebuf\n");
+      packetbuf_clear();
+      return;
+    }
     packetbuf_copyfrom(buframptr->data, buframptr->len);
-    packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
+    packetbuf_attr_unpack(QUEUEBUF_ATTRS(buframptr));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Load only the attributes and addresses into the packetbuf, and
+   leave the packetbuf data empty. This lets an RDC driver that keeps
+   ready-made frames in queuebufs send them straight from
+   queuebuf_dataptr(). */
+void
+queuebuf_attr_to_packetbuf(struct queuebuf *b)
+{
+  if(memb_inmemb(&bufmem, b)) {
+    struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+    packetbuf_clear();
+    if(buframptr != NULL) {
+      packetbuf_attr_unpack(QUEUEBUF_ATTRS(buframptr));
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -430,7 +733,9 @@ queuebuf_dataptr(struct queuebuf *b)
 {
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-    return buframptr->data;
+    if(buframptr != NULL) {
+      return buframptr->data;
+    }
   }
   return NULL;
 }
@@ -439,6 +744,9 @@ int
 queuebuf_datalen(struct queuebuf *b)
 {
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+  if(buframptr == NULL) {
+    return 0;
+  }
   return buframptr->len;
 }
 /*---------------------------------------------------------------------------*/
@@ -446,14 +754,20 @@ linkaddr_t *
 queuebuf_addr(struct queuebuf *b, uint8_t type)
 {
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-  return &buframptr->addrs[type - PACKETBUF_ADDR_FIRST].addr;
+  if(buframptr == NULL) {
+    return NULL;
+  }
+  return (linkaddr_t *)packetbuf_addr_packed(QUEUEBUF_ATTRS(buframptr), type);
 }
 /*---------------------------------------------------------------------------*/
 packetbuf_attr_t
 queuebuf_attr(struct queuebuf *b, uint8_t type)
 {
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
-  return buframptr->attrs[type].val;
+  if(buframptr == NULL) {
+    return 0;
+  }
+  return packetbuf_attr_packed(QUEUEBUF_ATTRS(buframptr), type);
 }
 /*---------------------------------------------------------------------------*/
 void
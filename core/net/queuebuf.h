@@ -79,6 +79,22 @@
   #define WITH_SWAP 0
 #endif /* QUEUEBUFRAM_CONF_NUM */
 
+/* With QUEUEBUF_CONF_ARENA, queuebuf data is allocated from the managed
+   memory arena (lib/mmem) and sized to the length of each packet,
+   rather than taken from a pool of PACKETBUF_SIZE buffers. Pointers
+   returned by queuebuf_dataptr() and queuebuf_addr() are then only
+   valid until the next queuebuf is freed or updated. Swapping is not
+   supported in this mode. */
+#ifdef QUEUEBUF_CONF_ARENA
+#define QUEUEBUF_ARENA QUEUEBUF_CONF_ARENA
+#else
+#define QUEUEBUF_ARENA 0
+#endif
+
+#if QUEUEBUF_ARENA && WITH_SWAP
+#error "QUEUEBUF_CONF_ARENA cannot be used with QUEUEBUFRAM_CONF_NUM < QUEUEBUF_NUM"
+#endif
+
 #ifdef QUEUEBUF_CONF_DEBUG
 #define QUEUEBUF_DEBUG QUEUEBUF_CONF_DEBUG
 #else /* QUEUEBUF_CONF_DEBUG */
@@ -96,9 +112,12 @@ struct queuebuf *queuebuf_new_from_packetbuf_debug(const char *file, int line);
 struct queuebuf *queuebuf_new_from_packetbuf(void);
 #endif /* QUEUEBUF_DEBUG */
 void queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
-void queuebuf_update_from_packetbuf(struct queuebuf *b);
+/* Returns zero if the queuebuf could not hold the packetbuf, in which
+   case it keeps its old contents */
+int queuebuf_update_from_packetbuf(struct queuebuf *b);
 
 void queuebuf_to_packetbuf(struct queuebuf *b);
+void queuebuf_attr_to_packetbuf(struct queuebuf *b);
 void queuebuf_free(struct queuebuf *b);
 
 void *queuebuf_dataptr(struct queuebuf *b);
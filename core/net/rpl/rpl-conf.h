@@ -284,4 +284,47 @@
     + random_rand() % (RPL_PROBING_INTERVAL))
 #endif
 
+/*
+ * Parent updates (link metric changes, rank changes) are coalesced and
+ * handled once per window, in seconds. Within a window, each DAG
+ * selects its preferred parent at most once.
+ * */
+#ifdef RPL_CONF_PARENT_UPDATE_WINDOW
+#define RPL_PARENT_UPDATE_WINDOW RPL_CONF_PARENT_UPDATE_WINDOW
+#else
+#define RPL_PARENT_UPDATE_WINDOW 1
+#endif
+
+/*
+ * Minimum time between two switches of preferred parent in a DAG, in
+ * clock ticks. A switch happens earlier only if the current preferred
+ * parent can no longer be used; a better parent turned down meanwhile
+ * is selected when the hold-off is over. Zero disables the hold-off.
+ * */
+#ifdef RPL_CONF_PARENT_SWITCH_HOLDOFF
+#define RPL_PARENT_SWITCH_HOLDOFF RPL_CONF_PARENT_SWITCH_HOLDOFF
+#else
+#define RPL_PARENT_SWITCH_HOLDOFF 0
+#endif
+
+/*
+ * The number of nodes a non-storing mode root keeps in its source
+ * routing graph.
+ * */
+#ifdef RPL_NS_CONF_LINK_NUM
+#define RPL_NS_LINK_NUM RPL_NS_CONF_LINK_NUM
+#else
+#define RPL_NS_LINK_NUM 32
+#endif
+
+/*
+ * The number of hash buckets used by the root to look up nodes in
+ * the source routing graph.
+ * */
+#ifdef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_HASH_SIZE RPL_NS_CONF_HASH_SIZE
+#else
+#define RPL_NS_HASH_SIZE 16
+#endif
+
 #endif /* RPL_CONF_H */
@@ -45,6 +45,7 @@
 
 #include "contiki.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/ip/uip.h"
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-ds6-nbr.h"
@@ -195,6 +196,31 @@ rpl_set_preferred_parent(rpl_dag_t *dag, rpl_parent_t *p)
   }
 }
 /*---------------------------------------------------------------------------*/
+static rpl_parent_t *select_parent(rpl_dag_t *dag, rpl_parent_t *candidate);
+static rpl_dag_t *select_dag(rpl_instance_t *instance, rpl_dag_t *updated_dag,
+                             rpl_parent_t *candidate);
+
+#if RPL_PARENT_SWITCH_HOLDOFF
+/*---------------------------------------------------------------------------*/
+static void
+handle_parent_switch_timer(void *ptr)
+{
+  rpl_dag_t *dag = ptr;
+
+  if(!dag->parent_switch_held) {
+    return;
+  }
+  dag->parent_switch_held = 0;
+
+  /* Make the parent selection that the hold-off turned down */
+  PRINTF("RPL: Parent switch hold-off over, reselecting\n");
+  if(select_dag(dag->instance, dag, NULL) == NULL) {
+    PRINTF("RPL: No parents found in any DAG\n");
+    rpl_local_repair(dag->instance);
+  }
+}
+#endif /* RPL_PARENT_SWITCH_HOLDOFF */
+/*---------------------------------------------------------------------------*/
 /* Greater-than function for the lollipop counter.                      */
 /*---------------------------------------------------------------------------*/
 static int
@@ -609,6 +635,9 @@ rpl_free_dag(rpl_dag_t *dag)
 
     remove_parents(dag, 0);
   }
+#if RPL_PARENT_SWITCH_HOLDOFF
+  ctimer_stop(&dag->parent_switch_timer);
+#endif /* RPL_PARENT_SWITCH_HOLDOFF */
   dag->used = 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -690,8 +719,12 @@ rpl_find_parent_any_dag(rpl_instance_t *instance, uip_ipaddr_t *addr)
   }
 }
 /*---------------------------------------------------------------------------*/
-rpl_dag_t *
-rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
+/* Select the best DAG of the instance after a change of parents in
+   updated_dag. If only non-preferred parents of updated_dag changed,
+   candidate is the best of them; otherwise it is NULL. */
+static rpl_dag_t *
+select_dag(rpl_instance_t *instance, rpl_dag_t *updated_dag,
+           rpl_parent_t *candidate)
 {
   rpl_parent_t *last_parent;
   rpl_dag_t *dag, *end, *best_dag;
@@ -702,11 +735,11 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
 
   best_dag = instance->current_dag;
   if(best_dag->rank != ROOT_RANK(instance)) {
-    if(rpl_select_parent(p->dag) != NULL) {
-      if(p->dag != best_dag) {
-        best_dag = instance->of->best_dag(best_dag, p->dag);
+    if(select_parent(updated_dag, candidate) != NULL) {
+      if(updated_dag != best_dag) {
+        best_dag = instance->of->best_dag(best_dag, updated_dag);
       }
-    } else if(p->dag == best_dag) {
+    } else if(updated_dag == best_dag) {
       best_dag = NULL;
       for(dag = &instance->dag_table[0], end = dag + RPL_MAX_DAG_PER_INSTANCE; dag < end; ++dag) {
         if(dag->used && dag->preferred_parent != NULL && dag->preferred_parent->rank != INFINITE_RANK) {
@@ -764,6 +797,11 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
     PRINTF("RPL: Changed preferred parent, rank changed from %u to %u\n",
   	(unsigned)old_rank, best_dag->rank);
     RPL_STAT(rpl_stats.parent_switch++);
+#if RPL_PARENT_SWITCH_HOLDOFF
+    best_dag->parent_switch_held = 0;
+    ctimer_set(&best_dag->parent_switch_timer, RPL_PARENT_SWITCH_HOLDOFF,
+               handle_parent_switch_timer, best_dag);
+#endif /* RPL_PARENT_SWITCH_HOLDOFF */
     if(instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
       if(last_parent != NULL) {
         /* Send a No-Path DAO to the removed preferred parent. */
@@ -784,6 +822,12 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
   return best_dag;
 }
 /*---------------------------------------------------------------------------*/
+rpl_dag_t *
+rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
+{
+  return select_dag(instance, p->dag, NULL);
+}
+/*---------------------------------------------------------------------------*/
 static rpl_parent_t *
 best_parent(rpl_dag_t *dag)
 {
@@ -806,10 +850,34 @@ best_parent(rpl_dag_t *dag)
   return best;
 }
 /*---------------------------------------------------------------------------*/
-rpl_parent_t *
-rpl_select_parent(rpl_dag_t *dag)
+static rpl_parent_t *
+select_parent(rpl_dag_t *dag, rpl_parent_t *candidate)
 {
-  rpl_parent_t *best = best_parent(dag);
+  rpl_parent_t *best;
+
+  RPL_STAT(rpl_stats.parent_selections++);
+
+  if(candidate != NULL && dag->preferred_parent != NULL) {
+    /* The parents that did not change still compare worse than the
+       preferred parent, so only the changed ones need a comparison. */
+    best = dag->instance->of->best_parent(dag->preferred_parent, candidate);
+  } else {
+    best = best_parent(dag);
+  }
+
+#if RPL_PARENT_SWITCH_HOLDOFF
+  /* Keep a recently chosen preferred parent as long as it is usable */
+  if(best != NULL && best != dag->preferred_parent &&
+     dag->preferred_parent != NULL &&
+     dag->preferred_parent->dag == dag &&
+     acceptable_rank(dag, dag->preferred_parent->rank) &&
+     !ctimer_expired(&dag->parent_switch_timer)) {
+    PRINTF("RPL: Parent switch held off\n");
+    /* Reselect when the hold-off is over */
+    dag->parent_switch_held = 1;
+    best = dag->preferred_parent;
+  }
+#endif /* RPL_PARENT_SWITCH_HOLDOFF */
 
   if(best != NULL) {
     rpl_set_preferred_parent(dag, best);
@@ -821,6 +889,12 @@ rpl_select_parent(rpl_dag_t *dag)
   return best;
 }
 /*---------------------------------------------------------------------------*/
+rpl_parent_t *
+rpl_select_parent(rpl_dag_t *dag)
+{
+  return select_parent(dag, NULL);
+}
+/*---------------------------------------------------------------------------*/
 void
 rpl_remove_parent(rpl_parent_t *parent)
 {
@@ -1170,23 +1244,83 @@ rpl_local_repair(rpl_instance_t *instance)
 void
 rpl_recalculate_ranks(void)
 {
+  rpl_instance_t *instance, *instance_end;
+  rpl_dag_t *dag, *dag_end;
   rpl_parent_t *p;
+  rpl_parent_t *candidate;
+  int reselect;
+#if RPL_PARENT_UPDATE_WINDOW > 1
+  static uint8_t window_ticks;
+
+  if(++window_ticks < RPL_PARENT_UPDATE_WINDOW) {
+    return;
+  }
+  window_ticks = 0;
+#endif /* RPL_PARENT_UPDATE_WINDOW > 1 */
 
   /*
    * We recalculate ranks when we receive feedback from the system rather
    * than RPL protocol messages. This periodical recalculation is called
    * from a timer in order to keep the stack depth reasonably low.
+   *
+   * All parent updates received since the last call are handled at
+   * once: each DAG selects its preferred parent at most once, and only
+   * compares the updated parents with the preferred one unless the
+   * preferred parent itself changed.
    */
-  p = nbr_table_head(rpl_parents);
-  while(p != NULL) {
-    if(p->dag != NULL && p->dag->instance && (p->flags & RPL_PARENT_FLAG_UPDATED)) {
-      p->flags &= ~RPL_PARENT_FLAG_UPDATED;
-      PRINTF("RPL: rpl_process_parent_event recalculate_ranks\n");
-      if(!rpl_process_parent_event(p->dag->instance, p)) {
-        PRINTF("RPL: A parent was dropped\n");
+  for(instance = &instance_table[0], instance_end = instance + RPL_MAX_INSTANCES;
+      instance < instance_end; ++instance) {
+    if(!instance->used || instance->current_dag == NULL) {
+      continue;
+    }
+    for(dag = &instance->dag_table[0], dag_end = dag + RPL_MAX_DAG_PER_INSTANCE;
+        dag < dag_end; ++dag) {
+      if(!dag->used) {
+        continue;
+      }
+
+      candidate = NULL;
+      reselect = 0;
+      for(p = nbr_table_head(rpl_parents); p != NULL;
+          p = nbr_table_next(rpl_parents, p)) {
+        if(p->dag != dag || !(p->flags & RPL_PARENT_FLAG_UPDATED)) {
+          continue;
+        }
+        p->flags &= ~RPL_PARENT_FLAG_UPDATED;
+        RPL_STAT(rpl_stats.parent_updates++);
+
+        if(!acceptable_rank(dag, p->rank)) {
+          /* The candidate parent is no longer valid: the rank increase
+             resulting from the choice of it as a parent would be too
+             high. */
+          PRINTF("RPL: Unacceptable rank %u\n", (unsigned)p->rank);
+          if(p == dag->preferred_parent) {
+            reselect = 2;
+          }
+          rpl_nullify_parent(p);
+        } else if(p == dag->preferred_parent || dag->preferred_parent == NULL) {
+          reselect = 2;
+        } else {
+          if(reselect == 0) {
+            reselect = 1;
+          }
+          candidate = candidate == NULL ? p :
+            instance->of->best_parent(candidate, p);
+        }
+      }
+
+      if(reselect == 0) {
+        continue;
+      }
+      PRINTF("RPL: recalculate_ranks, %s selection\n",
+             reselect == 1 ? "incremental" : "full");
+      if(select_dag(instance, dag, reselect == 1 ? candidate : NULL) == NULL) {
+        /* No suitable parent; trigger a local repair. */
+        PRINTF("RPL: No parents found in any DAG\n");
+        rpl_local_repair(instance);
+        break;
       }
     }
-    p = nbr_table_next(rpl_parents, p);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -47,7 +47,9 @@
 #include "net/ip/uip.h"
 #include "net/ip/tcpip.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/packetbuf.h"
 
 #define DEBUG DEBUG_NONE
@@ -64,6 +66,54 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+#define UIP_RH_BUF                ((struct uip_routing_hdr *)&uip_buf[uip_l2_l3_hdr_len])
+#define UIP_RPL_SRH_BUF           ((struct uip_rpl_srh_hdr *)&uip_buf[uip_l2_l3_hdr_len + RPL_RH_LEN])
+#define RPL_RH_LEN                4
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* Find the RPL Source Routing Header of the packet in uip_buf, if any */
+static struct uip_routing_hdr *
+find_srh(void)
+{
+  struct uip_ext_hdr *ext;
+  uint8_t *next;
+  int offset;
+
+  next = &UIP_IP_BUF->proto;
+  offset = UIP_LLH_LEN + UIP_IPH_LEN;
+  while(offset + RPL_RH_LEN <= UIP_LLH_LEN + uip_len) {
+    ext = (struct uip_ext_hdr *)&uip_buf[offset];
+    switch(*next) {
+    case UIP_PROTO_HBHO:
+    case UIP_PROTO_DESTO:
+      next = &ext->next;
+      offset += (ext->len << 3) + 8;
+      break;
+    case UIP_PROTO_ROUTING:
+      if(((struct uip_routing_hdr *)ext)->routing_type == RPL_RH_TYPE_SRH) {
+        return (struct uip_routing_hdr *)ext;
+      }
+      return NULL;
+    default:
+      return NULL;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* The DAG of which we are the non-storing mode root, if any */
+static rpl_dag_t *
+ns_root_dag(void)
+{
+  if(RPL_IS_NON_STORING(default_instance) &&
+     default_instance->current_dag != NULL &&
+     default_instance->current_dag->joined &&
+     default_instance->current_dag->rank == ROOT_RANK(default_instance)) {
+    return default_instance->current_dag;
+  }
+  return NULL;
+}
+#endif /* RPL_WITH_NON_STORING */
 /*---------------------------------------------------------------------------*/
 int
 rpl_verify_header(int uip_ext_opt_offset)
@@ -185,6 +235,13 @@ rpl_update_header_empty(void)
   int last_uip_ext_len;
   rpl_parent_t *parent;
 
+#if RPL_WITH_NON_STORING
+  if(find_srh() != NULL) {
+    /* Source routed packets carry no RPL option */
+    return 0;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
   last_uip_ext_len = uip_ext_len;
   uip_ext_len = 0;
   uip_ext_opt_offset = 2;
@@ -373,6 +430,198 @@ rpl_invert_header(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+int
+rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
+{
+#if RPL_WITH_NON_STORING
+  rpl_dag_t *dag;
+  rpl_ns_node_t *dest_node;
+
+  if(find_srh() == NULL) {
+    /* The root reaches its children directly, without a routing header */
+    dag = ns_root_dag();
+    if(dag == NULL) {
+      return 0;
+    }
+    dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+    if(dest_node == NULL || dest_node->parent == NULL ||
+       dest_node->parent != rpl_ns_get_node(dag, &dag->dag_id)) {
+      return 0;
+    }
+  }
+
+  /* Along a source route, the destination is always the next hop */
+  uip_ipaddr_copy(ipaddr, &UIP_IP_BUF->destipaddr);
+  uip_create_linklocal_prefix(ipaddr);
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 0;
+#endif /* RPL_WITH_NON_STORING */
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_process_srh_header(void)
+{
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t next_dest;
+  uint8_t *addr_ptr;
+  int cmpri, cmpre, pad;
+  int path_len, seg_left, addr_len, i;
+
+  if(UIP_RH_BUF->routing_type != RPL_RH_TYPE_SRH) {
+    return 0;
+  }
+
+  seg_left = UIP_RH_BUF->seg_left;
+  cmpri = UIP_RPL_SRH_BUF->cmpr >> 4;
+  cmpre = UIP_RPL_SRH_BUF->cmpr & 0x0f;
+  pad = UIP_RPL_SRH_BUF->pad >> RPL_SRH_PAD_SHIFT;
+  if(UIP_RH_BUF->len * 8 < pad + (16 - cmpre)) {
+    PRINTF("RPL: SRH too short\n");
+    return 0;
+  }
+  path_len = ((UIP_RH_BUF->len * 8) - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+
+  PRINTF("RPL: SRH with %d addresses, %d segments left\n", path_len, seg_left);
+
+  if(seg_left == 0 || seg_left > path_len) {
+    return 0;
+  }
+
+  if(UIP_IP_BUF->ttl <= 1) {
+    uip_icmp6_error_output(ICMP6_TIME_EXCEEDED, ICMP6_TIME_EXCEED_TRANSIT, 0);
+    return 1;
+  }
+
+  /* The next address, which shares its elided prefix with the current
+     destination */
+  i = path_len - seg_left;
+  addr_len = (i == path_len - 1) ? 16 - cmpre : 16 - cmpri;
+  addr_ptr = (uint8_t *)UIP_RPL_SRH_BUF + RPL_SRH_LEN + i * (16 - cmpri);
+  uip_ipaddr_copy(&next_dest, &UIP_IP_BUF->destipaddr);
+  memcpy(((uint8_t *)&next_dest) + 16 - addr_len, addr_ptr, addr_len);
+
+  if(uip_is_addr_mcast(&next_dest) || uip_ds6_is_my_addr(&next_dest)) {
+    PRINTF("RPL: SRH with bad next address\n");
+    return 0;
+  }
+
+  /* Swap the destination and the next address, so that the header
+     records the path taken */
+  memcpy(addr_ptr, ((uint8_t *)&UIP_IP_BUF->destipaddr) + 16 - addr_len, addr_len);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &next_dest);
+  UIP_RH_BUF->seg_left--;
+  UIP_IP_BUF->ttl--;
+
+  PRINTF("RPL: SRH next hop ");
+  PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+  PRINTF("\n");
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 0;
+#endif /* RPL_WITH_NON_STORING */
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_insert_srh_header(void)
+{
+#if RPL_WITH_NON_STORING
+  rpl_dag_t *dag;
+  rpl_ns_node_t *dest_node;
+  rpl_ns_node_t *root_node;
+  rpl_ns_node_t *node;
+  struct uip_routing_hdr *rh;
+  struct uip_rpl_srh_hdr *srh;
+  uip_ipaddr_t node_addr;
+  uint8_t *addr_ptr;
+  uint16_t ip_len;
+  int path_len, cmpr, addr_len, pad, hdr_len, i;
+
+  dag = ns_root_dag();
+  if(dag == NULL ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) ||
+     find_srh() != NULL) {
+    return 1;
+  }
+
+  dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+  root_node = rpl_ns_get_node(dag, &dag->dag_id);
+  if(dest_node == NULL || root_node == NULL || dest_node == root_node ||
+     !rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
+    /* Not in the DODAG; let the regular routing handle it */
+    return 1;
+  }
+
+  /* Count the hops below the root, and the number of leading bytes
+     all their addresses have in common */
+  path_len = 0;
+  cmpr = 15;
+  for(node = dest_node; node != root_node; node = node->parent) {
+    path_len++;
+    for(i = 0; i < cmpr - 8 &&
+          node->link_identifier[i] == dest_node->link_identifier[i]; i++);
+    cmpr = 8 + i;
+  }
+
+  if(path_len == 1) {
+    /* A child of the root; no routing header needed */
+    return 1;
+  }
+
+  /* The first hop goes in the IPv6 destination, the following hops
+     down to the destination in the address vector. */
+  path_len--;
+  addr_len = 16 - cmpr;
+  pad = (8 - (path_len * addr_len) % 8) % 8;
+  hdr_len = RPL_RH_LEN + RPL_SRH_LEN + path_len * addr_len + pad;
+
+  /* The RPL option is not used along source routes */
+  rpl_remove_header();
+
+  if(uip_len + hdr_len > UIP_BUFSIZE - UIP_LLH_LEN) {
+    PRINTF("RPL: Packet too long: impossible to add source routing header\n");
+    return 0;
+  }
+
+  PRINTF("RPL: Inserting SRH, %d addresses, compression %d\n",
+         path_len, cmpr);
+
+  memmove(&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + hdr_len],
+          &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN], uip_len - UIP_IPH_LEN);
+
+  rh = (struct uip_routing_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+  srh = (struct uip_rpl_srh_hdr *)((uint8_t *)rh + RPL_RH_LEN);
+  addr_ptr = (uint8_t *)srh + RPL_SRH_LEN;
+  memset(rh, 0, hdr_len);
+
+  rh->next = UIP_IP_BUF->proto;
+  rh->len = (hdr_len - 8) / 8;
+  rh->routing_type = RPL_RH_TYPE_SRH;
+  rh->seg_left = path_len;
+  srh->cmpr = (cmpr << 4) | cmpr;
+  srh->pad = pad << RPL_SRH_PAD_SHIFT;
+
+  /* Walk up from the destination, filling the vector backwards */
+  node = dest_node;
+  for(i = path_len - 1; i >= 0; i--) {
+    rpl_ns_get_node_global_addr(&node_addr, node);
+    memcpy(addr_ptr + i * addr_len, ((uint8_t *)&node_addr) + cmpr, addr_len);
+    node = node->parent;
+  }
+  rpl_ns_get_node_global_addr(&UIP_IP_BUF->destipaddr, node);
+
+  UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  uip_len += hdr_len;
+  ip_len = ((UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]) + hdr_len;
+  UIP_IP_BUF->len[0] = ip_len >> 8;
+  UIP_IP_BUF->len[1] = ip_len & 0xff;
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 1;
+#endif /* RPL_WITH_NON_STORING */
+}
+/*---------------------------------------------------------------------------*/
 void
 rpl_insert_header(void)
 {
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+/**
+ * \file
+ *         RPL non-storing mode specific functions. Only the root keeps
+ *         downward routing state: for every node, the parent it
+ *         advertised in its last DAO. Nodes are hashed on their
+ *         interface identifier, so that lookups stay cheap when the
+ *         graph holds thousands of nodes.
+ */
+
+#include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+#include <string.h>
+
+#if RPL_WITH_NON_STORING
+
+static int num_nodes;
+
+/* Hash buckets of the nodes; each bucket is a list */
+static void *buckets[RPL_NS_HASH_SIZE];
+MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+
+/*---------------------------------------------------------------------------*/
+static list_t
+bucket(const unsigned char *link_identifier)
+{
+  unsigned hash;
+  int i;
+
+  hash = 0;
+  for(i = 0; i < 8; i++) {
+    hash = (hash * 31) + link_identifier[i];
+  }
+  return (list_t)&buckets[hash % RPL_NS_HASH_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+static int
+node_matches_address(const rpl_dag_t *dag, const rpl_ns_node_t *node,
+                     const uip_ipaddr_t *addr)
+{
+  return addr != NULL && node != NULL && dag != NULL && dag == node->dag &&
+    !memcmp(addr, &dag->dag_id, 8) &&
+    !memcmp((const unsigned char *)addr + 8, node->link_identifier, 8);
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_parent(rpl_ns_node_t *node, rpl_ns_node_t *parent)
+{
+  if(node->parent != NULL) {
+    node->parent->children--;
+  }
+  node->parent = parent;
+  if(parent != NULL) {
+    parent->children++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t *
+add_node(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+
+  node = memb_alloc(&nodememb);
+  if(node == NULL) {
+    return NULL;
+  }
+  memset(node, 0, sizeof(*node));
+  node->dag = dag;
+  memcpy(node->link_identifier, (const unsigned char *)addr + 8, 8);
+  list_add(bucket(node->link_identifier), node);
+  num_nodes++;
+  return node;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_node(rpl_ns_node_t *node)
+{
+  set_parent(node, NULL);
+  list_remove(bucket(node->link_identifier), node);
+  memb_free(&nodememb, node);
+  num_nodes--;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_num_nodes(void)
+{
+  return num_nodes;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_node_head(void)
+{
+  int i;
+
+  for(i = 0; i < RPL_NS_HASH_SIZE; i++) {
+    if(buckets[i] != NULL) {
+      return buckets[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_node_next(rpl_ns_node_t *item)
+{
+  list_t current;
+  int i;
+
+  if(item == NULL) {
+    return NULL;
+  }
+  if(item->next != NULL) {
+    return item->next;
+  }
+  current = bucket(item->link_identifier);
+  for(i = (void **)current - buckets + 1; i < RPL_NS_HASH_SIZE; i++) {
+    if(buckets[i] != NULL) {
+      return buckets[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *l;
+
+  if(dag == NULL || addr == NULL) {
+    return NULL;
+  }
+  for(l = list_head(bucket((const unsigned char *)addr + 8));
+      l != NULL; l = list_item_next(l)) {
+    if(node_matches_address(dag, l, addr)) {
+      return l;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+  rpl_ns_node_t *root_node;
+  int max_depth;
+
+  node = rpl_ns_get_node(dag, addr);
+  root_node = rpl_ns_get_node(dag, &dag->dag_id);
+
+  /* Follow the parents up to the root; the depth bound stops loops
+     left by inconsistent DAOs. */
+  max_depth = RPL_NS_LINK_NUM;
+  while(node != NULL && node != root_node && max_depth > 0) {
+    node = node->parent;
+    max_depth--;
+  }
+  return node != NULL && node == root_node;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node)
+{
+  if(addr != NULL && node != NULL && node->dag != NULL) {
+    memcpy(addr, &node->dag->dag_id, 8);
+    memcpy(((unsigned char *)addr) + 8, node->link_identifier, 8);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                     const uip_ipaddr_t *parent)
+{
+  rpl_ns_node_t *l;
+
+  l = rpl_ns_get_node(dag, child);
+  /* Only expire the link if it is the one we know of */
+  if(l != NULL && node_matches_address(dag, l->parent, parent)) {
+    l->lifetime = DAO_EXPIRATION_TIMEOUT;
+  }
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                   const uip_ipaddr_t *parent, uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+
+  child_node = rpl_ns_get_node(dag, child);
+  if(child_node == NULL) {
+    child_node = add_node(dag, child);
+    if(child_node == NULL) {
+      PRINTF("RPL: NS graph full, could not add ");
+      PRINT6ADDR(child);
+      PRINTF("\n");
+      return NULL;
+    }
+  }
+
+  parent_node = rpl_ns_get_node(dag, parent);
+  if(parent_node == NULL) {
+    /* The parent has not sent a DAO yet (or is the root); keep a
+       placeholder with no lifetime so that the link can be stored. */
+    parent_node = add_node(dag, parent);
+    if(parent_node == NULL) {
+      PRINTF("RPL: NS graph full, could not add parent ");
+      PRINT6ADDR(parent);
+      PRINTF("\n");
+      return NULL;
+    }
+  }
+
+  if(parent_node == child_node) {
+    return NULL;
+  }
+
+  set_parent(child_node, parent_node);
+  child_node->lifetime = lifetime;
+
+  PRINTF("RPL: NS updated link, child ");
+  PRINT6ADDR(child);
+  PRINTF(", parent ");
+  PRINT6ADDR(parent);
+  PRINTF(", lifetime %lu, num_nodes %u\n", (unsigned long)lifetime, num_nodes);
+
+  return child_node;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_remove_dag(const rpl_dag_t *dag)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+  int i;
+
+  /* Drop all links first so that the nodes can be freed in any order */
+  for(l = rpl_ns_node_head(); l != NULL; l = rpl_ns_node_next(l)) {
+    if(l->dag == dag) {
+      set_parent(l, NULL);
+    }
+  }
+  for(i = 0; i < RPL_NS_HASH_SIZE; i++) {
+    for(l = buckets[i]; l != NULL; l = next) {
+      next = list_item_next(l);
+      if(l->dag == dag) {
+        remove_node(l);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Called every second */
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+  int i;
+
+  for(i = 0; i < RPL_NS_HASH_SIZE; i++) {
+    for(l = buckets[i]; l != NULL; l = next) {
+      next = list_item_next(l);
+      if(l->lifetime > 0) {
+        l->lifetime--;
+        if(l->lifetime == 0) {
+          /* The link has expired; the node stays until no other node
+             uses it as parent. */
+          set_parent(l, NULL);
+        }
+      } else if(l->children == 0) {
+        remove_node(l);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_init(void)
+{
+  int i;
+
+  num_nodes = 0;
+  memb_init(&nodememb);
+  for(i = 0; i < RPL_NS_HASH_SIZE; i++) {
+    buckets[i] = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_WITH_NON_STORING */
+
+/** @}*/
@@ -100,6 +100,17 @@
 #define RPL_HDR_OPT_RANK_ERR_SHIFT   	6
 #define RPL_HDR_OPT_FWD_ERR		0x20
 #define RPL_HDR_OPT_FWD_ERR_SHIFT   	5
+
+/* RPL Source Routing Header (RFC 6554). */
+#define RPL_RH_TYPE_SRH                 3
+#define RPL_SRH_LEN                     4
+#define RPL_SRH_PAD_SHIFT               4
+
+struct uip_rpl_srh_hdr {
+  uint8_t cmpr; /* CmprI and CmprE */
+  uint8_t pad;
+  uint8_t reserved[2];
+};
 /*---------------------------------------------------------------------------*/
 /* Default values for RPL constants and variables. */
 
@@ -163,6 +174,17 @@
 #endif /* UIP_IPV6_MULTICAST_RPL */
 #endif /* RPL_CONF_MOP */
 
+/* Non-storing mode support is included when it is the default MOP. */
+#ifdef RPL_CONF_WITH_NON_STORING
+#define RPL_WITH_NON_STORING            RPL_CONF_WITH_NON_STORING
+#else
+#define RPL_WITH_NON_STORING            (RPL_MOP_DEFAULT == RPL_MOP_NON_STORING)
+#endif /* RPL_CONF_WITH_NON_STORING */
+
+#define RPL_IS_NON_STORING(instance) \
+  (RPL_WITH_NON_STORING && (instance) != NULL && \
+   (instance)->mop == RPL_MOP_NON_STORING)
+
 /* Emit a pre-processor error if the user configured multicast with bad MOP */
 #if RPL_CONF_MULTICAST && (RPL_MOP_DEFAULT != RPL_MOP_STORING_MULTICAST)
 #error "RPL Multicast requires RPL_MOP_DEFAULT==3. Check contiki-conf.h"
@@ -246,6 +268,10 @@ struct rpl_stats {
   uint16_t loop_errors;
   uint16_t loop_warnings;
   uint16_t root_repairs;
+  uint16_t parent_updates;
+  uint16_t parent_selections;
+  uint16_t trickle_resets;
+  uint32_t control_bytes;
 };
 typedef struct rpl_stats rpl_stats_t;
 
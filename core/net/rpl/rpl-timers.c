@@ -192,6 +192,7 @@ rpl_reset_dio_timer(rpl_instance_t *instance)
     instance->dio_counter = 0;
     instance->dio_intcurrent = instance->dio_intmin;
     new_dio_interval(instance);
+    RPL_STAT(rpl_stats.trickle_resets++);
   }
 #if RPL_CONF_STATS
   rpl_stats.resets++;
@@ -47,6 +47,7 @@
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 
 #define DEBUG DEBUG_NONE
@@ -152,6 +153,11 @@ rpl_purge_routes(void)
     }
   }
 
+#if RPL_WITH_NON_STORING
+  /* Expire the links of the non-storing mode root */
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
+
 #if RPL_CONF_MULTICAST
   mcast_route = uip_mcast6_route_list_head();
 
@@ -186,6 +192,11 @@ rpl_remove_routes(rpl_dag_t *dag)
     }
   }
 
+#if RPL_WITH_NON_STORING
+  /* Remove the links learnt by the non-storing mode root */
+  rpl_ns_remove_dag(dag);
+#endif /* RPL_WITH_NON_STORING */
+
 #if RPL_CONF_MULTICAST
   mcast_route = uip_mcast6_route_list_head();
 
@@ -301,6 +312,9 @@ rpl_init(void)
   default_instance = NULL;
 
   rpl_dag_init();
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
   rpl_reset_periodic_timer();
   rpl_icmp6_register_handlers();
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \addtogroup cc2538-ccm-star
+ * @{
+ *
+ * \file
+ * Implementation of the cc2538 CCM* driver
+ */
+#include "contiki.h"
+#include "dev/crypto.h"
+#include "dev/aes.h"
+#include "dev/ccm.h"
+#include "dev/cc2538-ccm-star.h"
+
+#include <stdint.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+/* The 13-octet CCM* nonce leaves 2 octets for the length field */
+#define LEN_LEN (15 - CCM_STAR_NONCE_LENGTH)
+
+static uint8_t key_loaded;
+/*---------------------------------------------------------------------------*/
+static void
+mic(const uint8_t *m, uint8_t m_len,
+    const uint8_t *nonce,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result,
+    uint8_t mic_len)
+{
+  ccm_star_driver.mic(m, m_len, nonce, a, a_len, result, mic_len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+ctr(uint8_t *m, uint8_t m_len, const uint8_t *nonce)
+{
+  ccm_star_driver.ctr(m, m_len, nonce);
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_key(const uint8_t *key)
+{
+  static uint8_t initialized;
+
+  if(!initialized) {
+    crypto_init();
+    initialized = 1;
+  }
+  key_loaded = aes_load_keys(key, AES_KEY_STORE_SIZE_KEY_SIZE_128, 1,
+                             CC2538_CCM_STAR_KEY_AREA) == CRYPTO_SUCCESS;
+
+  /* The software driver serves mic, ctr and the fallback paths */
+  ccm_star_driver.set_key(key);
+}
+/*---------------------------------------------------------------------------*/
+static void
+aead(const uint8_t *nonce,
+     uint8_t *m, uint8_t m_len,
+     const uint8_t *a, uint8_t a_len,
+     uint8_t *result, uint8_t mic_len,
+     int forward)
+{
+  uint8_t ret;
+
+  /* The engine implements CCM, which has no MIC-less mode */
+  if(!key_loaded || mic_len < 4 || (mic_len & 1)) {
+    ccm_star_driver.aead(nonce, m, m_len, a, a_len, result, mic_len, forward);
+    return;
+  }
+
+  if(forward) {
+    ret = ccm_auth_encrypt_start(LEN_LEN, CC2538_CCM_STAR_KEY_AREA, nonce,
+                                 a, a_len, m, m_len, mic_len, NULL);
+    if(ret != CRYPTO_SUCCESS) {
+      ccm_star_driver.aead(nonce, m, m_len, a, a_len, result, mic_len, 1);
+      return;
+    }
+    while(!ccm_auth_encrypt_check_status());
+    ccm_auth_encrypt_get_result(result, mic_len);
+    return;
+  }
+
+  /* The engine checks the received MIC, which follows m */
+  ret = ccm_auth_decrypt_start(LEN_LEN, CC2538_CCM_STAR_KEY_AREA, nonce,
+                               a, a_len, m, m_len + mic_len, mic_len, NULL);
+  if(ret != CRYPTO_SUCCESS) {
+    ccm_star_driver.aead(nonce, m, m_len, a, a_len, result, mic_len, 0);
+    return;
+  }
+  while(!ccm_auth_decrypt_check_status());
+  ret = ccm_auth_decrypt_get_result(m, m_len + mic_len, result, mic_len);
+  if(ret != CRYPTO_SUCCESS) {
+    /* Hand back a MIC that is sure to differ from the received one */
+    memcpy(result, m + m_len, mic_len);
+    result[0] ^= 0xff;
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct ccm_star_driver cc2538_ccm_star_driver = {
+  mic,
+  ctr,
+  set_key,
+  aead
+};
+/*---------------------------------------------------------------------------*/
+
+/**
+ * @}
+ * @}
+ */
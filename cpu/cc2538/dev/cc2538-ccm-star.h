@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+/**
+ * \addtogroup cc2538-ccm
+ * @{
+ *
+ * \defgroup cc2538-ccm-star cc2538 CCM* driver
+ *
+ * CCM_STAR driver that hands one-pass authenticated en- and decryption of
+ * frames to the AES-CCM engine of the security core
+ * @{
+ *
+ * \file
+ * Header file for the cc2538 CCM* driver
+ */
+#ifndef CC2538_CCM_STAR_H_
+#define CC2538_CCM_STAR_H_
+
+#include "contiki.h"
+#include "lib/ccm-star.h"
+/*---------------------------------------------------------------------------*/
+/** \name CCM* driver configuration
+ * @{
+ */
+#ifdef CC2538_CCM_STAR_CONF_KEY_AREA
+#define CC2538_CCM_STAR_KEY_AREA CC2538_CCM_STAR_CONF_KEY_AREA
+#else
+#define CC2538_CCM_STAR_KEY_AREA 0 /**< Key RAM area holding the llsec key */
+#endif
+/** @} */
+/*---------------------------------------------------------------------------*/
+/**
+ * \brief The cc2538 CCM* driver. Select it with \c CCM_STAR_CONF.
+ *
+ * Only aead is run on the engine; mic, ctr and MIC lengths the engine
+ * does not support fall back to the generic software driver.
+ */
+extern const struct ccm_star_driver cc2538_ccm_star_driver;
+
+#endif /* CC2538_CCM_STAR_H_ */
+
+/**
+ * @}
+ * @}
+ */
@@ -42,6 +42,14 @@
 
 #include "tapdev-drv.h"
 
+/* The most frames handled per poll. When there are more, the driver
+   polls itself again after other processes have had a turn. */
+#ifdef TAPDEV_DRV_CONF_BATCH
+#define TAPDEV_DRV_BATCH TAPDEV_DRV_CONF_BATCH
+#else
+#define TAPDEV_DRV_BATCH 32
+#endif
+
 #define BUF ((struct uip_eth_hdr *)&uip_buf[0])
 #define IPBUF ((struct uip_tcpip_hdr *)&uip_buf[UIP_LLH_LEN])
 
@@ -59,10 +67,8 @@ tapdev_output(void)
 #endif
 /*---------------------------------------------------------------------------*/
 static void
-pollhandler(void)
+input(void)
 {
-  uip_len = tapdev_poll();
-
   if(uip_len > 0) {
 #if NETSTACK_CONF_WITH_IPV6
     if(BUF->type == uip_htons(UIP_ETHTYPE_IPV6)) {
@@ -88,6 +94,22 @@ pollhandler(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+pollhandler(void)
+{
+  int n;
+
+  /* Drain the pending frames, not just one per wakeup */
+  for(n = 0; n < TAPDEV_DRV_BATCH; n++) {
+    uip_len = tapdev_poll();
+    if(uip_len == 0) {
+      return;
+    }
+    input();
+  }
+  process_poll(&tapdev_process);
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(tapdev_process, ev, data)
 {
   PROCESS_POLLHANDLER(pollhandler());
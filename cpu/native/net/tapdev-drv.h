@@ -34,10 +34,14 @@
 #define TAPDEV_DRV_H_
 
 #include "contiki.h"
+#include <sys/select.h>
 
 PROCESS_NAME(tapdev_process);
 
 uint8_t tapdev_output(void);
 int tapdev_fd(void);
+/* Adds the descriptors of all TAP queues to fdset and returns the
+   highest one */
+int tapdev_set_fds(fd_set *fdset);
 
 #endif /* TAPDEV_DRV_H_ */
@@ -87,6 +87,15 @@ tapdev_fd(void)
 {
   return fd;
 }
+/*---------------------------------------------------------------------------*/
+int
+tapdev_set_fds(fd_set *fdset)
+{
+  if(fd > 0) {
+    FD_SET(fd, fdset);
+  }
+  return fd;
+}
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -165,6 +174,7 @@ tapdev_poll(void)
 
   if(ret == -1) {
     perror("tapdev_poll: read");
+    return 0;
   }
   return ret;
 }
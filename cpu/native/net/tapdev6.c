@@ -49,6 +49,7 @@
 #include <sys/time.h>
 #include <sys/uio.h>
 #include <sys/socket.h>
+#include <errno.h>
 
 
 #ifdef linux
@@ -81,7 +82,15 @@
 static int drop = 0;
 #endif
 
-static int fd = -1;
+/* Frames are read from and written to TAPDEV_QUEUES queues of the
+   same interface. Linux spreads incoming flows across the queues. */
+#if TAPDEV_QUEUES > 1 && !(defined(linux) && defined(IFF_MULTI_QUEUE))
+#error TAPDEV_CONF_QUEUES > 1 needs multi-queue TAP support (Linux 3.8)
+#endif
+
+static int fds[TAPDEV_QUEUES];
+static uint8_t rxq;
+static struct tapdev_stats stats[TAPDEV_QUEUES];
 
 static unsigned long lasttime;
 
@@ -104,38 +113,68 @@ uint8_t tapdev_send(const uip_lladdr_t *lladdr);
 int
 tapdev_fd(void)
 {
-  return fd;
+  return fds[0];
 }
-
-
+/*---------------------------------------------------------------------------*/
+int
+tapdev_set_fds(fd_set *fdset)
+{
+  int i, max;
+
+  max = -1;
+  for(i = 0; i < TAPDEV_QUEUES; i++) {
+    if(fds[i] > 0) {
+      FD_SET(fds[i], fdset);
+      if(fds[i] > max) {
+        max = fds[i];
+      }
+    }
+  }
+  return max;
+}
+/*---------------------------------------------------------------------------*/
+const struct tapdev_stats *
+tapdev_get_stats(int queue)
+{
+  if(queue < 0 || queue >= TAPDEV_QUEUES) {
+    return NULL;
+  }
+  return &stats[queue];
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The queues are non-blocking, so a read tells if a frame is waiting
+ * and no select() is needed per frame. Queues are visited in turn so
+ * that a busy one does not starve the others.
+ */
 uint16_t
 tapdev_poll(void)
 {
-  fd_set fdset;
-  struct timeval tv;
-  int ret;
-  
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
-  
-  FD_ZERO(&fdset);
-  if(fd > 0) {
-    FD_SET(fd, &fdset);
-  }
+  int i, ret;
 
-  ret = select(fd + 1, &fdset, NULL, NULL, &tv);
+  for(i = 0; i < TAPDEV_QUEUES; i++) {
+    if(++rxq >= TAPDEV_QUEUES) {
+      rxq = 0;
+    }
+    if(fds[rxq] <= 0) {
+      continue;
+    }
 
-  if(ret == 0) {
-    return 0;
-  }
-  ret = read(fd, uip_buf, UIP_BUFSIZE);
+    ret = read(fds[rxq], uip_buf, UIP_BUFSIZE);
 
-  PRINTF("tapdev6: read %d bytes (max %d)\n", ret, UIP_BUFSIZE);
-  
-  if(ret == -1) {
-    perror("tapdev_poll: read");
+    if(ret > 0) {
+      PRINTF("tapdev6: read %d bytes (max %d) on queue %d\n",
+             ret, UIP_BUFSIZE, rxq);
+      stats[rxq].rx_packets++;
+      stats[rxq].rx_bytes += ret;
+      return ret;
+    }
+    if(ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      perror("tapdev_poll: read");
+      stats[rxq].rx_errors++;
+    }
   }
-  return ret;
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 #if defined(__APPLE__)
@@ -146,7 +185,7 @@ tapdev_init_darwin_routes(void)
 {
   struct stat st;
 
-  if(-1 == fstat(fd, &st)) {
+  if(-1 == fstat(fds[0], &st)) {
     perror("tapdev: fstat failed.");
     exit(EXIT_FAILURE);
   }
@@ -295,24 +334,33 @@ void
 tapdev_init(void)
 {
   char buf[1024];
-  
-  fd = open(DEVTAP, O_RDWR);
-  if(fd == -1) {
-    perror("tapdev: tapdev_init: open");
-    return;
-  }
+  int i;
+#ifdef linux
+  struct ifreq ifr;
+
+  memset(&ifr, 0, sizeof(ifr));
+#endif /* linux */
+
+  for(i = 0; i < TAPDEV_QUEUES; i++) {
+    fds[i] = open(DEVTAP, O_RDWR | O_NONBLOCK);
+    if(fds[i] == -1) {
+      perror("tapdev: tapdev_init: open");
+      return;
+    }
 
 #ifdef linux
-  {
-    struct ifreq ifr;
-    memset(&ifr, 0, sizeof(ifr));
+    /* Every queue after the first attaches to the interface that the
+       first one created, as ifr_name is filled in by then */
     ifr.ifr_flags = IFF_TAP|IFF_NO_PI;
-    if (ioctl(fd, TUNSETIFF, (void *) &ifr) < 0) {
-      perror(buf);
+#if TAPDEV_QUEUES > 1
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#endif /* TAPDEV_QUEUES > 1 */
+    if (ioctl(fds[i], TUNSETIFF, (void *) &ifr) < 0) {
+      perror("tapdev: tapdev_init: TUNSETIFF");
       exit(1);
     }
-  }
 #endif /* Linux */
+  }
 
 #ifdef __APPLE__
   tapdev_init_darwin_routes();
@@ -347,8 +395,12 @@ static void
 do_send(void)
 {
   int ret;
+  int q;
 
-  if(fd <= 0) {
+  /* Keep each destination on one queue, so its frames stay in order */
+  q = TAPDEV_QUEUES > 1 ? IPBUF->destipaddr.u8[15] % TAPDEV_QUEUES : 0;
+
+  if(fds[q] <= 0) {
     return;
   }
 
@@ -363,12 +415,19 @@ do_send(void)
   }
 #endif /* DROP */
 
-  ret = write(fd, uip_buf, uip_len);
+  ret = write(fds[q], uip_buf, uip_len);
 
   if(ret == -1) {
+    if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      /* The queue is full; the frame is lost as on a real link */
+      stats[q].tx_errors++;
+      return;
+    }
     perror("tap_dev: tapdev_send: writev");
     exit(1);
   }
+  stats[q].tx_packets++;
+  stats[q].tx_bytes += ret;
 }
 /*---------------------------------------------------------------------------*/
 uint8_t
@@ -409,13 +468,19 @@ tapdev_do_send(void)
 void
 tapdev_exit(void)
 {
+  int i;
+
   PRINTF("tapdev: Closing...\n");
 
 #ifdef __APPLE__
   tapdev_cleanup_darwin_routes();
 #endif
 
-  close(fd);
+  for(i = 0; i < TAPDEV_QUEUES; i++) {
+    if(fds[i] > 0) {
+      close(fds[i]);
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
 
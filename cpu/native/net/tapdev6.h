@@ -38,9 +38,28 @@
 
 #include "contiki-net.h"
 
+/* The number of queues to open on the TAP interface. More than one
+   needs Linux multi-queue TAP support (IFF_MULTI_QUEUE). */
+#ifdef TAPDEV_CONF_QUEUES
+#define TAPDEV_QUEUES TAPDEV_CONF_QUEUES
+#else
+#define TAPDEV_QUEUES 1
+#endif
+
+/* Per queue counters */
+struct tapdev_stats {
+  unsigned long rx_packets;
+  unsigned long rx_bytes;
+  unsigned long rx_errors;
+  unsigned long tx_packets;
+  unsigned long tx_bytes;
+  unsigned long tx_errors;
+};
+
 void tapdev_init(void);
 uint8_t tapdev_send(const uip_lladdr_t *lladdr);
 uint16_t tapdev_poll(void);
 void tapdev_do_send(void);
 void tapdev_exit(void); //math
+const struct tapdev_stats *tapdev_get_stats(int queue);
 #endif /* TAPDEV_H_ */
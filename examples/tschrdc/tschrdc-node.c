@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Example of the tschrdc layer. Node 1 is the coordinator and
+ *         the other nodes send it a unicast every few seconds, which
+ *         it prints with its latency. On the native platform the node
+ *         id is the index of the process on the native radio medium,
+ *         so the first process started is the coordinator.
+ */
+
+#include "contiki.h"
+#include "net/rime/rime.h"
+#include "net/netstack.h"
+#include "net/mac/tschrdc/tschrdc.h"
+#include "lib/random.h"
+
+#if CONTIKI_TARGET_NATIVE
+#include "dev/native-radio.h"
+#else
+#include "sys/node-id.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#define SEND_INTERVAL (4 * CLOCK_SECOND)
+
+/*---------------------------------------------------------------------------*/
+PROCESS(tschrdc_node_process, "tschrdc example node");
+AUTOSTART_PROCESSES(&tschrdc_node_process);
+/*---------------------------------------------------------------------------*/
+static void
+recv_uc(struct unicast_conn *c, const linkaddr_t *from)
+{
+  clock_time_t sent;
+
+  if(packetbuf_datalen() != sizeof(sent)) {
+    return;
+  }
+  memcpy(&sent, packetbuf_dataptr(), sizeof(sent));
+  printf("from %d.%d latency %lu ticks\n", from->u8[0], from->u8[1],
+         (unsigned long)(clock_time() - sent));
+}
+static const struct unicast_callbacks unicast_callbacks = {recv_uc};
+static struct unicast_conn uc;
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tschrdc_node_process, ev, data)
+{
+  static struct etimer et;
+  static linkaddr_t coordinator;
+  linkaddr_t addr;
+  clock_time_t now;
+  int id;
+
+  PROCESS_EXITHANDLER(unicast_close(&uc);)
+
+  PROCESS_BEGIN();
+
+#if CONTIKI_TARGET_NATIVE
+  id = native_radio_node_index() + 1;
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = id;
+  linkaddr_set_node_addr(&addr);
+#else
+  id = node_id;
+#endif
+
+  memset(&coordinator, 0, sizeof(coordinator));
+  coordinator.u8[0] = 1;
+
+  if(id == 1) {
+    tschrdc_set_coordinator(1);
+  }
+  printf("node %d.%d%s\n", linkaddr_node_addr.u8[0],
+         linkaddr_node_addr.u8[1], id == 1 ? " (coordinator)" : "");
+
+  unicast_open(&uc, 146, &unicast_callbacks);
+
+  while(1) {
+    etimer_set(&et, SEND_INTERVAL + random_rand() % CLOCK_SECOND);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+    if(id != 1 && tschrdc_is_associated()) {
+      now = clock_time();
+      packetbuf_copyfrom(&now, sizeof(now));
+      unicast_send(&uc, &coordinator);
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
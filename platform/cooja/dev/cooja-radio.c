@@ -66,6 +66,17 @@ int simLQI = 105;
 
 static const void *pending_data;
 
+/* The SFD time of the frame in simInDataBuffer, for
+   PACKETBUF_ATTR_TIMESTAMP */
+static rtimer_clock_t rx_timestamp;
+static uint8_t rx_stamped;
+
+/* In poll mode, frames are left for the RDC layer to read */
+static uint8_t poll_mode;
+
+/* The air time of len bytes at 250 kbit/s */
+#define BYTES_AIRTIME(len) ((rtimer_clock_t)((uint32_t)(len) * RTIMER_SECOND / 31250))
+
 PROCESS(cooja_radio_process, "cooja radio process");
 
 /*---------------------------------------------------------------------------*/
@@ -115,10 +126,22 @@ radio_off(void)
 }
 /*---------------------------------------------------------------------------*/
 static void
+stamp_rx(void)
+{
+  if(!rx_stamped) {
+    /* The frame is delivered when it ends; the SFD came before the
+       length byte and the frame itself */
+    rx_timestamp = RTIMER_NOW() - BYTES_AIRTIME(simInSize + 1);
+    rx_stamped = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
 doInterfaceActionsBeforeTick(void)
 {
   if(!simRadioHWOn) {
     simInSize = 0;
+    rx_stamped = 0;
     return;
   }
   if(simReceiving) {
@@ -127,7 +150,10 @@ doInterfaceActionsBeforeTick(void)
   }
 
   if(simInSize > 0) {
-    process_poll(&cooja_radio_process);
+    stamp_rx();
+    if(!poll_mode) {
+      process_poll(&cooja_radio_process);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -144,6 +170,8 @@ radio_read(void *buf, unsigned short bufsize)
   if(simInSize == 0) {
     return 0;
   }
+  stamp_rx();
+  rx_stamped = 0;
   if(bufsize < simInSize) {
     simInSize = 0; /* rx flush */
     RIMESTATS_ADD(toolong);
@@ -253,11 +281,17 @@ PROCESS_THREAD(cooja_radio_process, ev, data)
 
   while(1) {
     PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(poll_mode) {
+      continue;
+    }
 
     packetbuf_clear();
     len = radio_read(packetbuf_dataptr(), PACKETBUF_SIZE);
     if(len > 0) {
       packetbuf_set_datalen(len);
+      /* Set here rather than in radio_read(), which the RDC layer also
+         uses to read ACKs while the packetbuf holds another frame */
+      packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, rx_timestamp);
       NETSTACK_RDC.input();
     }
   }
@@ -275,18 +309,58 @@ init(void)
 static radio_result_t
 get_value(radio_param_t param, radio_value_t *value)
 {
-  return RADIO_RESULT_NOT_SUPPORTED;
+  if(value == NULL) {
+    return RADIO_RESULT_INVALID_VALUE;
+  }
+  switch(param) {
+  case RADIO_PARAM_CHANNEL:
+    *value = simRadioChannel;
+    return RADIO_RESULT_OK;
+  case RADIO_PARAM_RX_MODE:
+    *value = poll_mode ? RADIO_RX_MODE_POLL_MODE : 0;
+    return RADIO_RESULT_OK;
+  case RADIO_CONST_CHANNEL_MIN:
+    *value = 11;
+    return RADIO_RESULT_OK;
+  case RADIO_CONST_CHANNEL_MAX:
+    *value = 26;
+    return RADIO_RESULT_OK;
+  default:
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
 }
 /*---------------------------------------------------------------------------*/
 static radio_result_t
 set_value(radio_param_t param, radio_value_t value)
 {
-  return RADIO_RESULT_NOT_SUPPORTED;
+  switch(param) {
+  case RADIO_PARAM_CHANNEL:
+    if(value < 11 || value > 26) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    radio_set_channel(value);
+    return RADIO_RESULT_OK;
+  case RADIO_PARAM_RX_MODE:
+    if(value & ~RADIO_RX_MODE_POLL_MODE) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    poll_mode = (value & RADIO_RX_MODE_POLL_MODE) != 0;
+    return RADIO_RESULT_OK;
+  default:
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
 }
 /*---------------------------------------------------------------------------*/
 static radio_result_t
 get_object(radio_param_t param, void *dest, size_t size)
 {
+  if(param == RADIO_PARAM_LAST_PACKET_TIMESTAMP) {
+    if(size != sizeof(rtimer_clock_t) || dest == NULL) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    *(rtimer_clock_t *)dest = rx_timestamp;
+    return RADIO_RESULT_OK;
+  }
   return RADIO_RESULT_NOT_SUPPORTED;
 }
 /*---------------------------------------------------------------------------*/
@@ -342,6 +342,9 @@ main(int argc, char **argv)
   while(1) {
     fd_set fds;
     int n;
+#ifndef __CYGWIN__
+    int maxfd;
+#endif /* __CYGWIN__ */
     struct timeval tv;
     clock_time_t next_event;
     
@@ -371,8 +374,11 @@ main(int argc, char **argv)
 #ifdef __CYGWIN__
     select(1, &fds, NULL, NULL, &tv);
 #else
-    FD_SET(tapdev_fd(), &fds);
-    if(0 > select(tapdev_fd() + 1, &fds, NULL, NULL, &tv)) {
+    maxfd = tapdev_set_fds(&fds);
+    if(maxfd < STDIN_FILENO) {
+      maxfd = STDIN_FILENO;
+    }
+    if(0 > select(maxfd + 1, &fds, NULL, NULL, &tv)) {
       perror("Call to select() failed.");
       exit(EXIT_FAILURE);
     }
@@ -263,6 +263,11 @@ typedef unsigned long clock_time_t;
 #define WWW_CONF_WEBPAGE_HEIGHT 17
 #endif /* PLATFORM_BUILD */
 
+/* T-table AES, which switches to AES-NI when the host CPU has it */
+#ifndef AES_128_CONF
+#define AES_128_CONF aes_128_ttable_driver
+#endif /* AES_128_CONF */
+
 /* Not part of C99 but actually present */
 int strcasecmp(const char*, const char*);
 
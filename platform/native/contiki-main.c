@@ -75,12 +75,54 @@
 
 #include "net/rime/rime.h"
 
+/* Callbacks are indexed by file descriptor and use fd_sets, so no
+   more than FD_SETSIZE descriptors can be handled */
 #ifdef SELECT_CONF_MAX
 #define SELECT_MAX SELECT_CONF_MAX
 #else
-#define SELECT_MAX 8
+#define SELECT_MAX FD_SETSIZE
 #endif
 
+#if SELECT_MAX > FD_SETSIZE
+#error SELECT_CONF_MAX must not be larger than FD_SETSIZE
+#endif
+
+/* On Linux, the main loop waits in epoll_wait() and uses a timerfd
+   to sleep until the next etimer expires. Otherwise it wakes up from
+   select() every millisecond. */
+#ifdef SELECT_CONF_EPOLL
+#define SELECT_EPOLL SELECT_CONF_EPOLL
+#elif defined(__linux__)
+#define SELECT_EPOLL 1
+#else
+#define SELECT_EPOLL 0
+#endif
+
+/* The number of bytes read from stdin at a time */
+#ifdef SELECT_CONF_STDIN_READ_MAX
+#define STDIN_READ_MAX SELECT_CONF_STDIN_READ_MAX
+#else
+#define STDIN_READ_MAX 256
+#endif
+
+#if SELECT_EPOLL
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define EPOLL_MAX_EVENTS 32
+
+/* Per file descriptor: the events it is registered for with epoll,
+   or FD_NOPOLL for files that epoll does not support */
+#define FD_NOPOLL 0x80
+static uint8_t select_events[SELECT_MAX];
+static int epfd = -1;
+static int tfd = -1;
+static uint8_t timer_armed;
+static clock_time_t timer_expiration;
+#endif /* SELECT_EPOLL */
+
 static const struct select_callback *select_callback[SELECT_MAX];
 static int select_max = 0;
 
@@ -102,6 +144,16 @@ select_set_callback(int fd, const struct select_callback *callback)
 
     select_callback[fd] = callback;
 
+#if SELECT_EPOLL
+    if(callback == NULL && select_events[fd] != 0) {
+      if(select_events[fd] != FD_NOPOLL) {
+        /* The descriptor may already be closed, which is fine */
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+      }
+      select_events[fd] = 0;
+    }
+#endif /* SELECT_EPOLL */
+
     /* Update fd max */
     if(callback != NULL) {
       if(fd > select_max) {
@@ -130,10 +182,23 @@ stdin_set_fd(fd_set *rset, fd_set *wset)
 static void
 stdin_handle_fd(fd_set *rset, fd_set *wset)
 {
-  char c;
+  uint8_t buf[STDIN_READ_MAX];
+  int len;
+
   if(FD_ISSET(STDIN_FILENO, rset)) {
-    if(read(STDIN_FILENO, &c, 1) > 0) {
-      pcapng_line_input_byte(c);
+    /* Leave what does not fit in the input buffer for the next round */
+    len = pcapng_line_input_room();
+    if(len > sizeof(buf)) {
+      len = sizeof(buf);
+    }
+    if(len > 0) {
+      len = read(STDIN_FILENO, buf, len);
+      if(len > 0) {
+        pcapng_line_input(buf, len);
+      } else if(len == 0) {
+        /* End of file: stop watching stdin */
+        select_set_callback(STDIN_FILENO, NULL);
+      }
     }
   }
 }
@@ -141,6 +206,175 @@ const static struct select_callback stdin_fd = {
   stdin_set_fd, stdin_handle_fd
 };
 /*---------------------------------------------------------------------------*/
+#if SELECT_EPOLL
+static void
+epoll_init(void)
+{
+  struct epoll_event ev;
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if(epfd < 0 || tfd < 0) {
+    perror("epoll");
+    exit(1);
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = tfd;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Arms the timerfd for the next etimer expiration, if it is not
+ * armed for it already.
+ *
+ * \return Non-zero if the next etimer has expired already.
+ */
+static int
+epoll_set_timer(void)
+{
+  struct itimerspec its;
+  clock_time_t next;
+  long delta;
+
+  if(!etimer_pending()) {
+    return 0;
+  }
+  next = etimer_next_expiration_time();
+  delta = (long)(next - clock_time());
+  if(delta <= 0) {
+    return 1;
+  }
+  if(!timer_armed || next != timer_expiration) {
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = delta / CLOCK_SECOND;
+    its.it_value.tv_nsec = (delta % CLOCK_SECOND) *
+      (1000000000L / CLOCK_SECOND);
+    timerfd_settime(tfd, 0, &its, NULL);
+    timer_armed = 1;
+    timer_expiration = next;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Waits for file descriptor events and calls the handlers of the
+ * descriptors that are ready. The set_fd functions are asked what to
+ * wait for on every round, as the select() based loop does, and only
+ * changes are passed on to epoll.
+ */
+static void
+epoll_run(int busy)
+{
+  static fd_set fdr, fdw;
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  struct epoll_event ev;
+  uint64_t expirations;
+  int i, n, fd, op, nopoll;
+
+  FD_ZERO(&fdr);
+  FD_ZERO(&fdw);
+  for(i = 0; i <= select_max; i++) {
+    if(select_callback[i] != NULL) {
+      select_callback[i]->set_fd(&fdr, &fdw);
+    }
+  }
+
+  nopoll = 0;
+  for(i = 0; i <= select_max; i++) {
+    if(select_events[i] == FD_NOPOLL) {
+      nopoll = 1;
+      continue;
+    }
+    memset(&ev, 0, sizeof(ev));
+    if(FD_ISSET(i, &fdr)) {
+      ev.events |= EPOLLIN;
+    }
+    if(FD_ISSET(i, &fdw)) {
+      ev.events |= EPOLLOUT;
+    }
+    if(ev.events == select_events[i]) {
+      continue;
+    }
+    ev.data.fd = i;
+    if(ev.events == 0) {
+      op = EPOLL_CTL_DEL;
+    } else if(select_events[i] == 0) {
+      op = EPOLL_CTL_ADD;
+    } else {
+      op = EPOLL_CTL_MOD;
+    }
+    if(epoll_ctl(epfd, op, i, &ev) < 0) {
+      if(errno == ENOENT && op == EPOLL_CTL_MOD) {
+        /* Closed and opened again since it was registered */
+        epoll_ctl(epfd, EPOLL_CTL_ADD, i, &ev);
+      } else if(errno == EPERM) {
+        /* Regular files are always ready, as with select() */
+        ev.events = FD_NOPOLL;
+        nopoll = 1;
+      } else if(op != EPOLL_CTL_DEL) {
+        perror("epoll_ctl");
+      }
+    }
+    select_events[i] = ev.events;
+  }
+
+  if(epoll_set_timer()) {
+    busy = 1;
+  }
+
+  n = epoll_wait(epfd, events, EPOLL_MAX_EVENTS, busy || nopoll ? 0 : -1);
+  if(n < 0) {
+    if(errno != EINTR) {
+      perror("epoll_wait");
+    }
+    return;
+  }
+
+  /* Only the descriptors that are ready are left in the sets */
+  if(nopoll) {
+    for(i = 0; i <= select_max; i++) {
+      if(select_events[i] != FD_NOPOLL) {
+        FD_CLR(i, &fdr);
+        FD_CLR(i, &fdw);
+      }
+    }
+  } else {
+    FD_ZERO(&fdr);
+    FD_ZERO(&fdw);
+  }
+  for(i = 0; i < n; i++) {
+    fd = events[i].data.fd;
+    if(fd == tfd) {
+      if(read(tfd, &expirations, sizeof(expirations)) > 0) {
+        timer_armed = 0;
+      }
+    } else {
+      if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        FD_SET(fd, &fdr);
+      }
+      if(events[i].events & (EPOLLOUT | EPOLLERR)) {
+        FD_SET(fd, &fdw);
+      }
+    }
+  }
+
+  for(i = 0; i < n; i++) {
+    fd = events[i].data.fd;
+    if(fd != tfd && select_callback[fd] != NULL) {
+      select_callback[fd]->handle_fd(&fdr, &fdw);
+    }
+  }
+  if(nopoll) {
+    for(i = 0; i <= select_max; i++) {
+      if(select_events[i] == FD_NOPOLL && select_callback[i] != NULL) {
+        select_callback[i]->handle_fd(&fdr, &fdw);
+      }
+    }
+  }
+}
+#endif /* SELECT_EPOLL */
+/*---------------------------------------------------------------------------*/
 static void
 set_rime_addr(void)
 {
@@ -250,8 +484,14 @@ main(int argc, char **argv)
   /* Make standard output unbuffered. */
   setvbuf(stdout, (char *)NULL, _IONBF, 0);
 
+#if SELECT_EPOLL
+  epoll_init();
+#endif /* SELECT_EPOLL */
   select_set_callback(STDIN_FILENO, &stdin_fd);
   while(1) {
+#if SELECT_EPOLL
+    epoll_run(process_run());
+#else /* SELECT_EPOLL */
     fd_set fdr;
     fd_set fdw;
     int maxfd;
@@ -286,6 +526,7 @@ main(int argc, char **argv)
         }
       }
     }
+#endif /* SELECT_EPOLL */
 
     etimer_request_poll();
 
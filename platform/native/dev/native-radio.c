@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2017, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *         A radio for the native platform. Every native process on
+ *         the host binds one UDP port on the loopback interface out
+ *         of NATIVE_RADIO_CONF_NODES consecutive ports, and a frame
+ *         is sent to all the other ports. A frame is only received
+ *         by radios that are on and tuned to the channel it was sent
+ *         on. Frames are timestamped by the kernel on arrival, which
+ *         stands in for the SFD timestamp of a real radio.
+ */
+
+#include "contiki.h"
+#include "dev/native-radio.h"
+#include "net/packetbuf.h"
+#include "net/netstack.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* The first UDP port of the shared medium */
+#ifdef NATIVE_RADIO_CONF_PORT
+#define NATIVE_RADIO_PORT NATIVE_RADIO_CONF_PORT
+#else
+#define NATIVE_RADIO_PORT 20220
+#endif
+
+/* The maximum number of nodes on the shared medium */
+#ifdef NATIVE_RADIO_CONF_NODES
+#define NATIVE_RADIO_NODES NATIVE_RADIO_CONF_NODES
+#else
+#define NATIVE_RADIO_NODES 16
+#endif
+
+#define NATIVE_RADIO_BUFSIZE PACKETBUF_SIZE
+
+/* Each datagram starts with the channel the frame was sent on */
+#define HDR_LEN 1
+
+#define CHANNEL_MIN 11
+#define CHANNEL_MAX 26
+
+static int sock = -1;
+static int node_index = -1;
+static uint8_t radio_is_on;
+static uint8_t channel = CHANNEL_MAX;
+
+static uint8_t rxbuf[HDR_LEN + NATIVE_RADIO_BUFSIZE];
+static int rxlen;
+static rtimer_clock_t rx_timestamp;
+/* The SFD time of the last frame read */
+static rtimer_clock_t last_timestamp;
+/* In poll mode, frames are left for the RDC layer to read */
+static uint8_t poll_mode;
+/* Set while the socket is read, since pending_packet() may interrupt
+   the main loop from an rtimer signal */
+static volatile uint8_t in_receive;
+
+static const void *pending_data;
+
+PROCESS(native_radio_process, "native radio process");
+
+/*---------------------------------------------------------------------------*/
+/* Take the next datagram off the socket, if any. Frames for another
+   channel, and all frames while the radio is off, are dropped. */
+static void
+receive(void)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  int len;
+#ifdef SO_TIMESTAMP
+  struct cmsghdr *cmsg;
+  char control[CMSG_SPACE(sizeof(struct timeval))];
+#endif /* SO_TIMESTAMP */
+
+  if(in_receive) {
+    return;
+  }
+  in_receive = 1;
+  while(rxlen == 0) {
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = rxbuf;
+    iov.iov_len = sizeof(rxbuf);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+#ifdef SO_TIMESTAMP
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+#endif /* SO_TIMESTAMP */
+
+    len = recvmsg(sock, &msg, 0);
+    if(len < 0) {
+      if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("native-radio: recvmsg");
+      }
+      break;
+    }
+    if(!radio_is_on || len <= HDR_LEN || rxbuf[0] != channel) {
+      continue;
+    }
+
+    /* The rtimer clock of the native platform is clock_time() */
+    rx_timestamp = RTIMER_NOW();
+#ifdef SO_TIMESTAMP
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+        cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP) {
+        struct timeval tv;
+        memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+        rx_timestamp = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+      }
+    }
+#endif /* SO_TIMESTAMP */
+    rxlen = len - HDR_LEN;
+  }
+  in_receive = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  FD_SET(sock, rset);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  if(FD_ISSET(sock, rset)) {
+    receive();
+    if(rxlen > 0 && !poll_mode) {
+      process_poll(&native_radio_process);
+    }
+  }
+}
+static const struct select_callback native_radio_sock_callback = {
+  set_fd, handle_fd
+};
+/*---------------------------------------------------------------------------*/
+/* Read the received frame and, if timestamp is not NULL, its SFD
+   time. The packetbuf is left alone, since the RDC layer also reads
+   ACKs from rtimer tasks while the packetbuf is in use. */
+static int
+read_frame(void *buf, unsigned short bufsize, rtimer_clock_t *timestamp)
+{
+  int len = rxlen;
+
+  if(len == 0) {
+    return 0;
+  }
+  rxlen = 0;
+  if(bufsize < len) {
+    return 0;
+  }
+  memcpy(buf, rxbuf + HDR_LEN, len);
+  last_timestamp = rx_timestamp;
+  if(timestamp != NULL) {
+    *timestamp = rx_timestamp;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short bufsize)
+{
+  return read_frame(buf, bufsize, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_send(const void *payload, unsigned short payload_len)
+{
+  struct sockaddr_in sin;
+  uint8_t txbuf[HDR_LEN + NATIVE_RADIO_BUFSIZE];
+  int i;
+
+  if(payload_len == 0 || payload_len > NATIVE_RADIO_BUFSIZE) {
+    return RADIO_TX_ERR;
+  }
+  txbuf[0] = channel;
+  memcpy(txbuf + HDR_LEN, payload, payload_len);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for(i = 0; i < NATIVE_RADIO_NODES; i++) {
+    if(i != node_index) {
+      sin.sin_port = htons(NATIVE_RADIO_PORT + i);
+      /* Ports without a node give an error, which is expected */
+      sendto(sock, txbuf, HDR_LEN + payload_len, 0,
+             (struct sockaddr *)&sin, sizeof(sin));
+    }
+  }
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prepare_packet(const void *data, unsigned short len)
+{
+  pending_data = data;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+transmit_packet(unsigned short len)
+{
+  if(pending_data == NULL) {
+    return RADIO_TX_ERR;
+  }
+  return radio_send(pending_data, len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending_packet(void)
+{
+  /* Also called from rtimer tasks, for instance while waiting for an
+     ACK, when the main loop has not had a chance to read the socket */
+  if(rxlen == 0) {
+    receive();
+  }
+  return rxlen > 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_on(void)
+{
+  radio_is_on = 1;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_off(void)
+{
+  radio_is_on = 0;
+  rxlen = 0;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(native_radio_process, ev, data)
+{
+  int len;
+  rtimer_clock_t timestamp;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL);
+    if(poll_mode) {
+      continue;
+    }
+
+    packetbuf_clear();
+    len = read_frame(packetbuf_dataptr(), PACKETBUF_SIZE, &timestamp);
+    if(len > 0) {
+      packetbuf_set_datalen(len);
+      packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, timestamp);
+      NETSTACK_RDC.input();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static int
+init(void)
+{
+  struct sockaddr_in sin;
+  int on = 1;
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if(sock < 0) {
+    perror("native-radio: socket");
+    return 0;
+  }
+#ifdef SO_TIMESTAMP
+  setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+#endif /* SO_TIMESTAMP */
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+  /* Take the first free port of the medium */
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for(node_index = 0; node_index < NATIVE_RADIO_NODES; node_index++) {
+    sin.sin_port = htons(NATIVE_RADIO_PORT + node_index);
+    if(bind(sock, (struct sockaddr *)&sin, sizeof(sin)) == 0) {
+      break;
+    }
+  }
+  if(node_index == NATIVE_RADIO_NODES) {
+    fprintf(stderr, "native-radio: all %d ports from %d are taken\n",
+            NATIVE_RADIO_NODES, NATIVE_RADIO_PORT);
+    close(sock);
+    sock = -1;
+    node_index = -1;
+    return 0;
+  }
+  PRINTF("native-radio: node %d on port %d\n",
+         node_index, NATIVE_RADIO_PORT + node_index);
+
+  select_set_callback(sock, &native_radio_sock_callback);
+  process_start(&native_radio_process, NULL);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+native_radio_node_index(void)
+{
+  return node_index;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_value(radio_param_t param, radio_value_t *value)
+{
+  if(value == NULL) {
+    return RADIO_RESULT_INVALID_VALUE;
+  }
+  switch(param) {
+  case RADIO_PARAM_POWER_MODE:
+    *value = radio_is_on ? RADIO_POWER_MODE_ON : RADIO_POWER_MODE_OFF;
+    return RADIO_RESULT_OK;
+  case RADIO_PARAM_CHANNEL:
+    *value = channel;
+    return RADIO_RESULT_OK;
+  case RADIO_PARAM_RX_MODE:
+    *value = poll_mode ? RADIO_RX_MODE_POLL_MODE : 0;
+    return RADIO_RESULT_OK;
+  case RADIO_CONST_CHANNEL_MIN:
+    *value = CHANNEL_MIN;
+    return RADIO_RESULT_OK;
+  case RADIO_CONST_CHANNEL_MAX:
+    *value = CHANNEL_MAX;
+    return RADIO_RESULT_OK;
+  default:
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_value(radio_param_t param, radio_value_t value)
+{
+  switch(param) {
+  case RADIO_PARAM_POWER_MODE:
+    if(value == RADIO_POWER_MODE_ON) {
+      radio_on();
+      return RADIO_RESULT_OK;
+    }
+    if(value == RADIO_POWER_MODE_OFF) {
+      radio_off();
+      return RADIO_RESULT_OK;
+    }
+    return RADIO_RESULT_INVALID_VALUE;
+  case RADIO_PARAM_CHANNEL:
+    if(value < CHANNEL_MIN || value > CHANNEL_MAX) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    channel = value;
+    return RADIO_RESULT_OK;
+  case RADIO_PARAM_RX_MODE:
+    if(value & ~RADIO_RX_MODE_POLL_MODE) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    poll_mode = (value & RADIO_RX_MODE_POLL_MODE) != 0;
+    return RADIO_RESULT_OK;
+  default:
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_object(radio_param_t param, void *dest, size_t size)
+{
+  if(param == RADIO_PARAM_LAST_PACKET_TIMESTAMP) {
+    if(size != sizeof(rtimer_clock_t) || dest == NULL) {
+      return RADIO_RESULT_INVALID_VALUE;
+    }
+    *(rtimer_clock_t *)dest = last_timestamp;
+    return RADIO_RESULT_OK;
+  }
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_object(radio_param_t param, const void *src, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver native_radio_driver =
+{
+  init,
+  prepare_packet,
+  transmit_packet,
+  radio_send,
+  radio_read,
+  channel_clear,
+  receiving_packet,
+  pending_packet,
+  radio_on,
+  radio_off,
+  get_value,
+  set_value,
+  get_object,
+  set_object
+};
+/*---------------------------------------------------------------------------*/
@@ -41,6 +41,8 @@
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 
 #include <unistd.h>
 #include <errno.h>
@@ -56,6 +58,10 @@
 
 #include <err.h>
 
+#ifdef linux
+#include <sys/epoll.h>
+#endif
+
 int verbose = 1;
 const char *ipaddr;
 const char *netmask;
@@ -63,6 +69,21 @@ int slipfd = 0;
 uint16_t basedelay=0,delaymsec=0;
 uint32_t startsec,startmsec,delaystartsec,delaystartmsec;
 int timestamp = 0, flowcontrol=0;
+int fastmode = 0, showstats = 0;
+
+/* Traffic counters, printed with -S */
+static struct {
+  unsigned long serial_reads;
+  unsigned long serial_bytes;
+  unsigned long serial_writes;
+  unsigned long serial_bytes_out;
+  unsigned long frames;
+  unsigned long tun_packets_out;
+  unsigned long tun_bytes_out;
+  unsigned long tun_packets_in;
+  unsigned long tun_bytes_in;
+  unsigned long dropped;
+} stats;
 
 int ssystem(const char *fmt, ...)
      __attribute__((__format__ (__printf__, 1, 2)));
@@ -150,6 +171,98 @@ is_sensible_string(const unsigned char *s, int len)
   return 1;
 }
 
+/*
+ * Act on a complete SLIP frame from the serial line: a control
+ * message, debug output, or an IP packet that goes to tun.
+ */
+void
+handle_frame(unsigned char *inbuf, int len, int outfd)
+{
+  int i;
+
+  if(inbuf[0] == '!') {
+    if(inbuf[1] == 'M') {
+      /* Read gateway MAC address and autoconfigure tap0 interface */
+      char macs[24];
+      int i, pos;
+      for(i = 0, pos = 0; i < 16; i++) {
+        macs[pos++] = inbuf[2 + i];
+        if((i & 1) == 1 && i < 14) {
+          macs[pos++] = ':';
+        }
+      }
+      if(timestamp) stamptime();
+      macs[pos] = '\0';
+//	  printf("*** Gateway's MAC address: %s\n", macs);
+      fprintf(stderr,"*** Gateway's MAC address: %s\n", macs);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s down", tundev);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s hw ether %s", tundev, &macs[6]);
+      if (timestamp) stamptime();
+      ssystem("ifconfig %s up", tundev);
+    }
+  } else if(inbuf[0] == '?') {
+    if(inbuf[1] == 'P') {
+      /* Prefix info requested */
+      struct in6_addr addr;
+      int i;
+      char *s = strchr(ipaddr, '/');
+      if(s != NULL) {
+        *s = '\0';
+      }
+      inet_pton(AF_INET6, ipaddr, &addr);
+      if(timestamp) stamptime();
+      fprintf(stderr,"*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
+ //         printf("*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
+             ipaddr,
+             addr.s6_addr[0], addr.s6_addr[1],
+             addr.s6_addr[2], addr.s6_addr[3],
+             addr.s6_addr[4], addr.s6_addr[5],
+             addr.s6_addr[6], addr.s6_addr[7]);
+      slip_send(slipfd, '!');
+      slip_send(slipfd, 'P');
+      for(i = 0; i < 8; i++) {
+        /* need to call the slip_send_char for stuffing */
+        slip_send_char(slipfd, addr.s6_addr[i]);
+      }
+      slip_send(slipfd, SLIP_END);
+    }
+#define DEBUG_LINE_MARKER '\r'
+  } else if(inbuf[0] == DEBUG_LINE_MARKER) {
+    fwrite(inbuf + 1, len - 1, 1, stdout);
+  } else if(is_sensible_string(inbuf, len)) {
+    if(verbose==1) {   /* strings already echoed below for verbose>1 */
+      if (timestamp) stamptime();
+      fwrite(inbuf, len, 1, stdout);
+    }
+  } else {
+    if(verbose>2) {
+      if (timestamp) stamptime();
+      printf("Packet from SLIP of length %d - write TUN\n", len);
+      if (verbose>4) {
+#if WIRESHARK_IMPORT_FORMAT
+        printf("0000");
+        for(i = 0; i < len; i++) printf(" %02x",inbuf[i]);
+#else
+        printf("         ");
+        for(i = 0; i < len; i++) {
+          printf("%02x", inbuf[i]);
+          if((i & 3) == 3) printf(" ");
+          if((i & 15) == 15) printf("\n         ");
+        }
+#endif
+        printf("\n");
+      }
+    }
+    if(write(outfd, inbuf, len) != len) {
+      err(1, "serial_to_tun: write");
+    }
+    stats.tun_packets_out++;
+    stats.tun_bytes_out += len;
+  }
+}
+
 /*
  * Read from serial, when we have a packet write it to tun. No output
  * buffering, input buffered by stdio.
@@ -161,7 +274,7 @@ serial_to_tun(FILE *inslip, int outfd)
     unsigned char inbuf[2000];
   } uip;
   static int inbufptr = 0;
-  int ret,i;
+  int ret;
   unsigned char c;
 
 #ifdef linux
@@ -191,85 +304,7 @@ serial_to_tun(FILE *inslip, int outfd)
   switch(c) {
   case SLIP_END:
     if(inbufptr > 0) {
-      if(uip.inbuf[0] == '!') {
-	if(uip.inbuf[1] == 'M') {
-	  /* Read gateway MAC address and autoconfigure tap0 interface */
-	  char macs[24];
-	  int i, pos;
-	  for(i = 0, pos = 0; i < 16; i++) {
-	    macs[pos++] = uip.inbuf[2 + i];
-	    if((i & 1) == 1 && i < 14) {
-	      macs[pos++] = ':';
-	    }
-	  }
-          if(timestamp) stamptime();
-	  macs[pos] = '\0';
-//	  printf("*** Gateway's MAC address: %s\n", macs);
-	  fprintf(stderr,"*** Gateway's MAC address: %s\n", macs);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s down", tundev);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s hw ether %s", tundev, &macs[6]);
-          if (timestamp) stamptime();
-	  ssystem("ifconfig %s up", tundev);
-	}
-      } else if(uip.inbuf[0] == '?') {
-	if(uip.inbuf[1] == 'P') {
-          /* Prefix info requested */
-          struct in6_addr addr;
-	  int i;
-	  char *s = strchr(ipaddr, '/');
-	  if(s != NULL) {
-	    *s = '\0';
-	  }
-          inet_pton(AF_INET6, ipaddr, &addr);
-          if(timestamp) stamptime();
-          fprintf(stderr,"*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
- //         printf("*** Address:%s => %02x%02x:%02x%02x:%02x%02x:%02x%02x\n",
-		 ipaddr, 
-		 addr.s6_addr[0], addr.s6_addr[1],
-		 addr.s6_addr[2], addr.s6_addr[3],
-		 addr.s6_addr[4], addr.s6_addr[5],
-		 addr.s6_addr[6], addr.s6_addr[7]);
-	  slip_send(slipfd, '!');
-	  slip_send(slipfd, 'P');
-	  for(i = 0; i < 8; i++) {
-	    /* need to call the slip_send_char for stuffing */
-	    slip_send_char(slipfd, addr.s6_addr[i]);
-	  }
-	  slip_send(slipfd, SLIP_END);
-        }
-#define DEBUG_LINE_MARKER '\r'
-      } else if(uip.inbuf[0] == DEBUG_LINE_MARKER) {    
-	fwrite(uip.inbuf + 1, inbufptr - 1, 1, stdout);
-      } else if(is_sensible_string(uip.inbuf, inbufptr)) {
-        if(verbose==1) {   /* strings already echoed below for verbose>1 */
-          if (timestamp) stamptime();
-          fwrite(uip.inbuf, inbufptr, 1, stdout);
-        }
-      } else {
-        if(verbose>2) {
-          if (timestamp) stamptime();
-          printf("Packet from SLIP of length %d - write TUN\n", inbufptr);
-          if (verbose>4) {
-#if WIRESHARK_IMPORT_FORMAT
-            printf("0000");
-	        for(i = 0; i < inbufptr; i++) printf(" %02x",uip.inbuf[i]);
-#else
-            printf("         ");
-            for(i = 0; i < inbufptr; i++) {
-              printf("%02x", uip.inbuf[i]);
-              if((i & 3) == 3) printf(" ");
-              if((i & 15) == 15) printf("\n         ");
-            }
-#endif
-            printf("\n");
-          }
-        }
-	if(write(outfd, uip.inbuf, inbufptr) != inbufptr) {
-	  err(1, "serial_to_tun: write");
-	}
-      }
+      handle_frame(uip.inbuf, inbufptr, outfd);
       inbufptr = 0;
     }
     break;
@@ -317,7 +352,10 @@ serial_to_tun(FILE *inslip, int outfd)
   goto read_more;
 }
 
-unsigned char slip_buf[2000];
+/* Room for several escaped packets, so that fast mode can queue more
+   than one at a time */
+#define SLIP_BUF_SIZE (16 * 1024)
+unsigned char slip_buf[SLIP_BUF_SIZE];
 int slip_end, slip_begin;
 
 void
@@ -444,6 +482,306 @@ tun_to_serial(int infd, int outfd)
   return size;
 }
 
+/*---------------------------------------------------------------------------*/
+/*
+ * High-throughput mode (-F). The serial line is read in blocks rather
+ * than one byte at a time through stdio, and SLIP is decoded a run of
+ * plain bytes at a time using a byte class table. A packet that
+ * arrives in one read without escapes is written to tun straight from
+ * the read buffer; one that spans reads is written with writev() from
+ * the frame buffer and the read buffer. Several tun packets are
+ * encoded per wakeup, as long as slip_buf has room for them.
+ */
+#define SERIAL_READ_SIZE 4096
+#define TUN_MTU          2000
+#define TUN_BATCH        4
+
+enum {
+  SLIP_PLAIN = 0,
+  SLIP_CLASS_END,
+  SLIP_CLASS_ESC,
+};
+
+static unsigned char slip_class[256];
+
+static unsigned char frame[TUN_MTU];
+static int framelen;
+static int escaped;
+
+void
+print_stats(void)
+{
+  if(timestamp) stamptime();
+  fprintf(stderr, "serial in: %lu bytes in %lu reads (%lu frames), "
+          "out: %lu bytes in %lu writes\n",
+          stats.serial_bytes, stats.serial_reads, stats.frames,
+          stats.serial_bytes_out, stats.serial_writes);
+  if(timestamp) stamptime();
+  fprintf(stderr, "tun out: %lu packets, %lu bytes; "
+          "in: %lu packets, %lu bytes; dropped %lu\n",
+          stats.tun_packets_out, stats.tun_bytes_out,
+          stats.tun_packets_in, stats.tun_bytes_in, stats.dropped);
+}
+
+static volatile sig_atomic_t got_sigusr1;
+
+void
+sigusr1(int signo)
+{
+  got_sigusr1 = 1;
+}
+
+void
+slip_class_init(void)
+{
+  slip_class[SLIP_END] = SLIP_CLASS_END;
+  slip_class[SLIP_ESC] = SLIP_CLASS_ESC;
+}
+
+static int
+is_packet(const unsigned char *a, int alen, const unsigned char *b, int blen)
+{
+  int i;
+  unsigned char first = alen > 0 ? a[0] : b[0];
+
+  if(first == '!' || first == '?' || first == DEBUG_LINE_MARKER) {
+    return 0;
+  }
+  /* Same test as is_sensible_string(), which skips the first byte */
+  for(i = 1; i < alen + blen; i++) {
+    unsigned char c = i < alen ? a[i] : b[i - alen];
+    if(c == 0 || c == '\r' || c == '\n' || c == '\t') {
+      continue;
+    } else if(c < ' ' || '~' < c) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * A frame ends. Its first framelen bytes are in frame[], the rest are
+ * the run bytes at p.
+ */
+static void
+frame_done(const unsigned char *p, int run, int outfd)
+{
+  struct iovec iov[2];
+  int n, len;
+
+  len = framelen + run;
+  if(len == 0) {
+    return;
+  }
+  stats.frames++;
+
+  if(verbose <= 2 && is_packet(frame, framelen, p, run)) {
+    n = 0;
+    if(framelen > 0) {
+      iov[n].iov_base = frame;
+      iov[n].iov_len = framelen;
+      n++;
+    }
+    if(run > 0) {
+      iov[n].iov_base = (void *)p;
+      iov[n].iov_len = run;
+      n++;
+    }
+    if(writev(outfd, iov, n) != len) {
+      err(1, "serial_to_tun: writev");
+    }
+    stats.tun_packets_out++;
+    stats.tun_bytes_out += len;
+  } else {
+    memcpy(frame + framelen, p, run);
+    handle_frame(frame, len, outfd);
+  }
+  framelen = 0;
+}
+
+/*
+ * Add one byte to the frame, with the per byte echo of the verbose
+ * levels of serial_to_tun().
+ */
+static void
+frame_add(unsigned char c)
+{
+  frame[framelen++] = c;
+
+  if((verbose==2) || (verbose==3) || (verbose>4)) {
+    if(c=='\n') {
+      if(is_sensible_string(frame, framelen)) {
+        if (timestamp) stamptime();
+        fwrite(frame, framelen, 1, stdout);
+        framelen=0;
+      }
+    }
+  } else if(verbose==4) {
+    if(c == 0 || c == '\r' || c == '\n' || c == '\t' || (c >= ' ' && c <= '~')) {
+      fwrite(&c, 1, 1, stdout);
+      if(c=='\n') if(timestamp) stamptime();
+    }
+  }
+}
+
+void
+slip_decode(const unsigned char *p, int n, int outfd)
+{
+  int run;
+  unsigned char c;
+
+  while(n > 0) {
+    if(framelen >= sizeof(frame)) {
+      if(timestamp) stamptime();
+      fprintf(stderr, "*** dropping large %d byte packet\n", framelen);
+      framelen = 0;
+      stats.dropped++;
+    }
+
+    if(!escaped && verbose <= 1) {
+      /* Take a run of plain bytes in one go */
+      for(run = 0; run < n && slip_class[p[run]] == SLIP_PLAIN; run++);
+      if(framelen + run > sizeof(frame)) {
+        run = sizeof(frame) - framelen;
+      } else if(run < n && slip_class[p[run]] == SLIP_CLASS_END) {
+        frame_done(p, run, outfd);
+        p += run + 1;
+        n -= run + 1;
+        continue;
+      }
+      memcpy(frame + framelen, p, run);
+      framelen += run;
+      p += run;
+      n -= run;
+      if(n == 0 || framelen == sizeof(frame)) {
+        continue;
+      }
+    }
+
+    c = *p++;
+    n--;
+    if(escaped) {
+      escaped = 0;
+      if(c == SLIP_ESC_END) {
+        c = SLIP_END;
+      } else if(c == SLIP_ESC_ESC) {
+        c = SLIP_ESC;
+      }
+      frame_add(c);
+    } else if(slip_class[c] == SLIP_CLASS_END) {
+      frame_done(p, 0, outfd);
+    } else if(slip_class[c] == SLIP_CLASS_ESC) {
+      escaped = 1;
+    } else {
+      frame_add(c);
+    }
+  }
+}
+
+void
+serial_to_tun_fast(int infd, int outfd)
+{
+  unsigned char buf[SERIAL_READ_SIZE];
+  int n;
+
+  for(;;) {
+    n = read(infd, buf, sizeof(buf));
+    if(n == 0) {
+      errx(1, "serial_to_tun: end of file");
+    } else if(n == -1) {
+      if(errno == EAGAIN || errno == EINTR) {
+        return;
+      }
+      err(1, "serial_to_tun: read");
+    }
+    stats.serial_reads++;
+    stats.serial_bytes += n;
+    slip_decode(buf, n, outfd);
+    if(n < sizeof(buf)) {
+      return;
+    }
+  }
+}
+
+/*
+ * Escape a packet into slip_buf a run of plain bytes at a time.
+ */
+void
+slip_encode(const unsigned char *p, int len)
+{
+  int run;
+
+  if(slip_begin > 0) {
+    memmove(slip_buf, slip_buf + slip_begin, slip_end - slip_begin);
+    slip_end -= slip_begin;
+    slip_begin = 0;
+  }
+  if(slip_end + 2 * len + 1 > sizeof(slip_buf)) {
+    err(1, "slip_send overflow");
+  }
+
+  while(len > 0) {
+    for(run = 0; run < len && slip_class[p[run]] == SLIP_PLAIN; run++);
+    memcpy(slip_buf + slip_end, p, run);
+    slip_end += run;
+    p += run;
+    len -= run;
+    if(len > 0) {
+      slip_buf[slip_end++] = SLIP_ESC;
+      slip_buf[slip_end++] = *p == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+      p++;
+      len--;
+    }
+  }
+  slip_buf[slip_end++] = SLIP_END;
+}
+
+/*
+ * Read packets from tun while slip_buf has room for them.
+ *
+ * \return The number of packets read.
+ */
+int
+tun_to_serial_fast(int infd, int max)
+{
+  unsigned char buf[TUN_MTU];
+  int size, n;
+
+  for(n = 0; n < max; n++) {
+    if(sizeof(slip_buf) - (slip_end - slip_begin) < 2 * sizeof(buf) + 1) {
+      break;
+    }
+    size = read(infd, buf, sizeof(buf));
+    if(size == -1) {
+      if(errno == EAGAIN || errno == EINTR) {
+        break;
+      }
+      err(1, "tun_to_serial: read");
+    }
+    stats.tun_packets_in++;
+    stats.tun_bytes_in += size;
+    if(verbose > 2) {
+      write_to_serial(slipfd, buf, size);
+    } else {
+      slip_encode(buf, size);
+    }
+  }
+  return n;
+}
+
+void
+slip_flushbuf_stats(int fd)
+{
+  int pending = slip_end - slip_begin;
+
+  if(pending == 0) {
+    return;
+  }
+  slip_flushbuf(fd);
+  stats.serial_writes++;
+  stats.serial_bytes_out += pending - (slip_end - slip_begin);
+}
+
 #ifndef BAUDRATE
 #define BAUDRATE B115200
 #endif
@@ -546,6 +884,9 @@ tun_alloc(char *dev, int tap)
 void
 cleanup(void)
 {
+  if(showstats) {
+    print_stats();
+  }
 #ifndef __APPLE__
   if (timestamp) stamptime();
   ssystem("ifconfig %s down", tundev);
@@ -685,6 +1026,148 @@ ifconf(const char *tundev, const char *ipaddr)
   ssystem("ifconfig %s\n", tundev);
 }
 
+/*
+ * Milliseconds left of the optional delay between outgoing packets,
+ * 0 when a packet may be sent.
+ */
+int
+delay_left(void)
+{
+  struct timeval tv;
+  int dmsec;
+
+  if(delaymsec == 0) {
+    return 0;
+  }
+  gettimeofday(&tv, NULL);
+  dmsec = (tv.tv_sec - delaystartsec) * 1000 + tv.tv_usec / 1000 - delaystartmsec;
+  if(dmsec < 0 || dmsec > delaymsec) {
+    delaymsec = 0;
+    return 0;
+  }
+  return delaymsec - dmsec;
+}
+
+void
+delay_start(void)
+{
+  struct timeval tv;
+
+  if(basedelay) {
+    gettimeofday(&tv, NULL);
+    delaymsec = basedelay;
+    delaystartsec = tv.tv_sec;
+    delaystartmsec = tv.tv_usec / 1000;
+  }
+}
+
+/*
+ * Main loop of fast mode. Uses epoll on Linux, where the interest set
+ * only changes when the output queue fills or drains, and select
+ * elsewhere.
+ */
+void
+fast_loop(int tunfd)
+{
+  int slipin, slipout, tunin;
+  int wait, room;
+#ifdef linux
+  struct epoll_event ev, events[2];
+  uint32_t slipmask = EPOLLIN, tunmask = EPOLLIN;
+  int epfd, i, n;
+
+  epfd = epoll_create(2);
+  if(epfd == -1) err(1, "epoll_create");
+  ev.events = slipmask;
+  ev.data.fd = slipfd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, slipfd, &ev) == -1) err(1, "epoll_ctl");
+  ev.events = tunmask;
+  ev.data.fd = tunfd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, tunfd, &ev) == -1) err(1, "epoll_ctl");
+#else
+  fd_set rset, wset;
+  struct timeval tv;
+  int maxfd = slipfd > tunfd ? slipfd : tunfd;
+#endif
+
+  fcntl(tunfd, F_SETFL, fcntl(tunfd, F_GETFL) | O_NONBLOCK);
+
+  while(1) {
+    if(got_sigusr1) {
+      got_sigusr1 = 0;
+      print_stats();
+    }
+
+    wait = delay_left();
+    room = wait == 0 &&
+      sizeof(slip_buf) - (slip_end - slip_begin) >= 2 * TUN_MTU + 1;
+
+#ifdef linux
+    if(slipmask != (slip_empty() ? EPOLLIN : EPOLLIN | EPOLLOUT)) {
+      slipmask ^= EPOLLOUT;
+      ev.events = slipmask;
+      ev.data.fd = slipfd;
+      if(epoll_ctl(epfd, EPOLL_CTL_MOD, slipfd, &ev) == -1) err(1, "epoll_ctl");
+    }
+    if(tunmask != (room ? EPOLLIN : 0)) {
+      tunmask ^= EPOLLIN;
+      ev.events = tunmask;
+      ev.data.fd = tunfd;
+      if(epoll_ctl(epfd, EPOLL_CTL_MOD, tunfd, &ev) == -1) err(1, "epoll_ctl");
+    }
+
+    n = epoll_wait(epfd, events, 2, wait ? wait : -1);
+    if(n == -1) {
+      if(errno == EINTR) continue;
+      err(1, "epoll_wait");
+    }
+    slipin = slipout = tunin = 0;
+    for(i = 0; i < n; i++) {
+      if(events[i].data.fd == slipfd) {
+        slipin = events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+        slipout = events[i].events & EPOLLOUT;
+      } else {
+        tunin = 1;
+      }
+    }
+#else
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    FD_SET(slipfd, &rset);
+    if(!slip_empty()) {
+      FD_SET(slipfd, &wset);
+    }
+    if(room) {
+      FD_SET(tunfd, &rset);
+    }
+    tv.tv_sec = wait / 1000;
+    tv.tv_usec = (wait % 1000) * 1000;
+    if(select(maxfd + 1, &rset, &wset, NULL, wait ? &tv : NULL) == -1) {
+      if(errno == EINTR) continue;
+      err(1, "select");
+    }
+    slipin = FD_ISSET(slipfd, &rset);
+    slipout = FD_ISSET(slipfd, &wset);
+    tunin = FD_ISSET(tunfd, &rset);
+#endif
+
+    if(slipin) {
+      serial_to_tun_fast(slipfd, tunfd);
+    }
+    if(tunin && delay_left() == 0) {
+      /* With a delay between packets, send one at a time */
+      if(tun_to_serial_fast(tunfd, basedelay ? 1 : TUN_BATCH) > 0) {
+        slipout = 1;
+        delay_start();
+      }
+    }
+    if(slipout) {
+      slip_flushbuf_stats(slipfd);
+      sigalarm_reset();
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 int
 main(int argc, char **argv)
 {
@@ -704,12 +1187,16 @@ main(int argc, char **argv)
   prog = argv[0];
   setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
-  while((c = getopt(argc, argv, "B:HLhs:t:v::d::a:p:T")) != -1) {
+  while((c = getopt(argc, argv, "B:FHLShs:t:v::d::a:p:T")) != -1) {
     switch(c) {
     case 'B':
       baudrate = atoi(optarg);
       break;
 
+    case 'F':
+      fastmode=1;
+      break;
+
     case 'H':
       flowcontrol=1;
       break;
@@ -718,6 +1205,10 @@ main(int argc, char **argv)
       timestamp=1;
       break;
 
+    case 'S':
+      showstats=1;
+      break;
+
     case 's':
       if(strncmp("/dev/", optarg, 5) == 0) {
 	siodev = optarg + 5;
@@ -767,8 +1258,10 @@ fprintf(stderr," -B baudrate    9600,19200,38400,57600,115200 (default),230400,4
 #else
 fprintf(stderr," -B baudrate    9600,19200,38400,57600,115200 (default),230400\n");
 #endif
+fprintf(stderr," -F             Fast mode: block reads and batched SLIP framing\n");
 fprintf(stderr," -H             Hardware CTS/RTS flow control (default disabled)\n");
 fprintf(stderr," -L             Log output format (adds time stamps)\n");
+fprintf(stderr," -S             Print traffic counters on SIGUSR1 and at exit (with -F)\n");
 fprintf(stderr," -s siodev      Serial device (default /dev/ttyUSB0)\n");
 fprintf(stderr," -T             Make tap interface (default is tun interface)\n");
 fprintf(stderr," -t tundev      Name of interface (default tap0 or tun0)\n");
@@ -793,7 +1286,7 @@ exit(1);
   argv += (optind - 1);
 
   if(argc != 2 && argc != 3) {
-    err(1, "usage: %s [-B baudrate] [-H] [-L] [-s siodev] [-t tundev] [-T] [-v verbosity] [-d delay] [-a serveraddress] [-p serverport] ipaddress", prog);
+    err(1, "usage: %s [-B baudrate] [-F] [-H] [-L] [-S] [-s siodev] [-t tundev] [-T] [-v verbosity] [-d delay] [-a serveraddress] [-p serverport] ipaddress", prog);
   }
   ipaddr = argv[1];
 
@@ -926,8 +1419,16 @@ exit(1);
   signal(SIGTERM, sigcleanup);
   signal(SIGINT, sigcleanup);
   signal(SIGALRM, sigalarm);
+  if(showstats) {
+    signal(SIGUSR1, sigusr1);
+  }
   ifconf(tundev, ipaddr);
 
+  if(fastmode) {
+    slip_class_init();
+    fast_loop(tunfd);
+  }
+
   while(1) {
     maxfd = 0;
     FD_ZERO(&rset);